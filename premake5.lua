@@ -59,6 +59,8 @@ project "ToyRaygun"
         path.join(SRC_DIR, "*.h"),
         path.join(SRC_DIR, "engine/*.cpp"), 
         path.join(SRC_DIR, "engine/*.h"),
+        path.join(SRC_DIR, "engine/CPU/**.cpp"),
+        path.join(SRC_DIR, "engine/CPU/**.h"),
         path.join(RUNTIME_DIR, "shaders/**.h")
     }
 
@@ -73,6 +75,9 @@ project "ToyRaygun"
         }
 
     filter "system:windows"
+        -- The CPU renderer's BVH8 node test uses AVX2, it falls back to scalar code without it.
+        vectorextensions "AVX2"
+
         includedirs {
             path.join(LIB_DIR, "SDL2-2.0.18/include/"),  
             path.join(LIB_DIR, "bx/include/compat/msvc/"),
@@ -125,8 +130,22 @@ project "ToyRaygun"
             "QuartzCore.framework",     
         }
 
+    -- No GPU backend on linux yet, only the CPU renderer. bx needs to be built for linux separately.
+    filter "system:linux"
+        vectorextensions "AVX2"
+
+        libdirs { 
+            path.join(LIB_DIR, "bx/lib/linux/")
+        }
+
+        links { 
+            "bxRelease",
+            "pthread",
+            "dl"
+        }
+
     -- use if statement so these functions won't be called at all on windows.
-    if os.host() == "macosx" then
+    if os.host() == "macosx" or os.host() == "linux" then
         pkgconfig.add_includes("sdl2")
         pkgconfig.add_links("sdl2")
     end
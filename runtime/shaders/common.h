@@ -29,8 +29,13 @@ struct Uniforms
     unsigned int width;
     unsigned int height;
     unsigned int frameIndex;
+    unsigned int indexSize;  // Bytes per index, 2 or 4.
     Camera camera;
     AreaLight light;
+
+    // The light's triangles in the baked scene, none if there isn't a light.
+    unsigned int lightFirstTriangle;
+    unsigned int lightTriangleCount;
 };
 
 float D3DX_FLOAT_to_SRGB(float val)
@@ -155,6 +160,9 @@ inline LightSample sampleAreaLight(AreaLight light,
     // surface normal
     result.color *= saturate(dot(vertexNormal, result.direction));
     
+    // The light's color is its radiance, so a bigger light gives off more
+    result.color *= 4.0f * length(cross(light.right, light.up));
+    
     return result;
 }
 
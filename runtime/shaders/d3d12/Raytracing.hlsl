@@ -60,6 +60,17 @@ uint3 Load3x16BitIndices(uint offsetBytes)
     return indices;
 }
 
+// Indices are 16 bit for small scenes and 32 bit for big ones, see GpuGeometryPacker.
+uint3 LoadTriangleIndices(uint triangleIndex)
+{
+    if (uniforms.indexSize == 4)
+    {
+        return Indices.Load3(triangleIndex * 12);
+    }
+
+    return Load3x16BitIndices(triangleIndex * 6);
+}
+
 typedef BuiltInTriangleIntersectionAttributes MyAttributes;
 
 struct RayPayload
@@ -187,15 +198,9 @@ void primaryHit(inout RayPayload payload, in MyAttributes attr)
 {
     float3 hitPosition = HitWorldPosition();
 
-    // Get the base index of the triangle's first 16 bit index.
-    uint indexSizeInBytes = 2;
-    uint indicesPerTriangle = 3;
-    uint triangleIndexStride = indicesPerTriangle * indexSizeInBytes;
+    // Load up the 3 indices for the triangle.
     uint triangleIndex = PrimitiveIndex();
-    uint baseIndex = triangleIndex * triangleIndexStride;
-
-    // Load up 3 16 bit indices for the triangle.
-    const uint3 indices = Load3x16BitIndices(baseIndex);
+    const uint3 indices = LoadTriangleIndices(triangleIndex);
 
     // Retrieve corresponding vertex normals for the triangle vertices.
     float3 vertexNormals[3] = {
@@ -230,7 +235,8 @@ void primaryHit(inout RayPayload payload, in MyAttributes attr)
         LightSample light;
         light = sampleAreaLight(uniforms.light, r, hitPosition, vertexNormal);
 
-        float3 primaryLightColor = light.color;
+        // Lambertian BRDF is the vertex color over PI, like getDirectLighting() on the CPU.
+        float3 primaryLightColor = light.color * (1.0f / PI);
 
         // Trace Shadow Ray
         RayDesc shadowRay;
@@ -261,10 +267,12 @@ void primaryHit(inout RayPayload payload, in MyAttributes attr)
         payload.color = float4((primaryLightColor * vertexColor * shadowFactor) + (secondaryLightColor * vertexColor), 1.0);
     }
 
-    // Emissive
+    // Emissive, vertex colors carry the emitter's radiance. Bounces already got the light
+    // in the uniforms through their shadow rays, any other emitter they hit adds its own.
     if (materialID == MATERIAL_EMISSIVE)
     {
-        payload.color = float4(uniforms.light.color, 1.0);
+        bool sampledLight = (triangleIndex - uniforms.lightFirstTriangle) < uniforms.lightTriangleCount;
+        payload.color = (payload.recursionDepth > 1 && sampledLight) ? float4(0.0, 0.0, 0.0, 1.0) : float4(vertexColor, 1.0);
     }
 }
 
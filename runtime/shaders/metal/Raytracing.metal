@@ -90,10 +90,16 @@ kernel void raygen(uint2 tid [[thread_position_in_grid]],
     }
 }
 
+// Indices are 16 bit for small scenes and 32 bit for big ones, see GpuGeometryPacker.
+inline uint loadVertexIndex(device uint *indices, unsigned int indexSize, unsigned int i)
+{
+    return (indexSize == 2) ? ((device ushort *)indices)[i] : indices[i];
+}
+
 // Interpolates vertex attribute of an arbitrary type across the surface of a triangle
 // given the barycentric coordinates and triangle index in an intersection struct
 template<typename T>
-inline T interpolateVertexAttribute(device T *attributes, Intersection intersection)
+inline T interpolateVertexAttribute(device T *attributes, device uint *indices, unsigned int indexSize, Intersection intersection)
 {
     // Barycentric coordinates sum to one
     float3 uvw;
@@ -102,10 +108,10 @@ inline T interpolateVertexAttribute(device T *attributes, Intersection intersect
     
     unsigned int triangleIndex = intersection.primitiveIndex;
     
-    // Lookup value for each vertex
-    T T0 = attributes[triangleIndex * 3 + 0];
-    T T1 = attributes[triangleIndex * 3 + 1];
-    T T2 = attributes[triangleIndex * 3 + 2];
+    // Lookup value for each vertex, welded scenes share vertices between triangles.
+    T T0 = attributes[loadVertexIndex(indices, indexSize, triangleIndex * 3 + 0)];
+    T T1 = attributes[loadVertexIndex(indices, indexSize, triangleIndex * 3 + 1)];
+    T T2 = attributes[loadVertexIndex(indices, indexSize, triangleIndex * 3 + 2)];
     
     // Compute sum of vertex attributes weighted by barycentric coordinates
     return uvw.x * T0 + uvw.y * T1 + uvw.z * T2;
@@ -121,6 +127,7 @@ kernel void primaryHit(uint2 tid [[thread_position_in_grid]],
                         device packed_float3 *vertexNormals,
                         device uint *triangleMasks,
                         constant unsigned int & bounce,
+                        device uint *vertexIndices,
                         texture2d<unsigned int> randomTex,
                         texture2d<float, access::write> dstTex)
 {
@@ -153,10 +160,10 @@ kernel void primaryHit(uint2 tid [[thread_position_in_grid]],
         float3 intersectionPoint = ray.origin + ray.direction * intersection.distance;
 
         // Interpolate the vertex color at the intersection point
-        float3 vertexColor = interpolateVertexAttribute(vertexColors, intersection);
+        float3 vertexColor = interpolateVertexAttribute(vertexColors, vertexIndices, uniforms.indexSize, intersection);
         
         // Interpolate the vertex normal at the intersection point
-        float3 vertexNormal = interpolateVertexAttribute(vertexNormals, intersection);
+        float3 vertexNormal = interpolateVertexAttribute(vertexNormals, vertexIndices, uniforms.indexSize, intersection);
         vertexNormal = normalize(vertexNormal);
 
         unsigned int offset = randomTex.read(tid).x;
@@ -167,7 +174,8 @@ kernel void primaryHit(uint2 tid [[thread_position_in_grid]],
         
         LightSample light = sampleAreaLight(uniforms.light, r, intersectionPoint, vertexNormal);
         
-        // Add the vertex color to the ray color.
+        // Add the vertex color to the ray color. The light sample also takes the Lambertian
+        // BRDF's 1 / PI, like getDirectLighting() on the CPU.
         color *= vertexColor;
         
         // Setup Shadow Ray.
@@ -175,7 +183,7 @@ kernel void primaryHit(uint2 tid [[thread_position_in_grid]],
         shadowRay.direction = light.direction;
         shadowRay.mask = RAY_MASK_SHADOW;
         shadowRay.maxDistance = light.distance - 1e-3f;
-        shadowRay.color = light.color * color;
+        shadowRay.color = light.color * color * (1.0f / PI);
             
         // Next we choose a random direction to continue the path of the ray. This will
         // cause light to bounce between surfaces. Normally we would apply a fair bit of math
@@ -199,13 +207,29 @@ kernel void primaryHit(uint2 tid [[thread_position_in_grid]],
     }
     else if (materialID == MATERIAL_EMISSIVE)
     {
-        // In this case, a ray coming from the camera hit the light source directly, so
-        // we'll write the light color into the output image.
-        dstTex.write(float4(uniforms.light.color, 1.0f), tid);
+        // Vertex colors carry the emitter's radiance. Bounces already got the light in the
+        // uniforms through their shadow rays, any other emitter they hit adds its own.
+        bool sampledLight = ((uint)intersection.primitiveIndex - uniforms.lightFirstTriangle) < uniforms.lightTriangleCount;
+        if (bounce == 0 || !sampledLight)
+        {
+            float3 vertexColor = interpolateVertexAttribute(vertexColors, vertexIndices, uniforms.indexSize, intersection);
+            float3 intersectionPoint = ray.origin + ray.direction * intersection.distance;
+            
+            // Only shadowHit() adds to the image, so the emission goes along with a shadow
+            // ray that can't be blocked: a short one back the way the ray came.
+            shadowRay.origin = intersectionPoint - ray.direction * 1e-3f;
+            shadowRay.direction = -ray.direction;
+            shadowRay.mask = RAY_MASK_SHADOW;
+            shadowRay.maxDistance = 1e-4f;
+            shadowRay.color = vertexColor * color;
+        }
+        else
+        {
+            shadowRay.maxDistance = -1.0f;
+        }
         
         // Terminate the ray's path
         ray.maxDistance = -1.0f;
-        shadowRay.maxDistance = -1.0f;
     }
     else
     {
@@ -8,9 +8,10 @@
 
 #include "engine/Scene.h"
 
-Scene* createCornellBoxScene()
+Scene* createCornellBoxScene(bool weldVertices = false)
 {
     Scene* scene = new Scene();
+    scene->setVertexWelding(weldVertices);
     
     float* transform = new float[16];
     
@@ -42,9 +43,9 @@ Scene* createCornellBoxScene()
     bx::mtxSRT(transform, 2.0f, 2.0f, 2.0f, -bx::kPi / 2.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f);
     scene->addPlane(bx::Vec3(0.725f, 0.71f, 0.68f), transform);
     
-    // Light source
+    // Light source, a quarter square unit so it's four times as bright as its power
     bx::mtxSRT(transform, 0.5f, 1.98f, 0.5f, 0.0f, 0.0f, bx::kPi, 0.0f, 1.0f, 0.0f);
-    scene->addAreaLight(bx::Vec3(1.0f, 1.0f, 1.0f), transform);
+    scene->addAreaLight(bx::Vec3(4.0f, 4.0f, 4.0f), transform);
     
     delete[] transform;
 
@@ -0,0 +1,87 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#ifndef CPU_ACCUMULATE_HEADER_GUARD
+#define CPU_ACCUMULATE_HEADER_GUARD
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace toyraygun
+{
+    // Folds one frame's RGBA samples into the running average in place, the CPU version
+    // of Accumulate.hlsl. Accumulate.hlsl computes (average * frameIndex + sample) /
+    // (frameIndex + 1), which scales the average back up to a sum that loses precision as
+    // frames pile up. Moving the average towards the sample by 1 / (frameIndex + 1) keeps
+    // every value near the size of a pixel instead and still converges after 100k frames.
+    inline void accumulateSamples(const float* samples, float* average, uint32_t pixelCount, uint32_t frameIndex)
+    {
+        const uint32_t valueCount = pixelCount * 4;
+
+        // The first frame replaces whatever was left from before.
+        if (frameIndex == 0)
+        {
+            memcpy(average, samples, valueCount * sizeof(float));
+            return;
+        }
+
+        const float weight = 1.0f / float(frameIndex + 1);
+
+        uint32_t i = 0;
+#if defined(__AVX2__)
+        // Two pixels at a time. Alpha is 1 in both so it stays 1.
+        const __m256 weight8 = _mm256_set1_ps(weight);
+        for (; i + 8 <= valueCount; i += 8)
+        {
+            __m256 value = _mm256_loadu_ps(average + i);
+            __m256 delta = _mm256_sub_ps(_mm256_loadu_ps(samples + i), value);
+            _mm256_storeu_ps(average + i, _mm256_add_ps(value, _mm256_mul_ps(delta, weight8)));
+        }
+#endif
+
+        for (; i < valueCount; ++i)
+        {
+            average[i] += (samples[i] - average[i]) * weight;
+        }
+    }
+
+    // accumulateSamples() that also keeps the sum of squared differences from the mean of
+    // each pixel's luminance (Welford's method), for estimating how noisy the average is.
+    // The luminance of the average is the average luminance so only M2 needs storing.
+    inline void accumulateSamplesAndVariance(const float* samples, float* average, float* luminanceM2, uint32_t pixelCount, uint32_t frameIndex)
+    {
+        const float weight = 1.0f / float(frameIndex + 1);
+
+        for (uint32_t i = 0; i < pixelCount; ++i)
+        {
+            const float* sample = &samples[i * 4];
+            float* value = &average[i * 4];
+
+            if (frameIndex == 0)
+            {
+                memcpy(value, sample, 4 * sizeof(float));
+                luminanceM2[i] = 0.0f;
+                continue;
+            }
+
+            const float sampleLuminance = (0.2126f * sample[0]) + (0.7152f * sample[1]) + (0.0722f * sample[2]);
+            const float oldLuminance = (0.2126f * value[0]) + (0.7152f * value[1]) + (0.0722f * value[2]);
+
+            for (uint32_t c = 0; c < 4; ++c)
+            {
+                value[c] += (sample[c] - value[c]) * weight;
+            }
+
+            const float newLuminance = (0.2126f * value[0]) + (0.7152f * value[1]) + (0.0722f * value[2]);
+            luminanceM2[i] += (sampleLuminance - oldLuminance) * (sampleLuminance - newLuminance);
+        }
+    }
+}
+
+#endif // CPU_ACCUMULATE_HEADER_GUARD
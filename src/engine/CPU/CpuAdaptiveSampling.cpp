@@ -0,0 +1,208 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#include "CpuAdaptiveSampling.h"
+using namespace toyraygun;
+
+#include <algorithm>
+#include <float.h>
+#include <iostream>
+#include <bx/math.h>
+
+CpuAdaptiveSampling::CpuAdaptiveSampling() :
+    m_width(0),
+    m_height(0),
+    m_blockSize(1),
+    m_blockCountX(0),
+    m_blockCountY(0),
+    m_threshold(0.0f),
+    m_minSamples(0),
+    m_activeBlockCount(0),
+    m_frameSampleCount(0)
+{
+
+}
+
+void CpuAdaptiveSampling::init(uint32_t width, uint32_t height, uint32_t blockSize, float threshold, uint32_t minSamples)
+{
+    m_width = width;
+    m_height = height;
+    m_blockSize = blockSize;
+    m_blockCountX = (width + blockSize - 1) / blockSize;
+    m_blockCountY = (height + blockSize - 1) / blockSize;
+    m_threshold = threshold;
+
+    // The variance estimate needs a couple of samples to mean anything.
+    m_minSamples = bx::max<uint32_t>(minSamples, 2);
+
+    m_sampleCounts.resize(size_t(m_blockCountX) * m_blockCountY);
+    m_converged.resize(size_t(m_blockCountX) * m_blockCountY);
+    m_passCounts.resize(size_t(m_blockCountX) * m_blockCountY);
+    m_errors.resize(size_t(m_blockCountX) * m_blockCountY);
+    m_activeBlocks.reserve(size_t(m_blockCountX) * m_blockCountY);
+    m_luminanceM2.resize(size_t(width) * height);
+
+    reset();
+}
+
+void CpuAdaptiveSampling::destroy()
+{
+    std::vector<uint32_t>().swap(m_sampleCounts);
+    std::vector<uint8_t>().swap(m_converged);
+    std::vector<uint8_t>().swap(m_passCounts);
+    std::vector<float>().swap(m_errors);
+    std::vector<uint32_t>().swap(m_activeBlocks);
+    std::vector<float>().swap(m_luminanceM2);
+}
+
+void CpuAdaptiveSampling::reset()
+{
+    std::fill(m_sampleCounts.begin(), m_sampleCounts.end(), 0);
+    std::fill(m_converged.begin(), m_converged.end(), 0);
+    std::fill(m_passCounts.begin(), m_passCounts.end(), 1);
+    std::fill(m_errors.begin(), m_errors.end(), FLT_MAX);
+    m_activeBlockCount = getBlockCount();
+    m_frameSampleCount = getBlockCount();
+}
+
+void CpuAdaptiveSampling::finishBlock(uint32_t blockIndex, uint32_t passCount, const float* average)
+{
+    const uint32_t sampleCount = m_sampleCounts[blockIndex] + passCount;
+    m_sampleCounts[blockIndex] = sampleCount;
+
+    if (sampleCount < m_minSamples)
+    {
+        return;
+    }
+
+    const uint32_t x0 = (blockIndex % m_blockCountX) * m_blockSize;
+    const uint32_t y0 = (blockIndex / m_blockCountX) * m_blockSize;
+    const uint32_t x1 = bx::min(x0 + m_blockSize, m_width);
+    const uint32_t y1 = bx::min(y0 + m_blockSize, m_height);
+
+    // Variance of a pixel's average is the sample variance over the sample count.
+    const float varianceScale = 1.0f / (float(sampleCount) * float(sampleCount - 1));
+
+    float maxError2 = 0.0f;
+    for (uint32_t y = y0; y < y1; ++y)
+    {
+        for (uint32_t x = x0; x < x1; ++x)
+        {
+            const uint32_t pixelIndex = (y * m_width) + x;
+            const float* color = &average[pixelIndex * 4];
+            const float luminance = (0.2126f * color[0]) + (0.7152f * color[1]) + (0.0722f * color[2]);
+
+            // Relative to the square root of the brightness, error in dark areas stands out
+            // more than relative error alone suggests.
+            const float error2 = (m_luminanceM2[pixelIndex] * varianceScale) / bx::max(luminance, 0.001f);
+            maxError2 = bx::max(maxError2, error2);
+        }
+    }
+
+    m_errors[blockIndex] = maxError2;
+    m_converged[blockIndex] = (maxError2 <= m_threshold * m_threshold) ? 1 : 0;
+}
+
+void CpuAdaptiveSampling::finishFrame()
+{
+    const uint32_t blockCount = getBlockCount();
+
+    m_activeBlocks.clear();
+    for (uint32_t i = 0; i < blockCount; ++i)
+    {
+        m_passCounts[i] = 0;
+        if (!m_converged[i])
+        {
+            m_activeBlocks.push_back(i);
+        }
+    }
+
+    const uint32_t activeBlockCount = (uint32_t)m_activeBlocks.size();
+    if (activeBlockCount == 0)
+    {
+        if (m_activeBlockCount > 0)
+        {
+            std::cout << "Adaptive sampling: every block has converged." << std::endl;
+        }
+
+        m_activeBlockCount = 0;
+        m_frameSampleCount = 0;
+        return;
+    }
+
+    // Every active block gets the same whole number of passes, the noisiest blocks get
+    // one more each for what's left over.
+    uint32_t passCount = blockCount / activeBlockCount;
+    uint32_t extraCount = blockCount - (passCount * activeBlockCount);
+    if (passCount >= kMaxPassesPerFrame)
+    {
+        passCount = kMaxPassesPerFrame;
+        extraCount = 0;
+    }
+
+    if (extraCount > 0)
+    {
+        std::nth_element(m_activeBlocks.begin(), m_activeBlocks.begin() + (extraCount - 1), m_activeBlocks.end(),
+            [&](uint32_t a, uint32_t b) { return m_errors[a] > m_errors[b]; });
+    }
+
+    for (uint32_t i = 0; i < activeBlockCount; ++i)
+    {
+        m_passCounts[m_activeBlocks[i]] = uint8_t(passCount + (i < extraCount ? 1 : 0));
+    }
+
+    m_activeBlockCount = activeBlockCount;
+    m_frameSampleCount = (passCount * activeBlockCount) + extraCount;
+}
+
+uint32_t CpuAdaptiveSampling::getBlockCount() const
+{
+    return m_blockCountX * m_blockCountY;
+}
+
+uint32_t CpuAdaptiveSampling::getActiveBlockCount() const
+{
+    return m_activeBlockCount;
+}
+
+uint32_t CpuAdaptiveSampling::getFrameSampleCount() const
+{
+    return m_frameSampleCount;
+}
+
+float CpuAdaptiveSampling::getThreshold() const
+{
+    return m_threshold;
+}
+
+uint32_t CpuAdaptiveSampling::getMinSamples() const
+{
+    return m_minSamples;
+}
+
+void CpuAdaptiveSampling::writeMask(uint32_t* pixels) const
+{
+    uint32_t maxSampleCount = 1;
+    for (size_t i = 0; i < m_sampleCounts.size(); ++i)
+    {
+        maxSampleCount = bx::max(maxSampleCount, m_sampleCounts[i]);
+    }
+
+    for (uint32_t y = 0; y < m_height; ++y)
+    {
+        for (uint32_t x = 0; x < m_width; ++x)
+        {
+            const uint32_t blockIndex = getBlockIndex(x, y);
+            const uint32_t value = (m_sampleCounts[blockIndex] * 255) / maxSampleCount;
+
+            uint32_t pixel = 0xff000000 | value;
+            if (m_converged[blockIndex])
+            {
+                pixel |= (value << 8) | (value << 16);
+            }
+            pixels[(y * m_width) + x] = pixel;
+        }
+    }
+}
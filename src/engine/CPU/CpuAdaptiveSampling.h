@@ -0,0 +1,98 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#ifndef CPU_ADAPTIVESAMPLING_HEADER_GUARD
+#define CPU_ADAPTIVESAMPLING_HEADER_GUARD
+
+#include <stdint.h>
+#include <vector>
+
+namespace toyraygun
+{
+    // Decides which blocks of pixels still need samples. Every pixel tracks the variance
+    // of its luminance as it accumulates, a block stops once the standard error of each
+    // of its pixels' averages, relative to the square root of its brightness, is below the
+    // threshold. Blocks rather than single pixels, since a pixel that has only seen black
+    // so far looks converged on its own. Rays saved on converged blocks go to the rest:
+    // each frame the remaining blocks share a frame's usual budget of a sample per pixel,
+    // with the noisiest getting the passes that don't divide evenly.
+    class CpuAdaptiveSampling
+    {
+    public:
+        static const uint32_t kMaxPassesPerFrame = 8;
+
+    protected:
+        uint32_t m_width;
+        uint32_t m_height;
+        uint32_t m_blockSize;
+        uint32_t m_blockCountX;
+        uint32_t m_blockCountY;
+
+        float m_threshold;
+        uint32_t m_minSamples;
+
+        // Per block
+        std::vector<uint32_t> m_sampleCounts;
+        std::vector<uint8_t> m_converged;
+        std::vector<uint8_t> m_passCounts;
+        std::vector<float> m_errors;  // Squared, of the block's noisiest pixel.
+        std::vector<uint32_t> m_activeBlocks;
+
+        // Per pixel, see accumulateSamplesAndVariance().
+        std::vector<float> m_luminanceM2;
+
+        uint32_t m_activeBlockCount;
+        uint32_t m_frameSampleCount;
+
+    public:
+        CpuAdaptiveSampling();
+
+        void init(uint32_t width, uint32_t height, uint32_t blockSize, float threshold, uint32_t minSamples);
+        void destroy();
+
+        // Starts over, every block needs samples again.
+        void reset();
+
+        uint32_t getBlockIndex(uint32_t x, uint32_t y) const
+        {
+            return ((y / m_blockSize) * m_blockCountX) + (x / m_blockSize);
+        }
+
+        // Samples this frame, zero once the block has converged.
+        uint32_t getPassCount(uint32_t blockIndex) const
+        {
+            return m_passCounts[blockIndex];
+        }
+
+        uint32_t getSampleCount(uint32_t blockIndex) const
+        {
+            return m_sampleCounts[blockIndex];
+        }
+
+        float* getLuminanceM2(uint32_t pixelIndex)
+        {
+            return &m_luminanceM2[pixelIndex];
+        }
+
+        // Called by the thread that traced the block after its passes are accumulated.
+        void finishBlock(uint32_t blockIndex, uint32_t passCount, const float* average);
+
+        // Hands the budget of the blocks that converged this frame to the rest.
+        void finishFrame();
+
+        uint32_t getBlockCount() const;
+        uint32_t getActiveBlockCount() const;
+        // Block samples handed out for this frame, the block count until most have converged.
+        uint32_t getFrameSampleCount() const;
+        float getThreshold() const;
+        uint32_t getMinSamples() const;
+
+        // Mask of where the samples went: brightness is a block's sample count relative to
+        // the most sampled block, blocks still being traced are red.
+        void writeMask(uint32_t* pixels) const;
+    };
+}
+
+#endif // CPU_ADAPTIVESAMPLING_HEADER_GUARD
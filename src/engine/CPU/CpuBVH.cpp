@@ -0,0 +1,942 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#include "CpuBVH.h"
+using namespace toyraygun;
+
+#include <algorithm>
+#include <chrono>
+#include <float.h>
+#include <iostream>
+#include <string.h>
+
+static const uint32_t kBinCount = 16;
+static const uint32_t kMaxLeafSize = 8;
+static const float kTraversalCost = 1.0f;
+static const float kIntersectionCost = 1.0f;
+
+
+// Start of a tree from save(). Bump the version whenever the layout or the builder
+// changes, older saved trees are then rebuilt.
+struct CpuBVH::SavedHeader
+{
+    uint32_t version;
+    uint32_t nodeSize;
+    uint32_t nodeCount;
+    uint32_t primitiveCount;
+};
+static const uint32_t kSavedVersion = 1;
+
+// Nodes with more primitives than this have their binning spread across the pool.
+static const uint32_t kParallelBinningThreshold = 64 * 1024;
+
+// Nodes smaller than this aren't split further on the calling thread.
+static const uint32_t kMinSubtreeSize = 1024;
+
+// Trees with fewer nodes than this are refit on the calling thread.
+static const uint32_t kMinParallelRefitNodes = 16 * 1024;
+
+void CpuAABB::reset()
+{
+    min[0] = min[1] = min[2] = FLT_MAX;
+    max[0] = max[1] = max[2] = -FLT_MAX;
+}
+
+void CpuAABB::grow(const float* point)
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        min[i] = bx::min(min[i], point[i]);
+        max[i] = bx::max(max[i], point[i]);
+    }
+}
+
+void CpuAABB::grow(const CpuAABB& other)
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        min[i] = bx::min(min[i], other.min[i]);
+        max[i] = bx::max(max[i], other.max[i]);
+    }
+}
+
+float CpuAABB::getSurfaceArea() const
+{
+    float dx = max[0] - min[0];
+    float dy = max[1] - min[1];
+    float dz = max[2] - min[2];
+
+    // Empty boxes have no area.
+    if (dx < 0.0f || dy < 0.0f || dz < 0.0f)
+    {
+        return 0.0f;
+    }
+
+    return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+static void setNodeBounds(CpuBVHNode& node, const CpuAABB& bounds)
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        node.boundsMin[i] = bounds.min[i];
+        node.boundsMax[i] = bounds.max[i];
+    }
+}
+
+static CpuAABB getNodeBounds(const CpuBVHNode& node)
+{
+    CpuAABB bounds;
+    for (int i = 0; i < 3; ++i)
+    {
+        bounds.min[i] = node.boundsMin[i];
+        bounds.max[i] = node.boundsMax[i];
+    }
+    return bounds;
+}
+
+static float getNodeSurfaceArea(const CpuBVHNode& node)
+{
+    return getNodeBounds(node).getSurfaceArea();
+}
+
+static inline float getCentroid(const CpuAABB& bounds, int axis)
+{
+    return (bounds.min[axis] + bounds.max[axis]) * 0.5f;
+}
+
+static inline uint32_t getBinIndex(float centroid, float centroidMin, float binScale)
+{
+    int bin = (int)((centroid - centroidMin) * binScale);
+    return (uint32_t)bx::clamp(bin, 0, (int)kBinCount - 1);
+}
+
+struct Bin
+{
+    CpuAABB bounds;
+    uint32_t count;
+};
+
+CpuBVH::CpuBVH() :
+    m_primitivesPerTest(1),
+    m_maxLeafSize(kMaxLeafSize),
+    m_buildTimeMs(0.0f),
+    m_refitTimeMs(0.0f),
+    m_sahCost(0.0f)
+{
+
+}
+
+void CpuBVH::build(const bx::Vec3* positions, const uint32_t* indices, uint32_t triangleCount, CpuThreadPool* threadPool)
+{
+    std::vector<CpuAABB> triangleBounds(triangleCount);
+
+    auto computeBounds = [&](uint32_t start, uint32_t end, uint32_t threadIndex)
+    {
+        for (uint32_t i = start; i < end; ++i)
+        {
+            CpuAABB& bounds = triangleBounds[i];
+            bounds.reset();
+            bounds.grow(&positions[indices[(i * 3) + 0]].x);
+            bounds.grow(&positions[indices[(i * 3) + 1]].x);
+            bounds.grow(&positions[indices[(i * 3) + 2]].x);
+        }
+    };
+
+    if (threadPool != nullptr)
+    {
+        threadPool->parallelFor(triangleCount, 4096, computeBounds);
+    }
+    else
+    {
+        computeBounds(0, triangleCount, 0);
+    }
+
+    build(triangleCount > 0 ? &triangleBounds[0] : nullptr, triangleCount, kMaxLeafSize, kMaxLeafSize, threadPool);
+}
+
+void CpuBVH::build(const CpuAABB* primitiveBounds, uint32_t primitiveCount, uint32_t primitivesPerTest, uint32_t maxLeafSize, CpuThreadPool* threadPool)
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    destroy();
+
+    if (primitiveCount == 0)
+    {
+        return;
+    }
+
+    m_primitivesPerTest = bx::max(primitivesPerTest, 1u);
+    m_maxLeafSize = bx::max(maxLeafSize, 1u);
+
+    uint32_t threadCount = (threadPool != nullptr) ? threadPool->getThreadCount() : 1;
+
+    m_primitiveIndices.resize(primitiveCount);
+    m_primitiveBounds.assign(primitiveBounds, primitiveBounds + primitiveCount);
+
+    // Root bounds, reduced per thread.
+    std::vector<CpuAABB> threadBounds(threadCount);
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        threadBounds[i].reset();
+    }
+
+    auto computeBounds = [&](uint32_t start, uint32_t end, uint32_t threadIndex)
+    {
+        for (uint32_t i = start; i < end; ++i)
+        {
+            threadBounds[threadIndex].grow(m_primitiveBounds[i]);
+            m_primitiveIndices[i] = i;
+        }
+    };
+
+    if (threadPool != nullptr)
+    {
+        threadPool->parallelFor(primitiveCount, 4096, computeBounds);
+    }
+    else
+    {
+        computeBounds(0, primitiveCount, 0);
+    }
+
+    CpuAABB rootBounds;
+    rootBounds.reset();
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        rootBounds.grow(threadBounds[i]);
+    }
+
+    // Worst case is a leaf per primitive.
+    m_nodes.reserve(primitiveCount * 2);
+
+    CpuBVHNode root;
+    setNodeBounds(root, rootBounds);
+    root.leftOrFirst = 0;
+    root.count = primitiveCount;
+    m_nodes.push_back(root);
+
+    // Split the top of the tree until there are enough subtrees for every thread to have
+    // a few, largest first so the subtrees end up roughly the same size.
+    const uint32_t targetSubtreeCount = (threadCount > 1) ? threadCount * 8 : 1;
+
+    std::vector<BuildTask> pending;
+    std::vector<BuildTask> subtrees;
+
+    BuildTask rootTask = { 0, 0, primitiveCount, 0 };
+    pending.push_back(rootTask);
+
+    while (!pending.empty())
+    {
+        size_t largest = 0;
+        for (size_t i = 1; i < pending.size(); ++i)
+        {
+            if ((pending[i].end - pending[i].begin) > (pending[largest].end - pending[largest].begin))
+            {
+                largest = i;
+            }
+        }
+
+        BuildTask task = pending[largest];
+        pending[largest] = pending.back();
+        pending.pop_back();
+
+        uint32_t count = task.end - task.begin;
+        if (count < kMinSubtreeSize || (pending.size() + subtrees.size() + 1) >= targetSubtreeCount)
+        {
+            subtrees.push_back(task);
+            continue;
+        }
+
+        uint32_t mid;
+        if (!splitNode(m_nodes, task.nodeIndex, task.begin, task.end, task.depth, threadPool, mid))
+        {
+            continue;
+        }
+
+        uint32_t left = m_nodes[task.nodeIndex].leftOrFirst;
+        BuildTask leftTask = { left, task.begin, mid, task.depth + 1 };
+        BuildTask rightTask = { left + 1, mid, task.end, task.depth + 1 };
+        pending.push_back(leftTask);
+        pending.push_back(rightTask);
+    }
+
+    // Build each subtree into its own node list.
+    std::vector<std::vector<CpuBVHNode>> subtreeNodes(subtrees.size());
+
+    auto buildSubtrees = [&](uint32_t start, uint32_t end, uint32_t threadIndex)
+    {
+        for (uint32_t i = start; i < end; ++i)
+        {
+            const BuildTask& task = subtrees[i];
+            std::vector<CpuBVHNode>& nodes = subtreeNodes[i];
+
+            nodes.reserve((task.end - task.begin) * 2);
+            nodes.push_back(m_nodes[task.nodeIndex]);
+            buildSubtree(nodes, task.begin, task.end, task.depth);
+        }
+    };
+
+    if (threadPool != nullptr)
+    {
+        threadPool->parallelFor((uint32_t)subtrees.size(), 1, buildSubtrees);
+    }
+    else
+    {
+        buildSubtrees(0, (uint32_t)subtrees.size(), 0);
+    }
+
+    // Stitch the subtrees onto the top of the tree. Each subtree root replaces the node it
+    // was built from and the rest are appended.
+    std::vector<uint32_t> subtreeOffsets(subtrees.size());
+    uint32_t nodeCount = (uint32_t)m_nodes.size();
+    for (size_t i = 0; i < subtrees.size(); ++i)
+    {
+        subtreeOffsets[i] = nodeCount;
+        nodeCount += (uint32_t)subtreeNodes[i].size() - 1;
+    }
+    m_nodes.resize(nodeCount);
+
+    auto stitchSubtrees = [&](uint32_t start, uint32_t end, uint32_t threadIndex)
+    {
+        for (uint32_t i = start; i < end; ++i)
+        {
+            std::vector<CpuBVHNode>& nodes = subtreeNodes[i];
+
+            // Local node n > 0 ends up at offset + n - 1.
+            for (size_t n = 0; n < nodes.size(); ++n)
+            {
+                CpuBVHNode node = nodes[n];
+                if (!node.isLeaf())
+                {
+                    node.leftOrFirst = subtreeOffsets[i] + node.leftOrFirst - 1;
+                }
+
+                uint32_t dest = (n == 0) ? subtrees[i].nodeIndex : subtreeOffsets[i] + (uint32_t)n - 1;
+                m_nodes[dest] = node;
+            }
+
+            std::vector<CpuBVHNode>().swap(nodes);
+        }
+    };
+
+    if (threadPool != nullptr)
+    {
+        threadPool->parallelFor((uint32_t)subtrees.size(), 1, stitchSubtrees);
+    }
+    else
+    {
+        stitchSubtrees(0, (uint32_t)subtrees.size(), 0);
+    }
+
+    // Only needed during the build.
+    std::vector<CpuAABB>().swap(m_primitiveBounds);
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    m_buildTimeMs = (float)std::chrono::duration<double, std::milli>(endTime - startTime).count();
+    m_sahCost = computeSAHCost();
+
+    std::cout << "CPU BVH: " << primitiveCount << " primitives, " << m_nodes.size() << " nodes, built in "
+              << m_buildTimeMs << " ms on " << threadCount << " threads, SAH cost " << m_sahCost << std::endl;
+}
+
+void CpuBVH::save(std::vector<uint8_t>& dataOut) const
+{
+    SavedHeader header;
+    header.version = kSavedVersion;
+    header.nodeSize = sizeof(CpuBVHNode);
+    header.nodeCount = (uint32_t)m_nodes.size();
+    header.primitiveCount = (uint32_t)m_primitiveIndices.size();
+
+    const size_t nodesSize = m_nodes.size() * sizeof(CpuBVHNode);
+    const size_t primitivesSize = m_primitiveIndices.size() * sizeof(uint32_t);
+    dataOut.resize(sizeof(header) + nodesSize + primitivesSize);
+    memcpy(&dataOut[0], &header, sizeof(header));
+    memcpy(&dataOut[sizeof(header)], m_nodes.data(), nodesSize);
+    memcpy(&dataOut[sizeof(header) + nodesSize], m_primitiveIndices.data(), primitivesSize);
+}
+
+bool CpuBVH::load(const uint8_t* data, size_t size, uint32_t primitiveCount)
+{
+    destroy();
+
+    SavedHeader header;
+    if (size < sizeof(header))
+    {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    if (header.version != kSavedVersion || header.nodeSize != sizeof(CpuBVHNode))
+    {
+        std::cout << "CPU BVH: prebuilt tree was saved by a different version." << std::endl;
+        return false;
+    }
+
+    const uint64_t expectedSize = sizeof(header) + ((uint64_t)header.nodeCount * sizeof(CpuBVHNode)) + ((uint64_t)header.primitiveCount * sizeof(uint32_t));
+    if (header.nodeCount == 0 || header.primitiveCount != primitiveCount || expectedSize != size)
+    {
+        std::cout << "CPU BVH: prebuilt tree doesn't match its mesh." << std::endl;
+        return false;
+    }
+
+    // Copied out rather than viewed, the blob has no alignment guarantees.
+    const uint32_t nodeCount = header.nodeCount;
+    m_nodes.resize(nodeCount);
+    m_primitiveIndices.resize(primitiveCount);
+    memcpy(m_nodes.data(), data + sizeof(header), nodeCount * sizeof(CpuBVHNode));
+    memcpy(m_primitiveIndices.data(), data + sizeof(header) + (nodeCount * sizeof(CpuBVHNode)), primitiveCount * sizeof(uint32_t));
+
+    // Children come after their parent so depths can be worked out in order. Every node
+    // but the root has to be the child of exactly one earlier node and the leaves have to
+    // cover each primitive exactly once, so a damaged tree can't send traversal or
+    // CpuMesh's leaf blocks out of bounds.
+    std::vector<uint32_t> depths(nodeCount, 0);
+    std::vector<uint8_t> reached(nodeCount, 0);
+    std::vector<uint8_t> covered(primitiveCount, 0);
+    uint32_t coveredCount = 0;
+    reached[0] = 1;
+
+    for (uint32_t i = 0; i < nodeCount; ++i)
+    {
+        const CpuBVHNode& node = m_nodes[i];
+        bool valid = reached[i] && depths[i] < kMaxDepth;
+        if (node.isLeaf())
+        {
+            valid = valid && node.leftOrFirst <= primitiveCount && node.count <= primitiveCount - node.leftOrFirst;
+            for (uint32_t p = node.leftOrFirst; valid && p < node.leftOrFirst + node.count; ++p)
+            {
+                valid = !covered[p];
+                covered[p] = 1;
+            }
+            coveredCount += valid ? node.count : 0;
+        }
+        else
+        {
+            valid = valid && node.leftOrFirst > i && node.leftOrFirst < nodeCount - 1 &&
+                    !reached[node.leftOrFirst] && !reached[node.leftOrFirst + 1];
+        }
+
+        if (!valid)
+        {
+            std::cout << "CPU BVH: prebuilt tree is damaged or deeper than " << kMaxDepth << " levels at node " << i << "." << std::endl;
+            destroy();
+            return false;
+        }
+
+        if (!node.isLeaf())
+        {
+            depths[node.leftOrFirst] = depths[i] + 1;
+            depths[node.leftOrFirst + 1] = depths[i] + 1;
+            reached[node.leftOrFirst] = 1;
+            reached[node.leftOrFirst + 1] = 1;
+        }
+    }
+
+    if (coveredCount != primitiveCount)
+    {
+        std::cout << "CPU BVH: prebuilt tree's leaves don't cover every primitive." << std::endl;
+        destroy();
+        return false;
+    }
+
+    for (uint32_t i = 0; i < primitiveCount; ++i)
+    {
+        if (m_primitiveIndices[i] >= primitiveCount)
+        {
+            std::cout << "CPU BVH: prebuilt tree has a primitive index out of range." << std::endl;
+            destroy();
+            return false;
+        }
+    }
+
+    m_primitivesPerTest = kMaxLeafSize;
+    m_maxLeafSize = kMaxLeafSize;
+    m_sahCost = computeSAHCost();
+
+    std::cout << "CPU BVH: " << primitiveCount << " primitives, " << m_nodes.size() << " nodes, loaded prebuilt, SAH cost "
+              << m_sahCost << std::endl;
+    return true;
+}
+
+// Children are always stored after their parent, so refitting nodes in reverse order
+// is bottom up. To spread it across the pool the top of the tree is cut into subtrees
+// that are refit on their own, then the few nodes above them are refit last.
+float CpuBVH::refit(const CpuAABB* primitiveBounds, CpuThreadPool* threadPool)
+{
+    if (m_nodes.empty())
+    {
+        return 0.0f;
+    }
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    auto refitNode = [&](uint32_t nodeIndex)
+    {
+        CpuBVHNode& node = m_nodes[nodeIndex];
+
+        CpuAABB bounds;
+        if (node.isLeaf())
+        {
+            bounds.reset();
+            for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+            {
+                bounds.grow(primitiveBounds[m_primitiveIndices[i]]);
+            }
+        }
+        else
+        {
+            bounds = getNodeBounds(m_nodes[node.leftOrFirst]);
+            bounds.grow(getNodeBounds(m_nodes[node.leftOrFirst + 1]));
+        }
+
+        setNodeBounds(node, bounds);
+    };
+
+    const uint32_t threadCount = (threadPool != nullptr) ? threadPool->getThreadCount() : 1;
+    if (threadCount == 1 || m_nodes.size() < kMinParallelRefitNodes)
+    {
+        for (size_t i = m_nodes.size(); i > 0; --i)
+        {
+            refitNode((uint32_t)(i - 1));
+        }
+    }
+    else
+    {
+        // Split a level at a time so the subtrees are roughly balanced.
+        const uint32_t targetSubtreeCount = threadCount * 8;
+        std::vector<uint32_t> topNodes;
+        std::vector<uint32_t> subtrees(1, 0);
+
+        while (subtrees.size() < targetSubtreeCount)
+        {
+            std::vector<uint32_t> nextSubtrees;
+            for (size_t i = 0; i < subtrees.size(); ++i)
+            {
+                const CpuBVHNode& node = m_nodes[subtrees[i]];
+                if (node.isLeaf())
+                {
+                    nextSubtrees.push_back(subtrees[i]);
+                    continue;
+                }
+
+                topNodes.push_back(subtrees[i]);
+                nextSubtrees.push_back(node.leftOrFirst);
+                nextSubtrees.push_back(node.leftOrFirst + 1);
+            }
+
+            if (nextSubtrees.size() == subtrees.size())
+            {
+                break;
+            }
+            subtrees.swap(nextSubtrees);
+        }
+
+        threadPool->parallelFor((uint32_t)subtrees.size(), 1, [&](uint32_t start, uint32_t end, uint32_t threadIndex)
+        {
+            std::vector<uint32_t> order;
+            std::vector<uint32_t> stack;
+            for (uint32_t i = start; i < end; ++i)
+            {
+                // Depth first order has parents before children too.
+                order.clear();
+                stack.push_back(subtrees[i]);
+                while (!stack.empty())
+                {
+                    uint32_t nodeIndex = stack.back();
+                    stack.pop_back();
+                    order.push_back(nodeIndex);
+
+                    const CpuBVHNode& node = m_nodes[nodeIndex];
+                    if (!node.isLeaf())
+                    {
+                        stack.push_back(node.leftOrFirst + 1);
+                        stack.push_back(node.leftOrFirst);
+                    }
+                }
+
+                for (size_t n = order.size(); n > 0; --n)
+                {
+                    refitNode(order[n - 1]);
+                }
+            }
+        });
+
+        for (size_t i = topNodes.size(); i > 0; --i)
+        {
+            refitNode(topNodes[i - 1]);
+        }
+    }
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    m_refitTimeMs = (float)std::chrono::duration<double, std::milli>(endTime - startTime).count();
+    m_sahCost = computeSAHCost();
+    return m_sahCost;
+}
+
+void CpuBVH::destroy()
+{
+    m_nodes.clear();
+    m_primitiveIndices.clear();
+    m_primitiveBounds.clear();
+    m_buildTimeMs = 0.0f;
+    m_refitTimeMs = 0.0f;
+    m_sahCost = 0.0f;
+}
+
+bool CpuBVH::findBestSplit(const CpuBVHNode& node, uint32_t begin, uint32_t end, CpuThreadPool* threadPool, Split& splitOut)
+{
+    const uint32_t count = end - begin;
+    if (count <= 1)
+    {
+        return false;
+    }
+
+    const bool parallel = (threadPool != nullptr && count >= kParallelBinningThreshold);
+    const uint32_t threadCount = parallel ? threadPool->getThreadCount() : 1;
+
+    // Bounds of the centroids decide where the bins go.
+    std::vector<CpuAABB> threadCentroidBounds(threadCount);
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        threadCentroidBounds[i].reset();
+    }
+
+    auto computeCentroidBounds = [&](uint32_t start, uint32_t stop, uint32_t threadIndex)
+    {
+        CpuAABB& bounds = threadCentroidBounds[threadIndex];
+        for (uint32_t i = begin + start; i < begin + stop; ++i)
+        {
+            const CpuAABB& primBounds = m_primitiveBounds[m_primitiveIndices[i]];
+            float centroid[3] = { getCentroid(primBounds, 0), getCentroid(primBounds, 1), getCentroid(primBounds, 2) };
+            bounds.grow(centroid);
+        }
+    };
+
+    if (parallel)
+    {
+        threadPool->parallelFor(count, 16 * 1024, computeCentroidBounds);
+    }
+    else
+    {
+        computeCentroidBounds(0, count, 0);
+    }
+
+    CpuAABB centroidBounds;
+    centroidBounds.reset();
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        centroidBounds.grow(threadCentroidBounds[i]);
+    }
+
+    float binScale[3];
+    bool degenerate = true;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+        binScale[axis] = (extent > 1e-12f) ? (float(kBinCount) / extent) : 0.0f;
+        degenerate &= (binScale[axis] == 0.0f);
+    }
+
+    // All centroids in the same place, binning can't separate them.
+    if (degenerate)
+    {
+        if (count <= m_maxLeafSize)
+        {
+            return false;
+        }
+
+        splitOut.axis = -1;
+        return true;
+    }
+
+    // Bin the primitives along all three axes at once.
+    std::vector<Bin> threadBins(threadCount * 3 * kBinCount);
+    for (size_t i = 0; i < threadBins.size(); ++i)
+    {
+        threadBins[i].bounds.reset();
+        threadBins[i].count = 0;
+    }
+
+    auto binPrimitives = [&](uint32_t start, uint32_t stop, uint32_t threadIndex)
+    {
+        Bin* bins = &threadBins[threadIndex * 3 * kBinCount];
+        for (uint32_t i = begin + start; i < begin + stop; ++i)
+        {
+            const CpuAABB& primBounds = m_primitiveBounds[m_primitiveIndices[i]];
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                if (binScale[axis] == 0.0f)
+                {
+                    continue;
+                }
+
+                uint32_t binIndex = getBinIndex(getCentroid(primBounds, axis), centroidBounds.min[axis], binScale[axis]);
+                Bin& bin = bins[(axis * kBinCount) + binIndex];
+                bin.bounds.grow(primBounds);
+                bin.count++;
+            }
+        }
+    };
+
+    if (parallel)
+    {
+        threadPool->parallelFor(count, 16 * 1024, binPrimitives);
+    }
+    else
+    {
+        binPrimitives(0, count, 0);
+    }
+
+    // Merge per thread bins into the first thread's.
+    for (uint32_t t = 1; t < threadCount; ++t)
+    {
+        for (uint32_t i = 0; i < 3 * kBinCount; ++i)
+        {
+            threadBins[i].bounds.grow(threadBins[(t * 3 * kBinCount) + i].bounds);
+            threadBins[i].count += threadBins[(t * 3 * kBinCount) + i].count;
+        }
+    }
+
+    // Sweep each axis to find the cheapest plane between two bins.
+    const float nodeArea = getNodeSurfaceArea(node);
+    const float invNodeArea = (nodeArea > 0.0f) ? 1.0f / nodeArea : 0.0f;
+
+    float bestCost = FLT_MAX;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        if (binScale[axis] == 0.0f)
+        {
+            continue;
+        }
+
+        const Bin* bins = &threadBins[axis * kBinCount];
+
+        float leftArea[kBinCount];
+        uint32_t leftCount[kBinCount];
+        CpuAABB leftBounds[kBinCount];
+
+        CpuAABB bounds;
+        bounds.reset();
+        uint32_t sum = 0;
+        for (uint32_t i = 0; i < kBinCount - 1; ++i)
+        {
+            bounds.grow(bins[i].bounds);
+            sum += bins[i].count;
+            leftArea[i] = bounds.getSurfaceArea();
+            leftCount[i] = sum;
+            leftBounds[i] = bounds;
+        }
+
+        bounds.reset();
+        sum = 0;
+        for (uint32_t i = kBinCount - 1; i > 0; --i)
+        {
+            bounds.grow(bins[i].bounds);
+            sum += bins[i].count;
+
+            uint32_t countLeft = leftCount[i - 1];
+            if (countLeft == 0 || sum == 0)
+            {
+                continue;
+            }
+
+            float cost = kTraversalCost + kIntersectionCost * invNodeArea * (leftArea[i - 1] * getLeafTestCount(countLeft) + bounds.getSurfaceArea() * getLeafTestCount(sum));
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                splitOut.axis = axis;
+                splitOut.bin = i;
+                splitOut.centroidMin = centroidBounds.min[axis];
+                splitOut.binScale = binScale[axis];
+                splitOut.leftBounds = leftBounds[i - 1];
+                splitOut.rightBounds = bounds;
+            }
+        }
+    }
+
+    if (bestCost == FLT_MAX)
+    {
+        if (count <= m_maxLeafSize)
+        {
+            return false;
+        }
+
+        splitOut.axis = -1;
+        return true;
+    }
+
+    // Keep it as a leaf if splitting doesn't pay for itself.
+    float leafCost = kIntersectionCost * getLeafTestCount(count);
+    if (bestCost >= leafCost && count <= m_maxLeafSize)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+uint32_t CpuBVH::partition(uint32_t begin, uint32_t end, const Split& split)
+{
+    uint32_t* first = &m_primitiveIndices[0] + begin;
+    uint32_t* last = &m_primitiveIndices[0] + end;
+
+    uint32_t* mid = std::partition(first, last, [&](uint32_t primIndex)
+    {
+        float centroid = getCentroid(m_primitiveBounds[primIndex], split.axis);
+        return getBinIndex(centroid, split.centroidMin, split.binScale) < split.bin;
+    });
+
+    return begin + (uint32_t)(mid - first);
+}
+
+// Levels below a node that splitting it in half gets to leaves in.
+static uint32_t getMedianSplitDepth(uint32_t count, uint32_t maxLeafSize)
+{
+    uint32_t levels = 0;
+    while ((uint64_t(maxLeafSize) << levels) < count)
+    {
+        levels++;
+    }
+    return levels;
+}
+
+bool CpuBVH::splitNode(std::vector<CpuBVHNode>& nodes, uint32_t nodeIndex, uint32_t begin, uint32_t end, uint32_t depth, CpuThreadPool* threadPool, uint32_t& midOut)
+{
+    // Clustered geometry can make SAH splits peel off a few primitives at a time. Once
+    // halving the primitives every level from here on only just ends within kMaxDepth,
+    // the rest of the subtree is split in half instead.
+    const uint32_t count = end - begin;
+    const bool forceMedian = (depth + getMedianSplitDepth(count, m_maxLeafSize)) >= (kMaxDepth - 1);
+
+    Split split;
+    if (forceMedian)
+    {
+        split.axis = -1;
+    }
+
+    if ((forceMedian && count <= m_maxLeafSize) || (!forceMedian && !findBestSplit(nodes[nodeIndex], begin, end, threadPool, split)))
+    {
+        nodes[nodeIndex].leftOrFirst = begin;
+        nodes[nodeIndex].count = end - begin;
+        return false;
+    }
+
+    if (split.axis >= 0)
+    {
+        midOut = partition(begin, end, split);
+    }
+    else
+    {
+        // Fall back to an even split, bounds have to be computed directly.
+        midOut = begin + (end - begin) / 2;
+
+        split.leftBounds.reset();
+        for (uint32_t i = begin; i < midOut; ++i)
+        {
+            split.leftBounds.grow(m_primitiveBounds[m_primitiveIndices[i]]);
+        }
+
+        split.rightBounds.reset();
+        for (uint32_t i = midOut; i < end; ++i)
+        {
+            split.rightBounds.grow(m_primitiveBounds[m_primitiveIndices[i]]);
+        }
+    }
+
+    CpuBVHNode left;
+    setNodeBounds(left, split.leftBounds);
+    left.leftOrFirst = begin;
+    left.count = midOut - begin;
+
+    CpuBVHNode right;
+    setNodeBounds(right, split.rightBounds);
+    right.leftOrFirst = midOut;
+    right.count = end - midOut;
+
+    uint32_t leftIndex = (uint32_t)nodes.size();
+    nodes.push_back(left);
+    nodes.push_back(right);
+
+    nodes[nodeIndex].leftOrFirst = leftIndex;
+    nodes[nodeIndex].count = 0;
+    return true;
+}
+
+void CpuBVH::buildSubtree(std::vector<CpuBVHNode>& nodes, uint32_t begin, uint32_t end, uint32_t depth)
+{
+    std::vector<BuildTask> stack;
+    BuildTask rootTask = { 0, begin, end, depth };
+    stack.push_back(rootTask);
+
+    while (!stack.empty())
+    {
+        BuildTask task = stack.back();
+        stack.pop_back();
+
+        uint32_t mid;
+        if (!splitNode(nodes, task.nodeIndex, task.begin, task.end, task.depth, nullptr, mid))
+        {
+            continue;
+        }
+
+        uint32_t left = nodes[task.nodeIndex].leftOrFirst;
+        BuildTask leftTask = { left, task.begin, mid, task.depth + 1 };
+        BuildTask rightTask = { left + 1, mid, task.end, task.depth + 1 };
+        stack.push_back(rightTask);
+        stack.push_back(leftTask);
+    }
+}
+
+// Expected cost of a random ray through the tree, relative to the root's surface area.
+// Leaves of triangles are intersected a whole CpuTriangleBlock at a time, so that's what
+// they cost.
+uint32_t CpuBVH::getLeafTestCount(uint32_t count) const
+{
+    return (count + m_primitivesPerTest - 1) / m_primitivesPerTest;
+}
+
+float CpuBVH::computeSAHCost() const
+{
+    if (m_nodes.empty())
+    {
+        return 0.0f;
+    }
+
+    double cost = 0.0;
+    for (size_t i = 0; i < m_nodes.size(); ++i)
+    {
+        const CpuBVHNode& node = m_nodes[i];
+        double area = getNodeSurfaceArea(node);
+        cost += area * (node.isLeaf() ? kIntersectionCost * getLeafTestCount(node.count) : kTraversalCost);
+    }
+
+    double rootArea = getNodeSurfaceArea(m_nodes[0]);
+    return (rootArea > 0.0) ? (float)(cost / rootArea) : 0.0f;
+}
+
+const std::vector<CpuBVHNode>& CpuBVH::getNodes() const
+{
+    return m_nodes;
+}
+
+const std::vector<uint32_t>& CpuBVH::getPrimitiveIndices() const
+{
+    return m_primitiveIndices;
+}
+
+float CpuBVH::getBuildTimeMs() const
+{
+    return m_buildTimeMs;
+}
+
+float CpuBVH::getRefitTimeMs() const
+{
+    return m_refitTimeMs;
+}
+
+float CpuBVH::getSAHCost() const
+{
+    return m_sahCost;
+}
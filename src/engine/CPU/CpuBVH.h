@@ -0,0 +1,122 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#ifndef CPU_BVH_HEADER_GUARD
+#define CPU_BVH_HEADER_GUARD
+
+#include "engine/CPU/CpuThreadPool.h"
+
+#include <stdint.h>
+#include <vector>
+#include <bx/math.h>
+
+namespace toyraygun
+{
+    struct CpuAABB
+    {
+        float min[3];
+        float max[3];
+
+        void reset();
+        void grow(const float* point);
+        void grow(const CpuAABB& other);
+        float getSurfaceArea() const;
+    };
+
+    // 32 byte binary BVH node. Children of an inner node are always stored next to each
+    // other so only the first one is referenced.
+    struct CpuBVHNode
+    {
+        float boundsMin[3];
+        uint32_t leftOrFirst;   // Left child index for inner nodes, first primitive for leaves.
+        float boundsMax[3];
+        uint32_t count;         // Number of primitives, zero for inner nodes.
+
+        bool isLeaf() const { return count > 0; }
+    };
+
+    // Binned SAH BVH over triangles or boxes. The top of the tree is split on the calling thread
+    // (with binning spread across the pool for big nodes) until there are enough
+    // independent subtrees to keep every thread busy, then the subtrees are built in parallel.
+    class CpuBVH
+    {
+    public:
+        // Most levels a tree can have, the root is level one. Traversal stacks are sized
+        // for it, deep chains of SAH splits give way to median splits to stay within it.
+        static const uint32_t kMaxDepth = 64;
+
+    protected:
+        struct SavedHeader;
+
+        struct BuildTask
+        {
+            uint32_t nodeIndex;
+            uint32_t begin;
+            uint32_t end;
+            uint32_t depth;  // Of the node, zero for the root.
+        };
+
+        struct Split
+        {
+            int axis;               // -1 splits the range in half without reordering.
+            uint32_t bin;           // Primitives in bins below this go left.
+            float centroidMin;
+            float binScale;
+            CpuAABB leftBounds;
+            CpuAABB rightBounds;
+        };
+
+        std::vector<CpuBVHNode> m_nodes;
+        std::vector<uint32_t> m_primitiveIndices;
+        std::vector<CpuAABB> m_primitiveBounds;
+
+        // How many primitives a leaf intersects at once, the SAH prices leaves in tests.
+        uint32_t m_primitivesPerTest;
+        uint32_t m_maxLeafSize;
+
+        // Stats
+        float m_buildTimeMs;
+        float m_refitTimeMs;
+        float m_sahCost;
+
+        bool findBestSplit(const CpuBVHNode& node, uint32_t begin, uint32_t end, CpuThreadPool* threadPool, Split& splitOut);
+        uint32_t partition(uint32_t begin, uint32_t end, const Split& split);
+        bool splitNode(std::vector<CpuBVHNode>& nodes, uint32_t nodeIndex, uint32_t begin, uint32_t end, uint32_t depth, CpuThreadPool* threadPool, uint32_t& midOut);
+        void buildSubtree(std::vector<CpuBVHNode>& nodes, uint32_t begin, uint32_t end, uint32_t depth);
+        uint32_t getLeafTestCount(uint32_t count) const;
+        float computeSAHCost() const;
+
+    public:
+        CpuBVH();
+
+        // Triangles are intersected in CpuTriangleBlocks of 8.
+        void build(const bx::Vec3* positions, const uint32_t* indices, uint32_t triangleCount, CpuThreadPool* threadPool);
+
+        // Any kind of primitive from its bounds, e.g. instances.
+        void build(const CpuAABB* primitiveBounds, uint32_t primitiveCount, uint32_t primitivesPerTest, uint32_t maxLeafSize, CpuThreadPool* threadPool);
+
+        // The tree as an opaque, versioned blob, e.g. for a scene cache to store.
+        void save(std::vector<uint8_t>& dataOut) const;
+        // Takes a triangle tree from save(). False, leaving the BVH empty, if it was saved by
+        // a different version, doesn't match the primitive count, is malformed or is deeper
+        // than kMaxDepth.
+        bool load(const uint8_t* data, size_t size, uint32_t primitiveCount);
+
+        // Recomputes every node's bounds from the primitives' current bounds, indexed like
+        // they were at build time, without changing the tree. Returns the new SAH cost,
+        // which grows as primitives move away from where the tree was built for.
+        float refit(const CpuAABB* primitiveBounds, CpuThreadPool* threadPool);
+        void destroy();
+
+        const std::vector<CpuBVHNode>& getNodes() const;
+        const std::vector<uint32_t>& getPrimitiveIndices() const;
+
+        float getBuildTimeMs() const;
+        float getRefitTimeMs() const;
+        float getSAHCost() const;
+    };
+}
+
+#endif // CPU_BVH_HEADER_GUARD
@@ -0,0 +1,263 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#include "CpuBVH8.h"
+using namespace toyraygun;
+
+#include <chrono>
+#include <float.h>
+#include <iostream>
+
+static const uint32_t kInvalidChild = 0xffffffff;
+
+static float getNodeSurfaceArea(const CpuBVHNode& node)
+{
+    float dx = node.boundsMax[0] - node.boundsMin[0];
+    float dy = node.boundsMax[1] - node.boundsMin[1];
+    float dz = node.boundsMax[2] - node.boundsMin[2];
+    return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+static void resetNode(CpuBVH8Node& node)
+{
+    for (uint32_t i = 0; i < 8; ++i)
+    {
+        node.minX[i] = node.minY[i] = node.minZ[i] = FLT_MAX;
+        node.maxX[i] = node.maxY[i] = node.maxZ[i] = -FLT_MAX;
+        node.child[i] = kInvalidChild;
+        node.count[i] = 0;
+    }
+}
+
+static void setChildBounds(CpuBVH8Node& node, uint32_t slot, const CpuBVHNode& binaryNode)
+{
+    node.minX[slot] = binaryNode.boundsMin[0];
+    node.minY[slot] = binaryNode.boundsMin[1];
+    node.minZ[slot] = binaryNode.boundsMin[2];
+    node.maxX[slot] = binaryNode.boundsMax[0];
+    node.maxY[slot] = binaryNode.boundsMax[1];
+    node.maxZ[slot] = binaryNode.boundsMax[2];
+}
+
+bool CpuBVH8Packet::setup(const CpuRay* rays, uint32_t rayCount)
+{
+    if (rayCount == 0)
+    {
+        return false;
+    }
+
+    tMin = FLT_MAX;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        originMin[axis] = invDirMin[axis] = FLT_MAX;
+        originMax[axis] = invDirMax[axis] = -FLT_MAX;
+    }
+
+    bool negative[3] = { rays[0].direction.x < 0.0f, rays[0].direction.y < 0.0f, rays[0].direction.z < 0.0f };
+
+    for (uint32_t i = 0; i < rayCount; ++i)
+    {
+        const float origin[3] = { rays[i].origin.x, rays[i].origin.y, rays[i].origin.z };
+        const float direction[3] = { rays[i].direction.x, rays[i].direction.y, rays[i].direction.z };
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            // Zero or mixed signs would make the inverse direction range unbounded.
+            if (direction[axis] == 0.0f || (direction[axis] < 0.0f) != negative[axis])
+            {
+                return false;
+            }
+
+            float invDir = 1.0f / direction[axis];
+            originMin[axis] = bx::min(originMin[axis], origin[axis]);
+            originMax[axis] = bx::max(originMax[axis], origin[axis]);
+            invDirMin[axis] = bx::min(invDirMin[axis], invDir);
+            invDirMax[axis] = bx::max(invDirMax[axis], invDir);
+        }
+
+        tMin = bx::min(tMin, rays[i].tMin);
+    }
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        nearOffset[axis] = (axis * 16) + (negative[axis] ? 8 : 0);
+        farOffset[axis] = (axis * 16) + (negative[axis] ? 0 : 8);
+    }
+
+    return true;
+}
+
+CpuBVH8::CpuBVH8() :
+    m_buildTimeMs(0.0f)
+{
+
+}
+
+void CpuBVH8::build(const CpuBVH& bvh)
+{
+    destroy();
+
+    const std::vector<CpuBVHNode>& binaryNodes = bvh.getNodes();
+    if (binaryNodes.empty())
+    {
+        return;
+    }
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    // Each wide node replaces at least two levels of the binary tree.
+    m_nodes.reserve((binaryNodes.size() / 4) + 1);
+    m_sourceNodes.reserve(m_nodes.capacity() * 8);
+
+    CpuBVH8Node root;
+    resetNode(root);
+    m_nodes.push_back(root);
+    m_sourceNodes.resize(8, kInvalidChild);
+
+    if (binaryNodes[0].isLeaf())
+    {
+        // Single leaf tree, the root just holds it.
+        setChildBounds(m_nodes[0], 0, binaryNodes[0]);
+        m_sourceNodes[0] = 0;
+        m_nodes[0].child[0] = binaryNodes[0].leftOrFirst;
+        m_nodes[0].count[0] = binaryNodes[0].count;
+    }
+    else
+    {
+        // Pairs of binary node index and the wide node it collapses into.
+        std::vector<uint32_t> pending;
+        pending.push_back(0);
+        pending.push_back(0);
+
+        while (!pending.empty())
+        {
+            uint32_t nodeIndex = pending.back();
+            pending.pop_back();
+            uint32_t binaryIndex = pending.back();
+            pending.pop_back();
+
+            collapseNode(binaryNodes, binaryIndex, nodeIndex, pending);
+        }
+    }
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    m_buildTimeMs = (float)std::chrono::duration<double, std::milli>(endTime - startTime).count();
+
+    std::cout << "CPU BVH8: " << binaryNodes.size() << " binary nodes collapsed to " << m_nodes.size()
+              << " wide nodes in " << m_buildTimeMs << " ms" << std::endl;
+}
+
+// Pulls up to 8 descendants of an inner binary node into one wide node, always opening
+// the child with the largest surface area first, the same greedy collapse Embree uses.
+void CpuBVH8::collapseNode(const std::vector<CpuBVHNode>& binaryNodes, uint32_t binaryIndex, uint32_t nodeIndex, std::vector<uint32_t>& pendingOut)
+{
+    uint32_t children[8];
+    uint32_t childCount = 2;
+    children[0] = binaryNodes[binaryIndex].leftOrFirst;
+    children[1] = binaryNodes[binaryIndex].leftOrFirst + 1;
+
+    while (childCount < 8)
+    {
+        int bestChild = -1;
+        float bestArea = -1.0f;
+        for (uint32_t i = 0; i < childCount; ++i)
+        {
+            const CpuBVHNode& child = binaryNodes[children[i]];
+            if (child.isLeaf())
+            {
+                continue;
+            }
+
+            float area = getNodeSurfaceArea(child);
+            if (area > bestArea)
+            {
+                bestArea = area;
+                bestChild = (int)i;
+            }
+        }
+
+        if (bestChild < 0)
+        {
+            break;
+        }
+
+        uint32_t left = binaryNodes[children[bestChild]].leftOrFirst;
+        children[bestChild] = left;
+        children[childCount++] = left + 1;
+    }
+
+    for (uint32_t i = 0; i < childCount; ++i)
+    {
+        const CpuBVHNode& child = binaryNodes[children[i]];
+        setChildBounds(m_nodes[nodeIndex], i, child);
+        m_sourceNodes[(nodeIndex * 8) + i] = children[i];
+
+        if (child.isLeaf())
+        {
+            m_nodes[nodeIndex].child[i] = child.leftOrFirst;
+            m_nodes[nodeIndex].count[i] = child.count;
+            continue;
+        }
+
+        // push_back can move the nodes so only index them after.
+        CpuBVH8Node newNode;
+        resetNode(newNode);
+
+        uint32_t childIndex = (uint32_t)m_nodes.size();
+        m_nodes.push_back(newNode);
+        m_sourceNodes.resize(m_nodes.size() * 8, kInvalidChild);
+        m_nodes[nodeIndex].child[i] = childIndex;
+        m_nodes[nodeIndex].count[i] = 0;
+
+        pendingOut.push_back(children[i]);
+        pendingOut.push_back(childIndex);
+    }
+}
+
+void CpuBVH8::refit(const CpuBVH& bvh, CpuThreadPool* threadPool)
+{
+    const std::vector<CpuBVHNode>& binaryNodes = bvh.getNodes();
+
+    auto refitNodes = [&](uint32_t start, uint32_t end, uint32_t threadIndex)
+    {
+        for (uint32_t i = start; i < end; ++i)
+        {
+            for (uint32_t slot = 0; slot < 8; ++slot)
+            {
+                uint32_t source = m_sourceNodes[(i * 8) + slot];
+                if (source != kInvalidChild)
+                {
+                    setChildBounds(m_nodes[i], slot, binaryNodes[source]);
+                }
+            }
+        }
+    };
+
+    if (threadPool != nullptr)
+    {
+        threadPool->parallelFor((uint32_t)m_nodes.size(), 1024, refitNodes);
+    }
+    else
+    {
+        refitNodes(0, (uint32_t)m_nodes.size(), 0);
+    }
+}
+
+void CpuBVH8::destroy()
+{
+    m_nodes.clear();
+    m_sourceNodes.clear();
+    m_buildTimeMs = 0.0f;
+}
+
+const std::vector<CpuBVH8Node>& CpuBVH8::getNodes() const
+{
+    return m_nodes;
+}
+
+float CpuBVH8::getBuildTimeMs() const
+{
+    return m_buildTimeMs;
+}
@@ -0,0 +1,237 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#ifndef CPU_BVH8_HEADER_GUARD
+#define CPU_BVH8_HEADER_GUARD
+
+#include "engine/CPU/CpuBVH.h"
+#include "engine/CPU/CpuRay.h"
+
+#include <stdint.h>
+#include <vector>
+#include <bx/math.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace toyraygun
+{
+    // 8 wide BVH node with the child bounds stored SoA so a ray can be tested against
+    // all of them at once. Unused slots have inverted bounds and never report a hit.
+    struct CpuBVH8Node
+    {
+        float minX[8];
+        float maxX[8];
+        float minY[8];
+        float maxY[8];
+        float minZ[8];
+        float maxZ[8];
+        uint32_t child[8];      // Node index for inner children, first primitive for leaves.
+        uint32_t count[8];      // Number of primitives, zero for inner children.
+    };
+
+    // Ray setup shared by every node test. Each axis picks its near and far plane up
+    // front from the sign of the direction.
+    struct CpuBVH8Ray
+    {
+        float origin[3];
+        float invDir[3];
+        uint32_t nearOffset[3];
+        uint32_t farOffset[3];
+        float tMin;
+
+        CpuBVH8Ray(const bx::Vec3& rayOrigin, const bx::Vec3& rayDirection, float rayTMin);
+    };
+
+    // Bounds on the origins and inverse directions of a group of rays, used to cull a
+    // node for the whole group at once with interval arithmetic. Only valid when every
+    // ray's direction has the same sign on each axis.
+    struct CpuBVH8Packet
+    {
+        float originMin[3];
+        float originMax[3];
+        float invDirMin[3];
+        float invDirMax[3];
+        uint32_t nearOffset[3];
+        uint32_t farOffset[3];
+        float tMin;
+
+        // Returns false if the rays can't share a packet.
+        bool setup(const CpuRay* rays, uint32_t rayCount);
+    };
+
+    // BVH8 collapsed from a binary CpuBVH. Leaves keep the binary tree's primitive ranges.
+    class CpuBVH8
+    {
+    protected:
+        std::vector<CpuBVH8Node> m_nodes;
+
+        // Binary node each child slot was collapsed from, 8 per wide node.
+        std::vector<uint32_t> m_sourceNodes;
+
+        // Stats
+        float m_buildTimeMs;
+
+        void collapseNode(const std::vector<CpuBVHNode>& binaryNodes, uint32_t binaryIndex, uint32_t nodeIndex, std::vector<uint32_t>& pendingOut);
+
+    public:
+        CpuBVH8();
+
+        void build(const CpuBVH& bvh);
+
+        // Copies the bounds of a refit binary tree, which must be the one this was built from.
+        void refit(const CpuBVH& bvh, CpuThreadPool* threadPool);
+        void destroy();
+
+        const std::vector<CpuBVH8Node>& getNodes() const;
+        float getBuildTimeMs() const;
+
+        // Tests the ray against all 8 children of a node, writes the entry distances and
+        // returns a bit mask of the children that were hit before tMax.
+        static uint32_t intersectChildren(const CpuBVH8Node& node, const CpuBVH8Ray& ray, float tMax, float* distancesOut);
+
+        // Same for a packet, a child is hit if any ray in the packet could hit it. The
+        // distances are the closest any ray could enter.
+        static uint32_t intersectChildren(const CpuBVH8Node& node, const CpuBVH8Packet& packet, float tMax, float* distancesOut);
+    };
+
+    inline CpuBVH8Ray::CpuBVH8Ray(const bx::Vec3& rayOrigin, const bx::Vec3& rayDirection, float rayTMin)
+    {
+        const float direction[3] = { rayDirection.x, rayDirection.y, rayDirection.z };
+
+        origin[0] = rayOrigin.x;
+        origin[1] = rayOrigin.y;
+        origin[2] = rayOrigin.z;
+        tMin = rayTMin;
+
+        // Offsets are in floats from minX, each axis stores its min then max array.
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            invDir[axis] = 1.0f / direction[axis];
+            nearOffset[axis] = (axis * 16) + (direction[axis] < 0.0f ? 8 : 0);
+            farOffset[axis] = (axis * 16) + (direction[axis] < 0.0f ? 0 : 8);
+        }
+    }
+
+    inline uint32_t CpuBVH8::intersectChildren(const CpuBVH8Node& node, const CpuBVH8Ray& ray, float tMax, float* distancesOut)
+    {
+        const float* bounds = node.minX;
+
+#if defined(__AVX2__)
+        __m256 tNear = _mm256_set1_ps(ray.tMin);
+        __m256 tFar = _mm256_set1_ps(tMax);
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const __m256 origin = _mm256_set1_ps(ray.origin[axis]);
+            const __m256 invDir = _mm256_set1_ps(ray.invDir[axis]);
+
+            __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(bounds + ray.nearOffset[axis]), origin), invDir);
+            __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(bounds + ray.farOffset[axis]), origin), invDir);
+
+            // Operand order matters, a NaN from 0 * inf keeps the running value.
+            tNear = _mm256_max_ps(t0, tNear);
+            tFar = _mm256_min_ps(t1, tFar);
+        }
+
+        _mm256_storeu_ps(distancesOut, tNear);
+        return (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ));
+#else
+        uint32_t mask = 0;
+        for (uint32_t i = 0; i < 8; ++i)
+        {
+            float tNear = ray.tMin;
+            float tFar = tMax;
+
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                float t0 = (bounds[ray.nearOffset[axis] + i] - ray.origin[axis]) * ray.invDir[axis];
+                float t1 = (bounds[ray.farOffset[axis] + i] - ray.origin[axis]) * ray.invDir[axis];
+
+                tNear = bx::max(t0, tNear);
+                tFar = bx::min(t1, tFar);
+            }
+
+            distancesOut[i] = tNear;
+            mask |= (tNear <= tFar ? 1u : 0u) << i;
+        }
+
+        return mask;
+#endif
+    }
+
+    inline uint32_t CpuBVH8::intersectChildren(const CpuBVH8Node& node, const CpuBVH8Packet& packet, float tMax, float* distancesOut)
+    {
+        const float* bounds = node.minX;
+
+#if defined(__AVX2__)
+        __m256 tNear = _mm256_set1_ps(packet.tMin);
+        __m256 tFar = _mm256_set1_ps(tMax);
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const __m256 originMin = _mm256_set1_ps(packet.originMin[axis]);
+            const __m256 originMax = _mm256_set1_ps(packet.originMax[axis]);
+            const __m256 invDirMin = _mm256_set1_ps(packet.invDirMin[axis]);
+            const __m256 invDirMax = _mm256_set1_ps(packet.invDirMax[axis]);
+
+            const __m256 nearPlane = _mm256_loadu_ps(bounds + packet.nearOffset[axis]);
+            const __m256 farPlane = _mm256_loadu_ps(bounds + packet.farOffset[axis]);
+
+            // Earliest any ray can cross the near plane.
+            __m256 d0 = _mm256_sub_ps(nearPlane, originMax);
+            __m256 d1 = _mm256_sub_ps(nearPlane, originMin);
+            __m256 t0 = _mm256_min_ps(_mm256_min_ps(_mm256_mul_ps(d0, invDirMin), _mm256_mul_ps(d0, invDirMax)),
+                                      _mm256_min_ps(_mm256_mul_ps(d1, invDirMin), _mm256_mul_ps(d1, invDirMax)));
+
+            // Latest any ray can cross the far plane.
+            d0 = _mm256_sub_ps(farPlane, originMax);
+            d1 = _mm256_sub_ps(farPlane, originMin);
+            __m256 t1 = _mm256_max_ps(_mm256_max_ps(_mm256_mul_ps(d0, invDirMin), _mm256_mul_ps(d0, invDirMax)),
+                                      _mm256_max_ps(_mm256_mul_ps(d1, invDirMin), _mm256_mul_ps(d1, invDirMax)));
+
+            tNear = _mm256_max_ps(t0, tNear);
+            tFar = _mm256_min_ps(t1, tFar);
+        }
+
+        _mm256_storeu_ps(distancesOut, tNear);
+        return (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ));
+#else
+        uint32_t mask = 0;
+        for (uint32_t i = 0; i < 8; ++i)
+        {
+            float tNear = packet.tMin;
+            float tFar = tMax;
+
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                float nearPlane = bounds[packet.nearOffset[axis] + i];
+                float farPlane = bounds[packet.farOffset[axis] + i];
+
+                float d0 = nearPlane - packet.originMax[axis];
+                float d1 = nearPlane - packet.originMin[axis];
+                float t0 = bx::min(d0 * packet.invDirMin[axis], d0 * packet.invDirMax[axis],
+                                   d1 * packet.invDirMin[axis], d1 * packet.invDirMax[axis]);
+
+                d0 = farPlane - packet.originMax[axis];
+                d1 = farPlane - packet.originMin[axis];
+                float t1 = bx::max(d0 * packet.invDirMin[axis], d0 * packet.invDirMax[axis],
+                                   d1 * packet.invDirMin[axis], d1 * packet.invDirMax[axis]);
+
+                tNear = bx::max(t0, tNear);
+                tFar = bx::min(t1, tFar);
+            }
+
+            distancesOut[i] = tNear;
+            mask |= (tNear <= tFar ? 1u : 0u) << i;
+        }
+
+        return mask;
+#endif
+    }
+}
+
+#endif // CPU_BVH8_HEADER_GUARD
@@ -0,0 +1,59 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#include "CpuBlueNoise.h"
+#include "engine/Texture.h"
+using namespace toyraygun;
+
+#include <iostream>
+#include <string.h>
+
+CpuBlueNoise::CpuBlueNoise() :
+    m_sliceCount(0)
+{
+
+}
+
+bool CpuBlueNoise::load(const std::string& pathPrefix)
+{
+    destroy();
+
+    for (uint32_t i = 0; i < kMaxSliceCount; ++i)
+    {
+        Texture slice;
+        if (!slice.loadFile(pathPrefix + std::to_string(i) + ".png"))
+        {
+            break;
+        }
+
+        const bool valid = slice.getWidth() == kSize && slice.getHeight() == kSize && slice.getChannels() == 1;
+        if (valid)
+        {
+            m_values.resize(size_t(m_sliceCount + 1) * kSize * kSize);
+            memcpy(&m_values[size_t(m_sliceCount) * kSize * kSize], slice.getBufferPointer(), kSize * kSize);
+            m_sliceCount++;
+        }
+        slice.destroy();
+
+        if (!valid)
+        {
+            std::cout << "Blue noise slice " << i << " isn't a " << kSize << "x" << kSize << " single channel image." << std::endl;
+            break;
+        }
+    }
+
+    return m_sliceCount > 0;
+}
+
+void CpuBlueNoise::destroy()
+{
+    std::vector<uint8_t>().swap(m_values);
+    m_sliceCount = 0;
+}
+
+uint32_t CpuBlueNoise::getSliceCount() const
+{
+    return m_sliceCount;
+}
@@ -0,0 +1,47 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#ifndef CPU_BLUENOISE_HEADER_GUARD
+#define CPU_BLUENOISE_HEADER_GUARD
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace toyraygun
+{
+    // Spatiotemporal blue noise (NVIDIA's STBN) as a volume of 128x128 slices, one per
+    // frame. Each slice is blue noise on its own and each pixel's values are well spread
+    // across the slices, so a pixel rotated by it gets errors that look like fine grain
+    // instead of blotches and average out quickly over frames.
+    class CpuBlueNoise
+    {
+    public:
+        static const uint32_t kSize = 128;
+        static const uint32_t kMaxSliceCount = 64;
+
+    protected:
+        std::vector<uint8_t> m_values;  // kSize x kSize per slice.
+        uint32_t m_sliceCount;
+
+    public:
+        CpuBlueNoise();
+
+        // Slices are single channel PNGs named pathPrefix followed by the slice index,
+        // loaded until one is missing. False if there isn't a valid first slice.
+        bool load(const std::string& pathPrefix);
+        void destroy();
+
+        uint32_t getSliceCount() const;
+
+        // Slice for a frame, the volume repeats every getSliceCount() frames.
+        const uint8_t* getSlice(uint32_t frameIndex) const
+        {
+            return &m_values[size_t(frameIndex % m_sliceCount) * kSize * kSize];
+        }
+    };
+}
+
+#endif // CPU_BLUENOISE_HEADER_GUARD
@@ -0,0 +1,328 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+
+ * C++ versions of the helpers in runtime/shaders/common.h used by the CPU renderer.
+ * Keep these in sync with the shader versions so all backends light a scene the same.
+ * The CPU estimator differs from the shaders' on top of these: it samples every light
+ * in the scene and weights light samples and bounce hits on lights with multiple
+ * importance sampling, so its noise isn't the same as theirs.
+ */
+
+#ifndef CPU_COMMON_HEADER_GUARD
+#define CPU_COMMON_HEADER_GUARD
+
+#include "engine/CPU/CpuRay.h"
+
+#include <stdint.h>
+#include <math.h>
+#include <bx/math.h>
+
+// Same as Raytracing.hlsl
+#define MAX_BOUNCES 3
+
+// Deepest paths CpuSampler has dimensions for.
+#define CPU_MAX_BOUNCE_LIMIT 10
+
+namespace toyraygun
+{
+    struct CpuCamera
+    {
+        bx::Vec3 position;
+        float invViewProjMtx[16];
+
+        CpuCamera() :
+            position(bx::init::Zero)
+        {
+
+        }
+    };
+
+    struct CpuAreaLight
+    {
+        bx::Vec3 position;
+        bx::Vec3 forward;
+        bx::Vec3 right;
+        bx::Vec3 up;
+        bx::Vec3 color;
+
+        CpuAreaLight() :
+            position(bx::init::Zero),
+            forward(bx::init::Zero),
+            right(bx::init::Zero),
+            up(bx::init::Zero),
+            color(bx::init::Zero)
+        {
+
+        }
+    };
+
+    struct CpuUniforms
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t frameIndex;
+        CpuCamera camera;
+
+        // Paths end after maxBounces hits, and from rouletteDepth hits on they may end
+        // early through Russian roulette.
+        uint32_t maxBounces;
+        uint32_t rouletteDepth;
+    };
+
+    inline float saturate(float value)
+    {
+        return bx::clamp(value, 0.0f, 1.0f);
+    }
+
+    inline float D3DX_FLOAT_to_SRGB(float val)
+    {
+        if (val < 0.0031308f)
+            val *= 12.92f;
+        else
+            val = 1.055f * powf(val, 1.0f / 2.4f) - 0.055f;
+        return val;
+    }
+
+    // Returns the i'th element of the Halton sequence using the d'th prime number as a
+    // base. See halton() in shaders/common.h, which only has the first 16 primes, this
+    // has one for each of CpuSampler's dimensions.
+    inline float halton(uint32_t i, uint32_t d)
+    {
+        static const uint32_t primes[] =
+        {
+              2,   3,   5,   7,  11,  13,  17,  19,
+             23,  29,  31,  37,  41,  43,  47,  53,
+             59,  61,  67,  71,  73,  79,  83,  89,
+             97, 101, 103, 107, 109, 113, 127, 131,
+            137, 139, 149, 151, 157, 163, 167, 173,
+            179, 181, 191, 193, 197, 199, 211, 223,
+            227, 229, 233, 239, 241, 251, 257, 263,
+            269, 271, 277, 281, 283, 293, 307, 311,
+        };
+
+        // Higher dimensions reuse the last prime rather than read past the table.
+        const uint32_t primeCount = sizeof(primes) / sizeof(primes[0]);
+        uint32_t b = primes[bx::min(d, primeCount - 1)];
+
+        float f = 1.0f;
+        float invB = 1.0f / b;
+
+        float r = 0;
+
+        while (i > 0) {
+            f = f * invB;
+            r = r + f * (i % b);
+            i = i / b;
+        }
+
+        return r;
+    }
+
+    // Maps two uniformly random numbers to a cosine weighted direction around (0, 1, 0).
+    inline bx::Vec3 sampleCosineWeightedHemisphere(float u, float v)
+    {
+        float phi = 2.0f * bx::kPi * u;
+
+        float cos_phi = cosf(phi);
+        float sin_phi = sinf(phi);
+
+        float cos_theta = sqrtf(v);
+        float sin_theta = sqrtf(1.0f - cos_theta * cos_theta);
+
+        return bx::Vec3(sin_theta * cos_phi, cos_theta, sin_theta * sin_phi);
+    }
+
+    // Aligns a direction on the unit hemisphere such that the hemisphere's "up" direction
+    // (0, 1, 0) maps to the given surface normal direction.
+    inline bx::Vec3 alignHemisphereWithNormal(bx::Vec3 sample, bx::Vec3 normal)
+    {
+        bx::Vec3 up = normal;
+        bx::Vec3 right = bx::normalize(bx::cross(normal, bx::Vec3(0.0072f, 1.0f, 0.0034f)));
+        bx::Vec3 forward = bx::cross(right, up);
+
+        return bx::add(bx::add(bx::mul(right, sample.x), bx::mul(up, sample.y)), bx::mul(forward, sample.z));
+    }
+
+    struct CpuLightSample
+    {
+        bx::Vec3 direction;
+        bx::Vec3 color;
+        float distance;
+        float pdf;  // Per solid angle at the shaded point, zero if the light faces away.
+
+        CpuLightSample() :
+            direction(bx::init::Zero),
+            color(bx::init::Zero),
+            distance(0.0f),
+            pdf(0.0f)
+        {
+
+        }
+    };
+
+    // Light reaching position from samplePosition on an emitter of the given area, facing
+    // forward, picked uniformly.
+    inline CpuLightSample sampleLightPoint(bx::Vec3 samplePosition,
+                                           bx::Vec3 forward,
+                                           bx::Vec3 color,
+                                           float area,
+                                           bx::Vec3 position,
+                                           bx::Vec3 vertexNormal)
+    {
+        CpuLightSample result;
+
+        // Compute vector from sample point on light source to intersection point
+        result.direction = bx::sub(samplePosition, position);
+        result.distance = bx::length(result.direction);
+
+        float inverseLightDistance = 1.0f / bx::max(result.distance, 1e-3f);
+        result.direction = bx::mul(result.direction, inverseLightDistance);
+
+        // Light falls off with the inverse square of the distance and the cosine at both ends.
+        float lightCosine = saturate(bx::dot(bx::neg(result.direction), forward));
+        float falloff = inverseLightDistance * inverseLightDistance;
+        falloff *= lightCosine;
+        falloff *= saturate(bx::dot(vertexNormal, result.direction));
+
+        // The light's color is its radiance, so a bigger light gives off more.
+        falloff *= area;
+
+        result.color = bx::mul(color, falloff);
+
+        // A point picked uniformly by area, seen from position.
+        result.pdf = (lightCosine > 0.0f) ? (result.distance * result.distance) / (area * lightCosine) : 0.0f;
+        return result;
+    }
+
+    inline CpuLightSample sampleAreaLight(const CpuAreaLight& light,
+                                          float u,
+                                          float v,
+                                          bx::Vec3 position,
+                                          bx::Vec3 vertexNormal)
+    {
+        // Map to -1..1
+        u = u * 2.0f - 1.0f;
+        v = v * 2.0f - 1.0f;
+
+        // Transform into light's coordinate system
+        bx::Vec3 samplePosition = bx::add(light.position, bx::add(bx::mul(light.right, u), bx::mul(light.up, v)));
+
+        float area = 4.0f * bx::length(bx::cross(light.right, light.up));
+
+        return sampleLightPoint(samplePosition, light.forward, light.color, area, position, vertexNormal);
+    }
+
+    // Uniform point on the triangle v0, v0 + edge0, v0 + edge1. The shaders only have the
+    // one area light so there's no shader version of this.
+    inline CpuLightSample sampleTriangleLight(bx::Vec3 v0,
+                                              bx::Vec3 edge0,
+                                              bx::Vec3 edge1,
+                                              bx::Vec3 forward,
+                                              bx::Vec3 color,
+                                              float u,
+                                              float v,
+                                              bx::Vec3 position,
+                                              bx::Vec3 vertexNormal)
+    {
+        // Folding the unit square in half keeps the points uniform.
+        if (u + v > 1.0f)
+        {
+            u = 1.0f - u;
+            v = 1.0f - v;
+        }
+
+        bx::Vec3 samplePosition = bx::add(v0, bx::add(bx::mul(edge0, u), bx::mul(edge1, v)));
+
+        float area = 0.5f * bx::length(bx::cross(edge0, edge1));
+
+        return sampleLightPoint(samplePosition, forward, color, area, position, vertexNormal);
+    }
+
+    // Chance of sampleCosineWeightedHemisphere() picking a direction, per solid angle.
+    inline float cosineHemispherePdf(float cosTheta)
+    {
+        return bx::max(cosTheta, 0.0f) * (1.0f / bx::kPi);
+    }
+
+    // Veach's power heuristic for one sample from each of two strategies: the weight of a
+    // sample found with pdf, when the other strategy could have found it with otherPdf.
+    inline float powerHeuristic(float pdf, float otherPdf)
+    {
+        float pdf2 = pdf * pdf;
+        float sum = pdf2 + (otherPdf * otherPdf);
+        return (sum > 0.0f) ? pdf2 / sum : 0.0f;
+    }
+
+    // A light sample's contribution to a diffuse surface, weighted against the cosine
+    // weighted bounce that could have found the same point. The 1 / pi is the diffuse
+    // BRDF's, for the bounce it cancels out against the pdf.
+    inline bx::Vec3 getDirectLighting(const CpuLightSample& light, bx::Vec3 vertexNormal)
+    {
+        float bouncePdf = cosineHemispherePdf(bx::dot(vertexNormal, light.direction));
+        return bx::mul(light.color, powerHeuristic(light.pdf, bouncePdf) * (1.0f / bx::kPi));
+    }
+
+    // Russian roulette after the path's depth'th hit. Past uniforms.rouletteDepth a path
+    // carries on with a chance equal to its brightest throughput channel, and the paths
+    // that do are scaled up to stand in for the ones that didn't. False ends the path.
+    inline bool continuePath(const CpuUniforms& uniforms, uint32_t depth, float u, bx::Vec3& throughput)
+    {
+        if (depth < uniforms.rouletteDepth)
+        {
+            return true;
+        }
+
+        float survival = bx::min(bx::max(throughput.x, bx::max(throughput.y, throughput.z)), 1.0f);
+        if (u >= survival)
+        {
+            return false;
+        }
+
+        throughput = bx::mul(throughput, 1.0f / survival);
+        return true;
+    }
+
+    // Camera ray setup from raygen() in Raytracing.hlsl, jitter is the pixel's random
+    // antialiasing offset in [0, 1).
+    inline CpuRay generateCameraRay(const CpuUniforms& uniforms, float jitterX, float jitterY, uint32_t x, uint32_t y)
+    {
+        // Add a random offset to the pixel coordinates for antialiasing
+        float px = float(x) + jitterX;
+        float py = float(y) + jitterY;
+
+        float u = (px / float(uniforms.width)) * 2.0f - 1.0f;
+        float v = (py / float(uniforms.height)) * 2.0f - 1.0f;
+
+        // Invert Y for DirectX-style coordinates.
+        v = -v;
+
+        // Unproject the pixel coordinate into a ray.
+        float clip[4] = { u, v, 0.0f, 1.0f };
+        float world[4];
+        bx::vec4MulMtx(world, clip, uniforms.camera.invViewProjMtx);
+
+        bx::Vec3 worldPos = bx::div(bx::Vec3(world[0], world[1], world[2]), world[3]);
+
+        CpuRay ray;
+        ray.origin = uniforms.camera.position;
+        ray.direction = bx::normalize(bx::sub(worldPos, ray.origin));
+        ray.tMin = 0.001f;
+        ray.tMax = 10000.0f;
+        return ray;
+    }
+
+    // ACES tone mapping curve fit to go from HDR to LDR
+    // https://knarkowicz.wordpress.com/2016/01/06/aces-filmic-tone-mapping-curve/
+    inline float ACESFilm(float x)
+    {
+        float a = 2.51f;
+        float b = 0.03f;
+        float c = 2.43f;
+        float d = 0.59f;
+        float e = 0.14f;
+        return saturate((x * (a * x + b)) / (x * (c * x + d) + e));
+    }
+}
+
+#endif // CPU_COMMON_HEADER_GUARD
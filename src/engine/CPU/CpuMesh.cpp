@@ -0,0 +1,307 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#include "CpuMesh.h"
+#include "engine/CPU/CpuTraversal.h"
+using namespace toyraygun;
+
+#include <string.h>
+
+CpuMesh::CpuMesh() :
+    m_triangleCount(0)
+{
+
+}
+
+void CpuMesh::build(const SceneMesh& mesh, CpuThreadPool* threadPool)
+{
+    destroy();
+
+    uint32_t triangleCount = (uint32_t)(mesh.indexBuffer.size() / 3);
+    if (triangleCount == 0)
+    {
+        return;
+    }
+
+    // A prebuilt tree that doesn't check out is built again.
+    if (mesh.bvhData.empty() || !m_bvh.load(mesh.bvhData.data(), mesh.bvhData.size(), triangleCount))
+    {
+        m_bvh.build(&mesh.vertexBuffer[0], &mesh.indexBuffer[0], triangleCount, threadPool);
+    }
+    m_bvh8.build(m_bvh);
+
+    // Give every leaf its run of blocks, in the order the leaves were built.
+    const std::vector<CpuBVHNode>& nodes = m_bvh.getNodes();
+    std::vector<uint32_t> leaves;
+    m_leafBlocks.resize(triangleCount);
+
+    uint32_t blockCount = 0;
+    for (uint32_t i = 0; i < (uint32_t)nodes.size(); ++i)
+    {
+        if (nodes[i].isLeaf())
+        {
+            leaves.push_back(i);
+            m_leafBlocks[nodes[i].leftOrFirst] = blockCount;
+            blockCount += (nodes[i].count + kTriangleBlockSize - 1) / kTriangleBlockSize;
+        }
+    }
+
+    m_triangleBlocks.resize(blockCount);
+    m_triangleCount = triangleCount;
+
+    const std::vector<uint32_t>& primitiveIndices = m_bvh.getPrimitiveIndices();
+    auto buildBlocks = [&](uint32_t start, uint32_t end, uint32_t threadIndex)
+    {
+        for (uint32_t i = start; i < end; ++i)
+        {
+            const CpuBVHNode& leaf = nodes[leaves[i]];
+            CpuTriangleBlock* block = &m_triangleBlocks[m_leafBlocks[leaf.leftOrFirst]];
+            memset(block, 0, sizeof(CpuTriangleBlock) * ((leaf.count + kTriangleBlockSize - 1) / kTriangleBlockSize));
+
+            for (uint32_t j = 0; j < leaf.count; ++j)
+            {
+                uint32_t primIndex = primitiveIndices[leaf.leftOrFirst + j];
+                const bx::Vec3 vertices[3] =
+                {
+                    mesh.vertexBuffer[mesh.indexBuffer[(primIndex * 3) + 0]],
+                    mesh.vertexBuffer[mesh.indexBuffer[(primIndex * 3) + 1]],
+                    mesh.vertexBuffer[mesh.indexBuffer[(primIndex * 3) + 2]]
+                };
+
+                CpuTriangleBlock& dest = block[j / kTriangleBlockSize];
+                const uint32_t slot = j % kTriangleBlockSize;
+                float (*destVertices[3])[8] = { dest.v0, dest.v1, dest.v2 };
+
+                for (int k = 0; k < 3; ++k)
+                {
+                    destVertices[k][0][slot] = vertices[k].x;
+                    destVertices[k][1][slot] = vertices[k].y;
+                    destVertices[k][2][slot] = vertices[k].z;
+                }
+
+                dest.primitiveIndex[slot] = primIndex;
+                dest.mask[slot] = mesh.materialIDBuffer[primIndex];
+            }
+        }
+    };
+
+    if (threadPool != nullptr)
+    {
+        threadPool->parallelFor((uint32_t)leaves.size(), 1024, buildBlocks);
+    }
+    else
+    {
+        buildBlocks(0, (uint32_t)leaves.size(), 0);
+    }
+
+    m_indices.assign(mesh.indexBuffer.begin(), mesh.indexBuffer.end());
+
+    const uint32_t vertexCount = (uint32_t)mesh.vertexBuffer.size();
+    m_attributes.resize(vertexCount);
+
+    auto encodeAttributes = [&](uint32_t start, uint32_t end, uint32_t threadIndex)
+    {
+        for (uint32_t i = start; i < end; ++i)
+        {
+            m_attributes[i].normal = encodeOctahedral(mesh.normalBuffer[i]);
+            m_attributes[i].color = encodeRGB9E5(mesh.colorBuffer[i]);
+        }
+    };
+
+    if (threadPool != nullptr)
+    {
+        threadPool->parallelFor(vertexCount, 16 * 1024, encodeAttributes);
+    }
+    else
+    {
+        encodeAttributes(0, vertexCount, 0);
+    }
+
+    m_materialIDs.assign(mesh.materialIDBuffer.begin(), mesh.materialIDBuffer.end());
+}
+
+void CpuMesh::destroy()
+{
+    m_bvh.destroy();
+    m_bvh8.destroy();
+    m_triangleBlocks.clear();
+    m_leafBlocks.clear();
+    m_triangleCount = 0;
+    m_indices.clear();
+    m_attributes.clear();
+    m_materialIDs.clear();
+}
+
+template<bool AnyHit>
+bool CpuMesh::intersectLeaf(uint32_t first, uint32_t count, const CpuTriangleRay& ray, bool cullBackFaces, float& closestT, CpuHit& hitOut) const
+{
+    const CpuTriangleBlock* block = &m_triangleBlocks[m_leafBlocks[first]];
+
+    bool hit = false;
+    for (uint32_t i = 0; i < count; i += kTriangleBlockSize, ++block)
+    {
+        float t[8], u[8], v[8];
+        uint32_t mask = intersectTriangleBlock(*block, ray, cullBackFaces, closestT, t, u, v);
+        if (mask == 0)
+        {
+            continue;
+        }
+
+        // Closest slot, ties go to the first.
+        uint32_t best = bx::uint32_cnttz(mask);
+        if (!AnyHit)
+        {
+            for (mask &= mask - 1; mask != 0; mask &= mask - 1)
+            {
+                uint32_t slot = bx::uint32_cnttz(mask);
+                if (t[slot] < t[best])
+                {
+                    best = slot;
+                }
+            }
+        }
+
+        closestT = t[best];
+        hitOut.t = t[best];
+        hitOut.u = u[best];
+        hitOut.v = v[best];
+        hitOut.primitiveIndex = block->primitiveIndex[best];
+        hit = true;
+
+        if (AnyHit)
+        {
+            break;
+        }
+    }
+
+    return hit;
+}
+
+template<bool AnyHit>
+bool CpuMesh::traverse(const CpuRay& ray, bool cullBackFaces, bool useBVH8, float& closestT, CpuHit& hitOut) const
+{
+    const CpuTriangleRay triangleRay(ray);
+    auto leafFunc = [&](uint32_t first, uint32_t count, float& leafClosestT)
+    {
+        return intersectLeaf<AnyHit>(first, count, triangleRay, cullBackFaces, leafClosestT, hitOut);
+    };
+
+    if (useBVH8)
+    {
+        return traverseBVH8<AnyHit>(m_bvh8, ray, closestT, leafFunc);
+    }
+
+    return traverseBVH<AnyHit>(m_bvh, ray, closestT, leafFunc);
+}
+
+bool CpuMesh::intersect(const CpuRay& ray, bool cullBackFaces, bool useBVH8, float& closestT, CpuHit& hitOut) const
+{
+    return traverse<false>(ray, cullBackFaces, useBVH8, closestT, hitOut);
+}
+
+bool CpuMesh::occluded(const CpuRay& ray, bool cullBackFaces, bool useBVH8, float closestT) const
+{
+    CpuHit hit;
+    return traverse<true>(ray, cullBackFaces, useBVH8, closestT, hit);
+}
+
+void CpuMesh::intersectPacket(const CpuRay* rays, uint32_t rayCount, bool cullBackFaces, float* closestT, CpuHit* hitsOut, bool* hitFoundOut) const
+{
+    CpuBVH8Packet packet;
+    if (rayCount > kMaxPacketSize || !packet.setup(rays, rayCount))
+    {
+        for (uint32_t i = 0; i < rayCount; ++i)
+        {
+            hitFoundOut[i] = intersect(rays[i], cullBackFaces, true, closestT[i], hitsOut[i]);
+        }
+        return;
+    }
+
+    CpuTriangleRay triangleRays[kMaxPacketSize];
+    for (uint32_t i = 0; i < rayCount; ++i)
+    {
+        triangleRays[i].setup(rays[i]);
+        hitFoundOut[i] = false;
+    }
+
+    traversePacketBVH8(m_bvh8, packet, closestT, rayCount, [&](uint32_t first, uint32_t count, float entryDistance)
+    {
+        for (uint32_t i = 0; i < rayCount; ++i)
+        {
+            if (entryDistance < closestT[i] &&
+                intersectLeaf<false>(first, count, triangleRays[i], cullBackFaces, closestT[i], hitsOut[i]))
+            {
+                hitFoundOut[i] = true;
+            }
+        }
+    });
+}
+
+// Same as HitAttribute() in Raytracing.hlsl
+static bx::Vec3 hitAttribute(const bx::Vec3& a0, const bx::Vec3& a1, const bx::Vec3& a2, const CpuHit& hit)
+{
+    return bx::add(a0, bx::add(bx::mul(bx::sub(a1, a0), hit.u), bx::mul(bx::sub(a2, a0), hit.v)));
+}
+
+bx::Vec3 CpuMesh::getNormal(const CpuHit& hit) const
+{
+    const uint32_t* idx = &m_indices[hit.primitiveIndex * 3];
+
+    return hitAttribute(decodeOctahedralDirection(m_attributes[idx[0]].normal),
+                        decodeOctahedralDirection(m_attributes[idx[1]].normal),
+                        decodeOctahedralDirection(m_attributes[idx[2]].normal), hit);
+}
+
+bx::Vec3 CpuMesh::getColor(const CpuHit& hit) const
+{
+    const uint32_t* idx = &m_indices[hit.primitiveIndex * 3];
+    return hitAttribute(decodeRGB9E5(m_attributes[idx[0]].color),
+                        decodeRGB9E5(m_attributes[idx[1]].color),
+                        decodeRGB9E5(m_attributes[idx[2]].color), hit);
+}
+
+uint32_t CpuMesh::getMaterialID(uint32_t primitiveIndex) const
+{
+    return m_materialIDs[primitiveIndex];
+}
+
+bool CpuMesh::getBounds(CpuAABB& boundsOut) const
+{
+    const std::vector<CpuBVHNode>& nodes = m_bvh.getNodes();
+    if (nodes.empty())
+    {
+        return false;
+    }
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        boundsOut.min[axis] = nodes[0].boundsMin[axis];
+        boundsOut.max[axis] = nodes[0].boundsMax[axis];
+    }
+
+    return true;
+}
+
+uint32_t CpuMesh::getTriangleCount() const
+{
+    return m_triangleCount;
+}
+
+uint32_t CpuMesh::getBlockCount() const
+{
+    return (uint32_t)m_triangleBlocks.size();
+}
+
+size_t CpuMesh::getMemorySize() const
+{
+    return (m_bvh.getNodes().size() * sizeof(CpuBVHNode)) +
+           (m_bvh.getPrimitiveIndices().size() * sizeof(uint32_t)) +
+           (m_bvh8.getNodes().size() * sizeof(CpuBVH8Node)) +
+           (m_triangleBlocks.size() * sizeof(CpuTriangleBlock)) +
+           (m_leafBlocks.size() * sizeof(uint32_t)) +
+           (m_indices.size() * sizeof(uint32_t)) +
+           (m_attributes.size() * sizeof(CpuVertexAttributes)) +
+           (m_materialIDs.size() * sizeof(uint32_t));
+}
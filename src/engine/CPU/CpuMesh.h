@@ -0,0 +1,79 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#ifndef CPU_MESH_HEADER_GUARD
+#define CPU_MESH_HEADER_GUARD
+
+#include "engine/Scene.h"
+#include "engine/CPU/CpuBVH.h"
+#include "engine/CPU/CpuBVH8.h"
+#include "engine/CPU/CpuRay.h"
+#include "engine/CPU/CpuThreadPool.h"
+#include "engine/CPU/CpuTriangleBlock.h"
+#include "engine/CPU/CpuVertexFormat.h"
+
+#include <stdint.h>
+#include <vector>
+#include <bx/math.h>
+
+namespace toyraygun
+{
+    // Bottom level of the CPU scene: one SceneMesh and its BVH in object space, traced
+    // by every instance of it.
+    class CpuMesh
+    {
+    protected:
+        CpuBVH m_bvh;
+        CpuBVH8 m_bvh8;
+
+        // Each leaf's triangles are packed into consecutive blocks, found through the
+        // leaf's first primitive.
+        std::vector<CpuTriangleBlock> m_triangleBlocks;
+        std::vector<uint32_t> m_leafBlocks;
+        uint32_t m_triangleCount;
+
+        std::vector<uint32_t> m_indices;
+        std::vector<CpuVertexAttributes> m_attributes;
+        std::vector<uint32_t> m_materialIDs;
+
+        // AnyHit stops at the first triangle found instead of the closest one.
+        template<bool AnyHit>
+        bool intersectLeaf(uint32_t first, uint32_t count, const CpuTriangleRay& ray, bool cullBackFaces, float& closestT, CpuHit& hitOut) const;
+        template<bool AnyHit>
+        bool traverse(const CpuRay& ray, bool cullBackFaces, bool useBVH8, float& closestT, CpuHit& hitOut) const;
+
+    public:
+        CpuMesh();
+
+        void build(const SceneMesh& mesh, CpuThreadPool* threadPool);
+        void destroy();
+
+        // Rays are in object space. closestT is the furthest a hit may be, e.g. the
+        // closest hit on another instance so far, and is shortened by any hit found.
+        bool intersect(const CpuRay& ray, bool cullBackFaces, bool useBVH8, float& closestT, CpuHit& hitOut) const;
+        bool occluded(const CpuRay& ray, bool cullBackFaces, bool useBVH8, float closestT) const;
+
+        // Closest hits for a group of coherent rays through the BVH8, rays that can't
+        // share a packet are traced one at a time. Only rays that hit something closer
+        // than their closestT have their hit written.
+        static const uint32_t kMaxPacketSize = 256;
+        void intersectPacket(const CpuRay* rays, uint32_t rayCount, bool cullBackFaces, float* closestT, CpuHit* hitsOut, bool* hitFoundOut) const;
+
+        // Interpolated vertex attributes at a hit in object space, decoded from the
+        // compact format. The normal isn't normalized.
+        bx::Vec3 getNormal(const CpuHit& hit) const;
+        bx::Vec3 getColor(const CpuHit& hit) const;
+        uint32_t getMaterialID(uint32_t primitiveIndex) const;
+
+        // False for a mesh without triangles.
+        bool getBounds(CpuAABB& boundsOut) const;
+
+        uint32_t getTriangleCount() const;
+        uint32_t getBlockCount() const;
+        size_t getMemorySize() const;
+    };
+}
+
+#endif // CPU_MESH_HEADER_GUARD
@@ -0,0 +1,63 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#ifndef CPU_RAY_HEADER_GUARD
+#define CPU_RAY_HEADER_GUARD
+
+#include <stdint.h>
+#include <bx/math.h>
+
+namespace toyraygun
+{
+    // Matches the D3D12 ray flags we use.
+    enum CpuRayFlags
+    {
+        CPU_RAY_FLAG_NONE                         = 0,
+        CPU_RAY_FLAG_CULL_BACK_FACING_TRIANGLES   = 1 << 0,
+    };
+
+    // Same scheme as the Metal backend: each triangle's mask is its material ID and a
+    // ray only sees triangles whose mask shares a bit with its own.
+    enum CpuRayMask
+    {
+        CPU_RAY_MASK_ALL      = 0xffffffff,
+        CPU_RAY_MASK_SHADOW   = 1,          // MATERIAL_DEFAULT only, lights don't block light.
+    };
+
+    struct CpuRay
+    {
+        bx::Vec3 origin;
+        float tMin;
+        bx::Vec3 direction;
+        float tMax;
+        uint32_t mask;
+
+        CpuRay() :
+            origin(bx::init::Zero),
+            tMin(0.0f),
+            direction(bx::init::Zero),
+            tMax(0.0f),
+            mask(CPU_RAY_MASK_ALL)
+        {
+
+        }
+    };
+
+    struct CpuHit
+    {
+        float t;
+
+        // Same convention as BuiltInTriangleIntersectionAttributes, the weights of the
+        // triangle's second and third vertex.
+        float u;
+        float v;
+
+        // Triangle within the instance's mesh.
+        uint32_t primitiveIndex;
+        uint32_t instanceIndex;
+    };
+}
+
+#endif // CPU_RAY_HEADER_GUARD
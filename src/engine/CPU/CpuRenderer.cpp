@@ -0,0 +1,568 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#include "CpuRenderer.h"
+using namespace toyraygun;
+
+#include <iostream>
+#include <stdlib.h>
+#include <bx/math.h>
+
+// Per pixel state shared by the functions below, the CPU equivalent of the
+// dispatch index and payload of the HLSL version.
+struct TraceContext
+{
+    const CpuScene* scene;
+    const CpuUniforms* uniforms;
+    const CpuSampler* sampler;
+    uint32_t x;
+    uint32_t y;
+    uint32_t pixelSeed;
+    uint32_t sampleIndex;
+    uint64_t rayCount;
+};
+
+static bool traceShadowRay(TraceContext& ctx, const CpuRay& ray)
+{
+    ctx.rayCount++;
+
+    // The HLSL version finds the closest hit and treats a light as unshadowed, masking the
+    // lights out and stopping at the first blocker before the light sample is the same test.
+    return ctx.scene->occluded(ray, CPU_RAY_FLAG_NONE);
+}
+
+// Follows a path on from its camera ray's first hit. primaryHit() in Raytracing.hlsl
+// recurses once per bounce, here the recursion is a loop that carries the path's
+// throughput, so Russian roulette can stop paths that have little left to add.
+// Lights are found both by light samples and by bounces, each weighted by multiple
+// importance sampling so every path is counted once and by the strategy best at it.
+static bx::Vec3 tracePath(TraceContext& ctx, CpuRay ray, CpuHit hit)
+{
+    const CpuUniforms& uniforms = *ctx.uniforms;
+
+    auto sample = [&](uint32_t depth, CpuBounceDimension dimension)
+    {
+        return ctx.sampler->get(ctx.x, ctx.y, ctx.pixelSeed, ctx.sampleIndex, getBounceDimension(depth, dimension));
+    };
+
+    bx::Vec3 color(0.0f, 0.0f, 0.0f);
+    bx::Vec3 throughput(1.0f, 1.0f, 1.0f);
+
+    // Chance of the bounce that found the current hit, zero for the camera ray.
+    float bouncePdf = 0.0f;
+
+    for (uint32_t depth = 1; ; ++depth)
+    {
+        uint32_t materialID = ctx.scene->getMaterialID(hit);
+
+        // Emissive, the vertex color is the light's color. Light samples can't see it
+        // from the camera, otherwise they share it with the bounce.
+        if (materialID == MATERIAL_EMISSIVE)
+        {
+            bx::Vec3 emission = bx::mul(ctx.scene->getColor(hit), throughput);
+            if (bouncePdf > 0.0f)
+            {
+                emission = bx::mul(emission, powerHeuristic(bouncePdf, ctx.scene->getLightPdf(ray, hit)));
+            }
+            return bx::add(color, emission);
+        }
+
+        // Error
+        if (materialID != MATERIAL_DEFAULT)
+        {
+            return bx::add(color, bx::mul(bx::Vec3(1.0f, 0.0f, 1.0f), throughput));
+        }
+
+        // Default. Shadow rays from the last hit count as shadowed and the bounce after it
+        // returns black, so the path ends here.
+        if (depth >= uniforms.maxBounces)
+        {
+            return color;
+        }
+
+        bx::Vec3 hitPosition = bx::mad(ray.direction, hit.t, ray.origin);
+        bx::Vec3 vertexNormal = ctx.scene->getNormal(hit);
+        throughput = bx::mul(throughput, ctx.scene->getColor(hit));
+
+        CpuLightSample light;
+        if (ctx.scene->sampleLight(sample(depth, CPU_DIMENSION_LIGHT_SELECT),
+                                   sample(depth, CPU_DIMENSION_LIGHT_U),
+                                   sample(depth, CPU_DIMENSION_LIGHT_V),
+                                   hitPosition,
+                                   vertexNormal,
+                                   light))
+        {
+            // Trace Shadow Ray
+            CpuRay shadowRay;
+            shadowRay.origin = hitPosition;
+            shadowRay.direction = light.direction;
+            shadowRay.tMin = 0.001f;
+            shadowRay.tMax = light.distance - 0.001f;
+            shadowRay.mask = CPU_RAY_MASK_SHADOW;
+            if (!traceShadowRay(ctx, shadowRay))
+            {
+                color = bx::add(color, bx::mul(getDirectLighting(light, vertexNormal), throughput));
+            }
+        }
+
+        if (!continuePath(uniforms, depth, sample(depth, CPU_DIMENSION_ROULETTE), throughput))
+        {
+            return color;
+        }
+
+        // Trace Secondary Ray
+        float r0 = sample(depth, CPU_DIMENSION_BOUNCE_U);
+        float r1 = sample(depth, CPU_DIMENSION_BOUNCE_V);
+
+        bx::Vec3 sampleDirection = sampleCosineWeightedHemisphere(r0, r1);
+        bouncePdf = cosineHemispherePdf(sampleDirection.y);
+        sampleDirection = alignHemisphereWithNormal(sampleDirection, vertexNormal);
+
+        ray.origin = hitPosition;
+        ray.direction = bx::normalize(sampleDirection);
+        ray.tMin = 0.001f;
+        ray.tMax = 10000.0f;
+        ray.mask = CPU_RAY_MASK_ALL;
+
+        ctx.rayCount++;
+        if (!ctx.scene->intersect(ray, CPU_RAY_FLAG_CULL_BACK_FACING_TRIANGLES, hit))
+        {
+            // Miss
+            return color;
+        }
+    }
+}
+
+CpuRenderer::CpuRenderer() :
+    m_usePackets(true),
+    m_useWavefront(false),
+    m_useAdaptiveSampling(false),
+    m_showSampleMask(false),
+    m_outputTexture(nullptr),
+    m_rayCount(0),
+    m_statsFrameCount(0)
+{
+
+}
+
+bool CpuRenderer::init()
+{
+    Renderer::init();
+
+    // --threads and --tile-size for tuning, zero threads means one per core.
+    const char* threadCount = Engine::instance()->getArgValue("--threads");
+    m_threadPool.init(threadCount != nullptr ? (uint32_t)atoi(threadCount) : 0);
+
+    // Tiles are whole packets, except at the edges of the screen.
+    const char* tileSizeArg = Engine::instance()->getArgValue("--tile-size");
+    uint32_t tileSize = tileSizeArg != nullptr ? (uint32_t)atoi(tileSizeArg) : kDefaultTileSize;
+    tileSize = ((tileSize + kPacketWidth - 1) / kPacketWidth) * kPacketWidth;
+    if (tileSize == 0)
+    {
+        tileSize = kPacketWidth;
+    }
+    m_tileScheduler.init(m_width, m_height, tileSize);
+
+    // --max-bounces and --roulette-depth trade path length against time per sample.
+    const char* maxBounces = Engine::instance()->getArgValue("--max-bounces");
+    m_uniforms.maxBounces = maxBounces != nullptr ? (uint32_t)atoi(maxBounces) : MAX_BOUNCES;
+    m_uniforms.maxBounces = bx::clamp<uint32_t>(m_uniforms.maxBounces, 1, CPU_MAX_BOUNCE_LIMIT);
+
+    const char* rouletteDepth = Engine::instance()->getArgValue("--roulette-depth");
+    m_uniforms.rouletteDepth = rouletteDepth != nullptr ? (uint32_t)atoi(rouletteDepth) : kDefaultRouletteDepth;
+    m_uniforms.rouletteDepth = bx::max<uint32_t>(m_uniforms.rouletteDepth, 1);
+
+    size_t pixelCount = size_t(m_width) * size_t(m_height);
+    m_raytracingOutput.assign(pixelCount * 4, 0.0f);
+    m_accumulateOutput.assign(pixelCount * 4, 0.0f);
+    m_postProcessingOutput.assign(pixelCount, 0);
+
+    // Random value per pixel used to decorrelate the samples.
+    m_randomTexture = Texture::generateRandomTexture(m_width, m_height, 4);
+
+    // --halton draws samples the way the shaders do, for comparing against the Sobol table.
+    m_sampler.init();
+    m_sampler.setUseHalton(Engine::instance()->hasArg("--halton"));
+
+    // Spatiotemporal blue noise rotates each pixel's samples, --white-noise uses random bits instead.
+    if (!m_sampler.loadBlueNoise(Engine::getRuntimeTexturePath() + "stbn_scalar_2Dx1Dx1D_128x128x64x1_"))
+    {
+        std::cout << "Failed to load blue noise texture, using white noise." << std::endl;
+    }
+    m_sampler.setUseBlueNoise(!Engine::instance()->hasArg("--white-noise"));
+
+    SDL_Renderer* sdlRenderer = Engine::instance()->getRenderer();
+    if (sdlRenderer != nullptr)
+    {
+        m_outputTexture = SDL_CreateTexture(sdlRenderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, m_width, m_height);
+    }
+
+    // --bvh2 traces the binary BVH instead, for comparing against the 8 wide one.
+    m_scene.setUseBVH8(!Engine::instance()->hasArg("--bvh2"));
+
+    // --no-packets traces camera rays one at a time.
+    m_usePackets = !Engine::instance()->hasArg("--no-packets");
+
+    // --wavefront runs the integrator stage by stage instead of per pixel.
+    m_useWavefront = Engine::instance()->hasArg("--wavefront");
+
+    // --adaptive stops tracing blocks whose error is below --adaptive-threshold after at least
+    // --adaptive-min-samples, --sample-mask shows the sample counts instead of the image.
+    m_useAdaptiveSampling = Engine::instance()->hasArg("--adaptive");
+    if (m_useAdaptiveSampling && m_useWavefront)
+    {
+        std::cout << "Adaptive sampling isn't supported by the wavefront integrator." << std::endl;
+        m_useAdaptiveSampling = false;
+    }
+
+    if (m_useAdaptiveSampling)
+    {
+        const char* threshold = Engine::instance()->getArgValue("--adaptive-threshold");
+        const char* minSamples = Engine::instance()->getArgValue("--adaptive-min-samples");
+        m_adaptiveSampling.init(m_width, m_height, kPacketWidth,
+                                threshold != nullptr ? (float)atof(threshold) : 0.01f,
+                                minSamples != nullptr ? (uint32_t)atoi(minSamples) : 32);
+    }
+    m_showSampleMask = m_useAdaptiveSampling && Engine::instance()->hasArg("--sample-mask");
+
+#if defined(__AVX2__)
+    const char* nodeTest = "AVX2";
+#else
+    const char* nodeTest = "scalar";
+#endif
+
+    std::cout << "CPU renderer using " << m_threadPool.getThreadCount() << " threads, "
+              << tileSize << "x" << tileSize << " tiles, "
+              << (m_scene.getUseBVH8() ? "BVH8 with " : "binary BVH, BVH8 node test is ") << nodeTest
+              << (m_usePackets ? ", camera ray packets" : "")
+              << (m_sampler.getUseHalton() ? ", halton samples" : ", Sobol samples")
+              << (m_sampler.getUseBlueNoise() && !m_sampler.getUseHalton() ? " with blue noise (" + std::to_string(m_sampler.getBlueNoise().getSliceCount()) + " slices)" : "")
+              << ", " << m_uniforms.maxBounces << " bounces with roulette from " << m_uniforms.rouletteDepth
+              << (m_useWavefront ? ", wavefront integrator." : ".") << std::endl;
+
+    if (m_useAdaptiveSampling)
+    {
+        std::cout << "Adaptive sampling " << m_adaptiveSampling.getBlockCount() << " blocks to a threshold of "
+                  << m_adaptiveSampling.getThreshold() << " after " << m_adaptiveSampling.getMinSamples() << " samples." << std::endl;
+    }
+
+    m_statsStartTime = std::chrono::high_resolution_clock::now();
+
+    return true;
+}
+
+void CpuRenderer::destroy()
+{
+    m_threadPool.destroy();
+    m_scene.destroy();
+    m_wavefront.destroy();
+    m_sampler.destroy();
+    m_adaptiveSampling.destroy();
+    m_randomTexture.destroy();
+
+    if (m_outputTexture != nullptr)
+    {
+        SDL_DestroyTexture(m_outputTexture);
+        m_outputTexture = nullptr;
+    }
+}
+
+void CpuRenderer::loadScene(Scene* scene)
+{
+    scene->buildLights();
+    m_scene.build(scene, &m_threadPool);
+    m_frameIndex = 0;
+}
+
+void CpuRenderer::updateScene(Scene* scene)
+{
+    if (scene->getDirtyInstances().empty())
+    {
+        return;
+    }
+
+    // Lights only need finding again if some of them moved.
+    if (scene->getDirtyInstancesHaveLights())
+    {
+        scene->buildLights();
+    }
+    m_scene.update(scene, &m_threadPool);
+    scene->clearDirtyInstances();
+
+    // Samples of the old scene can't be blended with the new one.
+    m_frameIndex = 0;
+}
+
+void CpuRenderer::updateUniforms()
+{
+    m_uniforms.width = m_width;
+    m_uniforms.height = m_height;
+
+    // Renderer::renderFrame() has already advanced the frame index, the first frame is zero.
+    m_uniforms.frameIndex = m_frameIndex - 1;
+
+    m_uniforms.camera.position = m_eye;
+    bx::mtxInverse(m_uniforms.camera.invViewProjMtx, m_viewProjMtx);
+}
+
+// Equivalent of raygen() in Raytracing.hlsl for every pixel, spread across the threads in
+// tiles. Camera rays are traced in packets of kPacketWidth x kPacketWidth pixels, everything
+// after the first hit is per pixel. Samples go straight into the running average.
+void CpuRenderer::performRaytracing()
+{
+    const uint32_t* randomValues = (const uint32_t*)m_randomTexture.getBufferPointer();
+
+    if (m_useWavefront)
+    {
+        m_rayCount += m_wavefront.render(m_threadPool, m_scene, m_uniforms, m_sampler, randomValues, m_usePackets, &m_raytracingOutput[0]);
+        return;
+    }
+
+    if (m_useAdaptiveSampling && m_uniforms.frameIndex == 0)
+    {
+        m_adaptiveSampling.reset();
+    }
+
+    m_tileScheduler.run(m_threadPool, [&](const CpuTile& tile, uint32_t threadIndex)
+    {
+        TraceContext ctx;
+        ctx.scene = &m_scene;
+        ctx.uniforms = &m_uniforms;
+        ctx.sampler = &m_sampler;
+        ctx.rayCount = 0;
+
+        CpuRay rays[kPacketWidth * kPacketWidth];
+        CpuHit hits[kPacketWidth * kPacketWidth];
+        bool hitFound[kPacketWidth * kPacketWidth];
+        uint32_t pixelIndices[kPacketWidth * kPacketWidth];
+        float samples[kPacketWidth * kPacketWidth * 4];
+
+        for (uint32_t y0 = tile.y0; y0 < tile.y1; y0 += kPacketWidth)
+        {
+            for (uint32_t x0 = tile.x0; x0 < tile.x1; x0 += kPacketWidth)
+            {
+                uint32_t x1 = bx::min(x0 + kPacketWidth, tile.x1);
+                uint32_t y1 = bx::min(y0 + kPacketWidth, tile.y1);
+
+                // Packets are the adaptive sampling blocks, converged ones are skipped and the
+                // rest may take more than one sample this frame.
+                uint32_t blockIndex = 0;
+                uint32_t passCount = 1;
+                uint32_t firstSample = m_uniforms.frameIndex;
+                if (m_useAdaptiveSampling)
+                {
+                    blockIndex = m_adaptiveSampling.getBlockIndex(x0, y0);
+                    passCount = m_adaptiveSampling.getPassCount(blockIndex);
+                    firstSample = m_adaptiveSampling.getSampleCount(blockIndex);
+                }
+
+                for (uint32_t pass = 0; pass < passCount; ++pass)
+                {
+                    ctx.sampleIndex = firstSample + pass;
+
+                    uint32_t rayCount = 0;
+                    for (uint32_t y = y0; y < y1; ++y)
+                    {
+                        for (uint32_t x = x0; x < x1; ++x)
+                        {
+                            uint32_t pixelIndex = y * m_width + x;
+
+                            // Every pixel draws its own samples from the sampler to decorrelate them
+                            ctx.pixelSeed = randomValues[pixelIndex];
+
+                            rays[rayCount] = generateCameraRay(m_uniforms,
+                                                               m_sampler.get(x, y, ctx.pixelSeed, ctx.sampleIndex, 0),
+                                                               m_sampler.get(x, y, ctx.pixelSeed, ctx.sampleIndex, 1),
+                                                               x, y);
+                            pixelIndices[rayCount] = pixelIndex;
+                            rayCount++;
+                        }
+                    }
+
+                    if (m_usePackets)
+                    {
+                        m_scene.intersectPacket(rays, rayCount, CPU_RAY_FLAG_CULL_BACK_FACING_TRIANGLES, hits, hitFound);
+                    }
+                    else
+                    {
+                        for (uint32_t i = 0; i < rayCount; ++i)
+                        {
+                            hitFound[i] = m_scene.intersect(rays[i], CPU_RAY_FLAG_CULL_BACK_FACING_TRIANGLES, hits[i]);
+                        }
+                    }
+
+                    // Rest of each camera ray's path.
+                    ctx.rayCount += rayCount;
+                    for (uint32_t i = 0; i < rayCount; ++i)
+                    {
+                        ctx.x = pixelIndices[i] % m_width;
+                        ctx.y = pixelIndices[i] / m_width;
+                        ctx.pixelSeed = randomValues[pixelIndices[i]];
+
+                        bx::Vec3 color(0.0f, 0.0f, 0.0f);
+                        if (hitFound[i])
+                        {
+                            color = tracePath(ctx, rays[i], hits[i]);
+                        }
+
+                        float* sample = &samples[i * 4];
+                        sample[0] = color.x;
+                        sample[1] = color.y;
+                        sample[2] = color.z;
+                        sample[3] = 1.0f;
+                    }
+
+                    // Accumulate while the packet's pixels are still in cache, one row at a time.
+                    const uint32_t packetWidth = x1 - x0;
+                    for (uint32_t y = y0; y < y1; ++y)
+                    {
+                        if (m_useAdaptiveSampling)
+                        {
+                            accumulateSamplesAndVariance(&samples[(y - y0) * packetWidth * 4], &m_accumulateOutput[(y * m_width + x0) * 4],
+                                                         m_adaptiveSampling.getLuminanceM2(y * m_width + x0), packetWidth, ctx.sampleIndex);
+                        }
+                        else
+                        {
+                            accumulateSamples(&samples[(y - y0) * packetWidth * 4], &m_accumulateOutput[(y * m_width + x0) * 4],
+                                              packetWidth, ctx.sampleIndex);
+                        }
+                    }
+                }
+
+                if (m_useAdaptiveSampling && passCount > 0)
+                {
+                    m_adaptiveSampling.finishBlock(blockIndex, passCount, &m_accumulateOutput[0]);
+                }
+            }
+        }
+
+        m_rayCount += ctx.rayCount;
+    });
+
+    if (m_useAdaptiveSampling)
+    {
+        m_adaptiveSampling.finishFrame();
+    }
+}
+
+// Equivalent of Accumulate.hlsl. The tiled integrator accumulates as it goes, only the
+// wavefront one leaves a whole frame of samples behind.
+void CpuRenderer::performAccumulate()
+{
+    if (!m_useWavefront)
+    {
+        return;
+    }
+
+    const uint32_t pixelCount = m_width * m_height;
+    m_threadPool.parallelFor(pixelCount, kAccumulateBlockSize, [&](uint32_t start, uint32_t end, uint32_t threadIndex)
+    {
+        accumulateSamples(&m_raytracingOutput[start * 4], &m_accumulateOutput[start * 4], end - start, m_uniforms.frameIndex);
+    });
+}
+
+// Equivalent of PostProcessing.hlsl
+void CpuRenderer::performPostProcessing()
+{
+    if (m_showSampleMask)
+    {
+        m_adaptiveSampling.writeMask(&m_postProcessingOutput[0]);
+        return;
+    }
+
+    m_threadPool.parallelFor(m_height, 8, [&](uint32_t start, uint32_t end, uint32_t threadIndex)
+    {
+        for (uint32_t i = start * m_width; i < end * m_width; ++i)
+        {
+            const float* color = &m_accumulateOutput[i * 4];
+
+            uint32_t pixel = 0xff000000;
+            for (uint32_t c = 0; c < 3; ++c)
+            {
+                // Tonemapping then convert to SRGB.
+                float value = D3DX_FLOAT_to_SRGB(ACESFilm(color[c]));
+                uint32_t byte = (uint32_t)(saturate(value) * 255.0f + 0.5f);
+                pixel |= byte << (c * 8);
+            }
+
+            m_postProcessingOutput[i] = pixel;
+        }
+    });
+}
+
+void CpuRenderer::present()
+{
+    SDL_Renderer* sdlRenderer = Engine::instance()->getRenderer();
+    if (sdlRenderer == nullptr || m_outputTexture == nullptr)
+    {
+        return;
+    }
+
+    SDL_UpdateTexture(m_outputTexture, nullptr, &m_postProcessingOutput[0], m_width * sizeof(uint32_t));
+    SDL_RenderCopy(sdlRenderer, m_outputTexture, nullptr, nullptr);
+    SDL_RenderPresent(sdlRenderer);
+}
+
+// Prints throughput about once a second.
+void CpuRenderer::updateStats()
+{
+    m_statsFrameCount++;
+
+    auto now = std::chrono::high_resolution_clock::now();
+    double seconds = std::chrono::duration<double>(now - m_statsStartTime).count();
+    if (seconds < 1.0)
+    {
+        return;
+    }
+
+    double raysPerSecond = double(m_rayCount.load()) / seconds;
+    double msPerFrame = (seconds * 1000.0) / double(m_statsFrameCount);
+
+    std::cout << "CPU renderer: " << (raysPerSecond / 1000000.0) << " Mrays/s, "
+              << msPerFrame << " ms/frame" << std::endl;
+
+    // Busy/idle time of each thread during raytracing, for tuning the tile size and thread count.
+    const std::vector<CpuTileScheduler::ThreadStats>& threadStats = m_tileScheduler.getThreadStats();
+    for (size_t i = 0; i < threadStats.size(); ++i)
+    {
+        const CpuTileScheduler::ThreadStats& stats = threadStats[i];
+        double totalMs = bx::max(stats.busyMs + stats.idleMs, 1e-6);
+
+        std::cout << "  thread " << i << ": " << (100.0 * stats.busyMs / totalMs) << "% busy, "
+                  << stats.busyMs << " ms busy, " << stats.idleMs << " ms idle, "
+                  << stats.tileCount << " tiles, " << stats.stealCount << " steals" << std::endl;
+    }
+    m_tileScheduler.resetThreadStats();
+
+    if (m_useAdaptiveSampling)
+    {
+        std::cout << "  adaptive: " << m_adaptiveSampling.getActiveBlockCount() << " of " << m_adaptiveSampling.getBlockCount()
+                  << " blocks active, " << m_adaptiveSampling.getFrameSampleCount() << " block samples per frame" << std::endl;
+    }
+
+    m_rayCount = 0;
+    m_statsFrameCount = 0;
+    m_statsStartTime = now;
+}
+
+void CpuRenderer::renderFrame()
+{
+    // Base class does some house keeping.
+    Renderer::renderFrame();
+
+    updateUniforms();
+
+    performRaytracing();
+    performAccumulate();
+    performPostProcessing();
+
+    present();
+    updateStats();
+}
+
+const std::vector<uint32_t>& CpuRenderer::getOutputPixels()
+{
+    return m_postProcessingOutput;
+}
@@ -0,0 +1,100 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#ifndef CPU_RENDERER_HEADER_GUARD
+#define CPU_RENDERER_HEADER_GUARD
+
+#include "engine/Renderer.h"
+#include "engine/Texture.h"
+#include "engine/CPU/CpuAccumulate.h"
+#include "engine/CPU/CpuAdaptiveSampling.h"
+#include "engine/CPU/CpuCommon.h"
+#include "engine/CPU/CpuSampler.h"
+#include "engine/CPU/CpuScene.h"
+#include "engine/CPU/CpuThreadPool.h"
+#include "engine/CPU/CpuTileScheduler.h"
+#include "engine/CPU/CpuWavefront.h"
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+namespace toyraygun
+{
+    // Renders the scenes Raytracing.hlsl, Accumulate.hlsl and PostProcessing.hlsl do on
+    // every core, for machines without a raytracing capable GPU. The estimator isn't the
+    // shaders' one: every light is sampled instead of just the brightest, light samples
+    // and bounce hits on lights are combined with multiple importance sampling, and paths
+    // can go deeper than MAX_BOUNCES with Russian roulette keeping long paths cheap.
+    class CpuRenderer : public Renderer
+    {
+    protected:
+        CpuThreadPool m_threadPool;
+        CpuScene m_scene;
+        CpuUniforms m_uniforms;
+
+        // Roulette only starts once a path is as deep as the GPU backends ever go, so by
+        // default no path is cut shorter than theirs.
+        static const uint32_t kDefaultRouletteDepth = MAX_BOUNCES;
+
+        // Camera rays are traced in square packets, 8x8 keeps the packet's bounds tight
+        // enough that it rarely visits nodes a single ray wouldn't.
+        static const uint32_t kPacketWidth = 8;
+        bool m_usePackets;
+
+        // Per pixel work is handed out in tiles, tile size is rounded up to whole packets.
+        static const uint32_t kDefaultTileSize = 32;
+        CpuTileScheduler m_tileScheduler;
+
+        CpuWavefront m_wavefront;
+        bool m_useWavefront;
+
+        // Raytracing input
+        CpuSampler m_sampler;
+        Texture m_randomTexture;
+
+        // Blocks of kPacketWidth x kPacketWidth pixels stop once they've converged.
+        CpuAdaptiveSampling m_adaptiveSampling;
+        bool m_useAdaptiveSampling;
+        bool m_showSampleMask;
+
+        // Pixels per job when accumulating a whole frame, 256KB of samples.
+        static const uint32_t kAccumulateBlockSize = 16 * 1024;
+
+        // RGBA32F render targets and the RGBA8 image that gets presented.
+        std::vector<float> m_raytracingOutput;
+        std::vector<float> m_accumulateOutput;
+        std::vector<uint32_t> m_postProcessingOutput;
+        SDL_Texture* m_outputTexture;
+
+        // Stats
+        std::atomic<uint64_t> m_rayCount;
+        uint32_t m_statsFrameCount;
+        std::chrono::high_resolution_clock::time_point m_statsStartTime;
+
+        void updateUniforms();
+        void performRaytracing();
+        void performAccumulate();
+        void performPostProcessing();
+        void present();
+        void updateStats();
+
+    public:
+        CpuRenderer();
+
+        // Setup
+        virtual bool init();
+        virtual void destroy();
+        virtual void loadScene(Scene* scene);
+        virtual void updateScene(Scene* scene);
+
+        // Rendering
+        virtual void renderFrame();
+
+        const std::vector<uint32_t>& getOutputPixels();
+    };
+}
+
+#endif // CPU_RENDERER_HEADER_GUARD
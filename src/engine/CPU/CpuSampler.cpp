@@ -0,0 +1,128 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#include "CpuSampler.h"
+using namespace toyraygun;
+
+static uint32_t reverseBits(uint32_t x)
+{
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+    x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+static uint32_t hashSeed(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x21f0aaadu;
+    x ^= x >> 15;
+    x *= 0x735a2d97u;
+    x ^= x >> 15;
+    return x;
+}
+
+// Owen scrambling: every bit is flipped or not depending on the bits above it. The hash
+// is Laine and Karras' with Burley's constants, it works on reversed bits since an
+// integer multiply only carries upwards. See "Practical Hash-based Owen Scrambling".
+static uint32_t owenScramble(uint32_t x, uint32_t seed)
+{
+    x = reverseBits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return reverseBits(x);
+}
+
+// Second dimension of the Sobol sequence, from the primitive polynomial x + 1. The first
+// is the bit reversed index.
+static uint32_t sobolSecond(uint32_t index)
+{
+    uint32_t result = 0;
+    uint32_t direction = 1u << 31;
+    for (; index != 0; index >>= 1)
+    {
+        if (index & 1)
+        {
+            result ^= direction;
+        }
+        direction ^= direction >> 1;
+    }
+    return result;
+}
+
+CpuSampler::CpuSampler() :
+    m_useHalton(false),
+    m_useBlueNoise(false)
+{
+
+}
+
+void CpuSampler::init(uint32_t seed)
+{
+    m_table.resize(size_t(kSampleCount) * kDimensionCount);
+
+    for (uint32_t dimension = 0; dimension < kDimensionCount; ++dimension)
+    {
+        // Both dimensions of a pair visit the points in the same shuffled order. Owen
+        // scrambling the index keeps each power of two prefix of rows a whole number of
+        // the sequence's strata.
+        const uint32_t pair = dimension / 2;
+        const uint32_t orderSeed = hashSeed(seed ^ hashSeed(pair));
+        const uint32_t valueSeed = hashSeed(seed ^ hashSeed(dimension + kDimensionCount));
+
+        for (uint32_t row = 0; row < kSampleCount; ++row)
+        {
+            const uint32_t index = owenScramble(row, orderSeed);
+            const uint32_t value = (dimension % 2 == 0) ? reverseBits(index) : sobolSecond(index);
+            m_table[(size_t(row) * kDimensionCount) + dimension] = owenScramble(value, valueSeed);
+        }
+
+        const uint32_t offset = hashSeed(seed ^ hashSeed(dimension + (2 * kDimensionCount)));
+        m_blueNoiseOffsetX[dimension] = uint8_t(offset);
+        m_blueNoiseOffsetY[dimension] = uint8_t(offset >> 8);
+    }
+}
+
+void CpuSampler::destroy()
+{
+    std::vector<uint32_t>().swap(m_table);
+    m_blueNoise.destroy();
+    m_useBlueNoise = false;
+}
+
+void CpuSampler::setUseHalton(bool enabled)
+{
+    m_useHalton = enabled;
+}
+
+bool CpuSampler::getUseHalton() const
+{
+    return m_useHalton;
+}
+
+bool CpuSampler::loadBlueNoise(const std::string& pathPrefix)
+{
+    m_useBlueNoise = m_blueNoise.load(pathPrefix);
+    return m_useBlueNoise;
+}
+
+void CpuSampler::setUseBlueNoise(bool enabled)
+{
+    m_useBlueNoise = enabled && m_blueNoise.getSliceCount() > 0;
+}
+
+bool CpuSampler::getUseBlueNoise() const
+{
+    return m_useBlueNoise;
+}
+
+const CpuBlueNoise& CpuSampler::getBlueNoise() const
+{
+    return m_blueNoise;
+}
@@ -0,0 +1,126 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#ifndef CPU_SAMPLER_HEADER_GUARD
+#define CPU_SAMPLER_HEADER_GUARD
+
+#include "engine/CPU/CpuBlueNoise.h"
+#include "engine/CPU/CpuCommon.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace toyraygun
+{
+    // Dimensions 0 and 1 jitter the camera ray, then every bounce of a path takes
+    // CPU_BOUNCE_DIMENSIONS more starting at getBounceDimension().
+    enum CpuBounceDimension
+    {
+        CPU_DIMENSION_LIGHT_U = 0,
+        CPU_DIMENSION_LIGHT_V,
+        CPU_DIMENSION_LIGHT_SELECT,
+        CPU_DIMENSION_ROULETTE,
+        CPU_DIMENSION_BOUNCE_U,
+        CPU_DIMENSION_BOUNCE_V,
+
+        CPU_BOUNCE_DIMENSIONS
+    };
+
+    // First dimension of the bounce off a path's depth'th hit, depth starts at 1.
+    inline uint32_t getBounceDimension(uint32_t depth, CpuBounceDimension dimension)
+    {
+        return 2 + ((depth - 1) * CPU_BOUNCE_DIMENSIONS) + dimension;
+    }
+
+    // Random numbers for the integrators. By default these come from a table of Sobol
+    // points built once at startup: each pair of dimensions is a 2D Sobol sequence with
+    // its own Owen scrambled order and values, so pairs don't correlate with each other
+    // and every power of two prefix stays stratified. A frame reads one row of the table,
+    // and pixels decorrelate by XORing their own random bits into it, which keeps the
+    // stratification too. Lookups are a load and a hash instead of halton()'s divisions.
+    // The old halton() lookup is kept for comparison.
+    //
+    // With blue noise loaded, pixels rotate the row by an amount instead, the top 8 bits
+    // of which come from the STBN texture at the pixel's position. Neighbouring pixels then
+    // get rotations that are far apart, so the error left after a few samples is spread
+    // out as high frequency noise instead of clumps. Each dimension reads the texture at
+    // its own offset so dimensions don't share a pattern.
+    class CpuSampler
+    {
+    public:
+        static const uint32_t kSampleCount = 4096;
+        static const uint32_t kDimensionCount = 64;
+
+    protected:
+        std::vector<uint32_t> m_table;  // kSampleCount rows of kDimensionCount.
+        bool m_useHalton;
+
+        CpuBlueNoise m_blueNoise;
+        bool m_useBlueNoise;
+        uint8_t m_blueNoiseOffsetX[kDimensionCount];
+        uint8_t m_blueNoiseOffsetY[kDimensionCount];
+
+        static uint32_t hashPixel(uint32_t pixelSeed, uint32_t dimension, uint32_t pass)
+        {
+            uint32_t hash = pixelSeed ^ (dimension * 0x9e3779b9u) ^ (pass * 0x85ebca6bu);
+            hash ^= hash >> 16;
+            hash *= 0x7feb352du;
+            hash ^= hash >> 15;
+            hash *= 0x846ca68bu;
+            hash ^= hash >> 16;
+            return hash;
+        }
+
+    public:
+        CpuSampler();
+
+        void init(uint32_t seed = 0);
+        void destroy();
+
+        void setUseHalton(bool enabled);
+        bool getUseHalton() const;
+
+        // Blue noise slices, see CpuBlueNoise::load(). Enabled if any load.
+        bool loadBlueNoise(const std::string& pathPrefix);
+        void setUseBlueNoise(bool enabled);
+        bool getUseBlueNoise() const;
+        const CpuBlueNoise& getBlueNoise() const;
+
+        // A number in [0, 1) for pixel (x, y)'s sampleIndex'th sample. Past kSampleCount
+        // samples the table repeats with new pixel bits.
+        float get(uint32_t x, uint32_t y, uint32_t pixelSeed, uint32_t sampleIndex, uint32_t dimension) const
+        {
+            if (m_useHalton)
+            {
+                return halton(pixelSeed + sampleIndex, dimension);
+            }
+
+            const uint32_t row = sampleIndex & (kSampleCount - 1);
+            const uint32_t pass = sampleIndex / kSampleCount;
+            uint32_t bits = m_table[(row * kDimensionCount) + dimension];
+
+            if (m_useBlueNoise)
+            {
+                // The volume moves on a slice per frame, a single slice rotates every frame
+                // of the pixel by the same amount.
+                const uint8_t* slice = m_blueNoise.getSlice(sampleIndex);
+                const uint32_t u = (x + m_blueNoiseOffsetX[dimension]) & (CpuBlueNoise::kSize - 1);
+                const uint32_t v = (y + m_blueNoiseOffsetY[dimension]) & (CpuBlueNoise::kSize - 1);
+                const uint32_t rotation = (uint32_t(slice[(v * CpuBlueNoise::kSize) + u]) << 24) | (hashPixel(pixelSeed, dimension, 0) >> 8);
+                bits += rotation + (pass * 0x9e3779b9u);
+            }
+            else
+            {
+                bits ^= hashPixel(pixelSeed, dimension, pass);
+            }
+
+            // Top 24 bits, so the result can't round up to 1.
+            return float(bits >> 8) * (1.0f / 16777216.0f);
+        }
+    };
+}
+
+#endif // CPU_SAMPLER_HEADER_GUARD
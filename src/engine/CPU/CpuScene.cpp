@@ -0,0 +1,526 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#include "CpuScene.h"
+#include "engine/CPU/CpuTraversal.h"
+using namespace toyraygun;
+
+#include <algorithm>
+#include <iostream>
+#include <string.h>
+
+// Inverse of a 3x4 row major affine transform, through bx's 4x4 inverse.
+static void invertTransform(const float* transform, float* inverseOut)
+{
+    float mtx[16];
+    for (int row = 0; row < 3; ++row)
+    {
+        for (int column = 0; column < 4; ++column)
+        {
+            mtx[(column * 4) + row] = transform[(row * 4) + column];
+        }
+    }
+    mtx[3] = 0.0f;
+    mtx[7] = 0.0f;
+    mtx[11] = 0.0f;
+    mtx[15] = 1.0f;
+
+    float inverse[16];
+    bx::mtxInverse(inverse, mtx);
+
+    for (int row = 0; row < 3; ++row)
+    {
+        for (int column = 0; column < 4; ++column)
+        {
+            inverseOut[(row * 4) + column] = inverse[(column * 4) + row];
+        }
+    }
+}
+
+static inline bx::Vec3 transformPoint(const float* transform, const bx::Vec3& point)
+{
+    return bx::Vec3(transform[0] * point.x + transform[1] * point.y + transform[2] * point.z + transform[3],
+                    transform[4] * point.x + transform[5] * point.y + transform[6] * point.z + transform[7],
+                    transform[8] * point.x + transform[9] * point.y + transform[10] * point.z + transform[11]);
+}
+
+static inline bx::Vec3 transformDirection(const float* transform, const bx::Vec3& direction)
+{
+    return bx::Vec3(transform[0] * direction.x + transform[1] * direction.y + transform[2] * direction.z,
+                    transform[4] * direction.x + transform[5] * direction.y + transform[6] * direction.z,
+                    transform[8] * direction.x + transform[9] * direction.y + transform[10] * direction.z);
+}
+
+// The direction isn't renormalized so distances along the ray are the same in both
+// spaces and hits on different instances compare directly.
+static inline void transformRay(const CpuInstance& instance, const CpuRay& ray, CpuRay& rayOut)
+{
+    rayOut = ray;
+    rayOut.origin = transformPoint(instance.worldToObject, ray.origin);
+    rayOut.direction = transformDirection(instance.worldToObject, ray.direction);
+}
+
+CpuScene::CpuScene() :
+    m_useBVH8(true),
+    m_builtSAHCost(0.0f)
+{
+
+}
+
+// Rebuild the top level tree once refitting has made it this much more expensive to
+// trace than it was when it was built.
+static const float kRebuildCostRatio = 1.5f;
+
+// World bounds of the mesh bounds' corners.
+static CpuAABB getWorldBounds(const CpuAABB& meshBounds, const float* objectToWorld)
+{
+    CpuAABB bounds;
+    bounds.reset();
+    for (uint32_t corner = 0; corner < 8; ++corner)
+    {
+        bx::Vec3 point((corner & 1) ? meshBounds.max[0] : meshBounds.min[0],
+                       (corner & 2) ? meshBounds.max[1] : meshBounds.min[1],
+                       (corner & 4) ? meshBounds.max[2] : meshBounds.min[2]);
+        point = transformPoint(objectToWorld, point);
+
+        const float worldPoint[3] = { point.x, point.y, point.z };
+        bounds.grow(worldPoint);
+    }
+    return bounds;
+}
+
+void CpuScene::build(Scene* scene, CpuThreadPool* threadPool)
+{
+    destroy();
+
+    m_meshes.resize(scene->m_meshes.size());
+    for (size_t i = 0; i < scene->m_meshes.size(); ++i)
+    {
+        m_meshes[i].build(scene->m_meshes[i], threadPool);
+    }
+
+    // Instances of empty meshes are left out of the top level tree.
+    m_instances.resize(scene->m_instances.size());
+    m_instancePrimitives.resize(scene->m_instances.size());
+    for (size_t i = 0; i < scene->m_instances.size(); ++i)
+    {
+        const SceneInstance& sceneInstance = scene->m_instances[i];
+        CpuInstance& instance = m_instances[i];
+
+        instance.meshID = sceneInstance.meshID;
+        instance.mask = sceneInstance.mask;
+        memcpy(instance.objectToWorld, sceneInstance.transform, sizeof(instance.objectToWorld));
+        invertTransform(instance.objectToWorld, instance.worldToObject);
+
+        CpuAABB meshBounds;
+        if (!m_meshes[instance.meshID].getBounds(meshBounds))
+        {
+            m_instancePrimitives[i] = UINT32_MAX;
+            continue;
+        }
+
+        m_instancePrimitives[i] = (uint32_t)m_primitiveBounds.size();
+        m_primitiveBounds.push_back(getWorldBounds(meshBounds, instance.objectToWorld));
+        m_primitiveInstances.push_back((uint32_t)i);
+    }
+
+    buildTopLevel(threadPool);
+
+    m_lights = scene->m_lights;
+    m_lightAliases = scene->m_lightAliases;
+    buildLightLookup();
+
+    size_t meshTriangleCount = 0;
+    size_t blockCount = 0;
+    size_t meshBytes = 0;
+    for (size_t i = 0; i < m_meshes.size(); ++i)
+    {
+        meshTriangleCount += m_meshes[i].getTriangleCount();
+        blockCount += m_meshes[i].getBlockCount();
+        meshBytes += m_meshes[i].getMemorySize();
+    }
+
+    size_t bakedBytes = 0;
+    for (size_t i = 0; i < m_instances.size(); ++i)
+    {
+        bakedBytes += m_meshes[m_instances[i].meshID].getMemorySize();
+    }
+
+    const size_t instanceBytes = (m_instances.size() * sizeof(CpuInstance)) + (m_leafInstances.size() * sizeof(uint32_t)) +
+                                 (m_bvh.getNodes().size() * sizeof(CpuBVHNode)) + (m_bvh8.getNodes().size() * sizeof(CpuBVH8Node));
+
+    std::cout << "CPU scene: " << m_instances.size() << " instances of " << m_meshes.size() << " meshes, "
+              << meshTriangleCount << " mesh triangles (" << getTriangleCount() << " instanced) in "
+              << blockCount << " blocks of " << kTriangleBlockSize << " ("
+              << (100.0f * meshTriangleCount) / bx::max<size_t>(blockCount * kTriangleBlockSize, 1) << "% slots used), "
+              << ((meshBytes + instanceBytes) / (1024.0f * 1024.0f)) << " MB, "
+              << ((bakedBytes + instanceBytes) / (1024.0f * 1024.0f)) << " MB without instancing, "
+              << m_lights.size() << " lights." << std::endl;
+}
+
+void CpuScene::buildTopLevel(CpuThreadPool* threadPool)
+{
+    m_bvh.destroy();
+    m_bvh8.destroy();
+    m_leafInstances.clear();
+    m_builtSAHCost = 0.0f;
+
+    if (m_primitiveBounds.empty())
+    {
+        return;
+    }
+
+    // An instance costs far more to test than a box, one per leaf lets the node tests cull
+    // every instance on its own.
+    m_bvh.build(&m_primitiveBounds[0], (uint32_t)m_primitiveBounds.size(), 1, 1, threadPool);
+    m_bvh8.build(m_bvh);
+    m_builtSAHCost = m_bvh.getSAHCost();
+
+    const std::vector<uint32_t>& primitiveIndices = m_bvh.getPrimitiveIndices();
+    m_leafInstances.resize(primitiveIndices.size());
+    for (size_t i = 0; i < primitiveIndices.size(); ++i)
+    {
+        m_leafInstances[i] = m_primitiveInstances[primitiveIndices[i]];
+    }
+}
+
+bool CpuScene::update(Scene* scene, CpuThreadPool* threadPool)
+{
+    // Anything other than instances moving needs the whole scene rebuilt.
+    if (scene->m_meshes.size() != m_meshes.size() || scene->m_instances.size() != m_instances.size())
+    {
+        build(scene, threadPool);
+        return true;
+    }
+
+    const std::vector<uint32_t>& dirtyInstances = scene->getDirtyInstances();
+    if (dirtyInstances.empty())
+    {
+        return false;
+    }
+
+    // Lights are only taken again if one of them moved, Scene::buildLights() has to have
+    // been called since.
+    if (scene->getDirtyInstancesHaveLights())
+    {
+        m_lights = scene->m_lights;
+        m_lightAliases = scene->m_lightAliases;
+        buildLightLookup();
+    }
+
+    auto updateInstances = [&](uint32_t start, uint32_t end, uint32_t threadIndex)
+    {
+        for (uint32_t i = start; i < end; ++i)
+        {
+            const uint32_t instanceIndex = dirtyInstances[i];
+            CpuInstance& instance = m_instances[instanceIndex];
+            memcpy(instance.objectToWorld, scene->m_instances[instanceIndex].transform, sizeof(instance.objectToWorld));
+            invertTransform(instance.objectToWorld, instance.worldToObject);
+
+            const uint32_t primitive = m_instancePrimitives[instanceIndex];
+            CpuAABB meshBounds;
+            if (primitive != UINT32_MAX && m_meshes[instance.meshID].getBounds(meshBounds))
+            {
+                m_primitiveBounds[primitive] = getWorldBounds(meshBounds, instance.objectToWorld);
+            }
+        }
+    };
+
+    if (threadPool != nullptr)
+    {
+        threadPool->parallelFor((uint32_t)dirtyInstances.size(), 256, updateInstances);
+    }
+    else
+    {
+        updateInstances(0, (uint32_t)dirtyInstances.size(), 0);
+    }
+
+    if (m_primitiveBounds.empty())
+    {
+        return false;
+    }
+
+    // Meshes don't change so only the top level tree needs new bounds.
+    const float sahCost = m_bvh.refit(&m_primitiveBounds[0], threadPool);
+    if (sahCost > m_builtSAHCost * kRebuildCostRatio)
+    {
+        std::cout << "CPU scene: top level SAH cost went from " << m_builtSAHCost << " to " << sahCost
+                  << " after refitting, rebuilding it." << std::endl;
+        buildTopLevel(threadPool);
+        return true;
+    }
+
+    m_bvh8.refit(m_bvh, threadPool);
+    return false;
+}
+
+void CpuScene::destroy()
+{
+    m_meshes.clear();
+    m_instances.clear();
+    m_instancePrimitives.clear();
+    m_primitiveBounds.clear();
+    m_primitiveInstances.clear();
+    m_bvh.destroy();
+    m_bvh8.destroy();
+    m_leafInstances.clear();
+    m_builtSAHCost = 0.0f;
+    m_lights.clear();
+    m_lightAliases.clear();
+    m_instanceLightOffsets.clear();
+    m_primitiveLights.clear();
+}
+
+template<bool AnyHit>
+bool CpuScene::traverse(const CpuRay& ray, uint32_t flags, CpuHit& hitOut) const
+{
+    const bool cullBackFaces = (flags & CPU_RAY_FLAG_CULL_BACK_FACING_TRIANGLES) != 0;
+
+    auto leafFunc = [&](uint32_t first, uint32_t count, float& closestT)
+    {
+        bool hit = false;
+        for (uint32_t i = first; i < first + count; ++i)
+        {
+            const uint32_t instanceIndex = m_leafInstances[i];
+            const CpuInstance& instance = m_instances[instanceIndex];
+            if ((instance.mask & ray.mask) == 0)
+            {
+                continue;
+            }
+
+            CpuRay objectRay;
+            transformRay(instance, ray, objectRay);
+
+            const CpuMesh& mesh = m_meshes[instance.meshID];
+            if (AnyHit)
+            {
+                if (mesh.occluded(objectRay, cullBackFaces, m_useBVH8, closestT))
+                {
+                    return true;
+                }
+            }
+            else if (mesh.intersect(objectRay, cullBackFaces, m_useBVH8, closestT, hitOut))
+            {
+                hitOut.instanceIndex = instanceIndex;
+                hit = true;
+            }
+        }
+
+        return hit;
+    };
+
+    float closestT = ray.tMax;
+    if (m_useBVH8)
+    {
+        return traverseBVH8<AnyHit>(m_bvh8, ray, closestT, leafFunc);
+    }
+
+    return traverseBVH<AnyHit>(m_bvh, ray, closestT, leafFunc);
+}
+
+bool CpuScene::intersect(const CpuRay& ray, uint32_t flags, CpuHit& hitOut) const
+{
+    return traverse<false>(ray, flags, hitOut);
+}
+
+void CpuScene::intersectPacket(const CpuRay* rays, uint32_t rayCount, uint32_t flags, CpuHit* hitsOut, bool* hitFoundOut) const
+{
+    CpuBVH8Packet packet;
+    if (!m_useBVH8 || m_bvh8.getNodes().empty() || rayCount > kMaxPacketSize || !packet.setup(rays, rayCount))
+    {
+        for (uint32_t i = 0; i < rayCount; ++i)
+        {
+            hitFoundOut[i] = intersect(rays[i], flags, hitsOut[i]);
+        }
+        return;
+    }
+
+    const bool cullBackFaces = (flags & CPU_RAY_FLAG_CULL_BACK_FACING_TRIANGLES) != 0;
+
+    float closestT[kMaxPacketSize];
+    for (uint32_t i = 0; i < rayCount; ++i)
+    {
+        closestT[i] = rays[i].tMax;
+        hitFoundOut[i] = false;
+    }
+
+    // The packet is moved into each instance's object space in turn.
+    CpuRay objectRays[kMaxPacketSize];
+    float meshClosestT[kMaxPacketSize];
+    CpuHit meshHits[kMaxPacketSize];
+    bool meshHitFound[kMaxPacketSize];
+
+    traversePacketBVH8(m_bvh8, packet, closestT, rayCount, [&](uint32_t first, uint32_t count, float entryDistance)
+    {
+        for (uint32_t j = first; j < first + count; ++j)
+        {
+            const uint32_t instanceIndex = m_leafInstances[j];
+            const CpuInstance& instance = m_instances[instanceIndex];
+
+            // Rays that can't hit this instance get an empty interval.
+            for (uint32_t i = 0; i < rayCount; ++i)
+            {
+                transformRay(instance, rays[i], objectRays[i]);
+                const bool active = (instance.mask & rays[i].mask) != 0 && entryDistance < closestT[i];
+                meshClosestT[i] = active ? closestT[i] : rays[i].tMin;
+            }
+
+            m_meshes[instance.meshID].intersectPacket(objectRays, rayCount, cullBackFaces, meshClosestT, meshHits, meshHitFound);
+
+            for (uint32_t i = 0; i < rayCount; ++i)
+            {
+                if (meshHitFound[i])
+                {
+                    closestT[i] = meshClosestT[i];
+                    hitsOut[i] = meshHits[i];
+                    hitsOut[i].instanceIndex = instanceIndex;
+                    hitFoundOut[i] = true;
+                }
+            }
+        }
+    });
+}
+
+bool CpuScene::occluded(const CpuRay& ray, uint32_t flags) const
+{
+    CpuHit hit;
+    return traverse<true>(ray, flags, hit);
+}
+
+bx::Vec3 CpuScene::getNormal(const CpuHit& hit) const
+{
+    const CpuInstance& instance = m_instances[hit.instanceIndex];
+    const bx::Vec3 normal = m_meshes[instance.meshID].getNormal(hit);
+
+    // Normals go to world space through the inverse transpose. Normalizing once at the end
+    // is what Raytracing.metal does, for flat triangles it's also the same as Raytracing.hlsl.
+    const float* m = instance.worldToObject;
+    return bx::normalize(bx::Vec3(m[0] * normal.x + m[4] * normal.y + m[8] * normal.z,
+                                  m[1] * normal.x + m[5] * normal.y + m[9] * normal.z,
+                                  m[2] * normal.x + m[6] * normal.y + m[10] * normal.z));
+}
+
+bx::Vec3 CpuScene::getColor(const CpuHit& hit) const
+{
+    return m_meshes[m_instances[hit.instanceIndex].meshID].getColor(hit);
+}
+
+uint32_t CpuScene::getMaterialID(const CpuHit& hit) const
+{
+    return m_meshes[m_instances[hit.instanceIndex].meshID].getMaterialID(hit.primitiveIndex);
+}
+
+bool CpuScene::sampleLight(float select, float u, float v, bx::Vec3 position, bx::Vec3 vertexNormal, CpuLightSample& sampleOut) const
+{
+    if (m_lights.empty())
+    {
+        return false;
+    }
+
+    // One uniform bucket, then the fraction left over picks between it and its alias.
+    const uint32_t lightCount = (uint32_t)m_lights.size();
+    const float bucket = select * lightCount;
+    uint32_t lightIndex = bx::min((uint32_t)bucket, lightCount - 1);
+
+    const SceneLightAlias& alias = m_lightAliases[lightIndex];
+    if (bucket - lightIndex >= alias.probability)
+    {
+        lightIndex = alias.alias;
+    }
+
+    const SceneLight& light = m_lights[lightIndex];
+    if (light.type == SceneLightType::Quad)
+    {
+        CpuAreaLight areaLight;
+        areaLight.position = light.position;
+        areaLight.forward = light.normal;
+        areaLight.right = light.edge0;
+        areaLight.up = light.edge1;
+        areaLight.color = light.color;
+        sampleOut = sampleAreaLight(areaLight, u, v, position, vertexNormal);
+    }
+    else
+    {
+        sampleOut = sampleTriangleLight(light.position, light.edge0, light.edge1, light.normal, light.color, u, v, position, vertexNormal);
+    }
+
+    sampleOut.color = bx::mul(sampleOut.color, 1.0f / light.pdf);
+    sampleOut.pdf *= light.pdf;
+    return true;
+}
+
+float CpuScene::getLightPdf(const CpuRay& ray, const CpuHit& hit) const
+{
+    const uint32_t offset = m_instanceLightOffsets.empty() ? UINT32_MAX : m_instanceLightOffsets[hit.instanceIndex];
+    if (offset == UINT32_MAX)
+    {
+        return 0.0f;
+    }
+
+    const uint32_t lightIndex = m_primitiveLights[offset + hit.primitiveIndex];
+    if (lightIndex == UINT32_MAX)
+    {
+        return 0.0f;
+    }
+
+    // The same density sampleLightPoint() gives the point, ray directions are unit length.
+    const SceneLight& light = m_lights[lightIndex];
+    const float lightCosine = saturate(bx::dot(bx::neg(ray.direction), light.normal));
+    if (lightCosine <= 0.0f)
+    {
+        return 0.0f;
+    }
+
+    return (light.pdf * hit.t * hit.t) / (light.area * lightCosine);
+}
+
+void CpuScene::buildLightLookup()
+{
+    m_instanceLightOffsets.assign(m_instances.size(), UINT32_MAX);
+    m_primitiveLights.clear();
+
+    for (uint32_t i = 0; i < (uint32_t)m_lights.size(); ++i)
+    {
+        const SceneLight& light = m_lights[i];
+
+        uint32_t& offset = m_instanceLightOffsets[light.instanceIndex];
+        const uint32_t triangleCount = m_meshes[m_instances[light.instanceIndex].meshID].getTriangleCount();
+        if (offset == UINT32_MAX)
+        {
+            offset = (uint32_t)m_primitiveLights.size();
+            m_primitiveLights.resize(m_primitiveLights.size() + triangleCount, UINT32_MAX);
+        }
+
+        // A quad is every triangle of its plane.
+        if (light.primitiveIndex == UINT32_MAX)
+        {
+            std::fill(m_primitiveLights.begin() + offset, m_primitiveLights.begin() + offset + triangleCount, i);
+        }
+        else
+        {
+            m_primitiveLights[offset + light.primitiveIndex] = i;
+        }
+    }
+}
+
+void CpuScene::setUseBVH8(bool enabled)
+{
+    m_useBVH8 = enabled;
+}
+
+bool CpuScene::getUseBVH8() const
+{
+    return m_useBVH8;
+}
+
+uint32_t CpuScene::getTriangleCount() const
+{
+    uint32_t triangleCount = 0;
+    for (size_t i = 0; i < m_instances.size(); ++i)
+    {
+        triangleCount += m_meshes[m_instances[i].meshID].getTriangleCount();
+    }
+    return triangleCount;
+}
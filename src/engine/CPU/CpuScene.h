@@ -0,0 +1,119 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#ifndef CPU_SCENE_HEADER_GUARD
+#define CPU_SCENE_HEADER_GUARD
+
+#include "engine/Scene.h"
+#include "engine/CPU/CpuBVH.h"
+#include "engine/CPU/CpuBVH8.h"
+#include "engine/CPU/CpuCommon.h"
+#include "engine/CPU/CpuMesh.h"
+#include "engine/CPU/CpuRay.h"
+#include "engine/CPU/CpuThreadPool.h"
+
+#include <stdint.h>
+#include <vector>
+#include <bx/math.h>
+
+namespace toyraygun
+{
+    // A SceneInstance with the inverse transform rays are moved into object space with.
+    // Both are 3x4 row major.
+    struct CpuInstance
+    {
+        uint32_t meshID;
+        uint32_t mask;
+        float objectToWorld[12];
+        float worldToObject[12];
+    };
+
+    // Two level acceleration structure the CPU renderer traces against, built from a
+    // Scene. Each mesh has its own BVH in object space and a top level BVH over the
+    // instances' world bounds finds which of them a ray has to visit, so any number of
+    // copies of a mesh cost one mesh's memory.
+    class CpuScene
+    {
+    protected:
+        std::vector<CpuMesh> m_meshes;
+        std::vector<CpuInstance> m_instances;
+
+        // World bounds of every instance with a non-empty mesh, the primitives of the top
+        // level tree, and which instance each one is.
+        std::vector<CpuAABB> m_primitiveBounds;
+        std::vector<uint32_t> m_primitiveInstances;
+        std::vector<uint32_t> m_instancePrimitives;  // UINT32_MAX for empty meshes.
+
+        // Top level tree, its leaves index m_leafInstances.
+        CpuBVH m_bvh;
+        CpuBVH8 m_bvh8;
+        bool m_useBVH8;
+        std::vector<uint32_t> m_leafInstances;
+        float m_builtSAHCost;
+
+        // Copied from the scene along with its alias table.
+        std::vector<SceneLight> m_lights;
+        std::vector<SceneLightAlias> m_lightAliases;
+
+        // Light of every triangle of the instances that have any, found through the
+        // instance's offset. UINT32_MAX where there isn't one.
+        std::vector<uint32_t> m_instanceLightOffsets;
+        std::vector<uint32_t> m_primitiveLights;
+
+        void buildLightLookup();
+
+        void buildTopLevel(CpuThreadPool* threadPool);
+
+        template<bool AnyHit>
+        bool traverse(const CpuRay& ray, uint32_t flags, CpuHit& hitOut) const;
+
+    public:
+        CpuScene();
+
+        void build(Scene* scene, CpuThreadPool* threadPool);
+
+        // Moves the scene's dirty instances and refits the top level tree around them,
+        // rebuilding it instead once refitting has degraded it too far. Returns true if
+        // anything was rebuilt.
+        bool update(Scene* scene, CpuThreadPool* threadPool);
+        void destroy();
+
+        // Trace against the 8 wide BVHs (default) or the binary ones they were collapsed from.
+        void setUseBVH8(bool enabled);
+        bool getUseBVH8() const;
+
+        // Closest hit along the ray, false if nothing was hit.
+        bool intersect(const CpuRay& ray, uint32_t flags, CpuHit& hitOut) const;
+
+        // Closest hits for a group of coherent rays, e.g. camera rays from a block of
+        // pixels. Nodes are culled for the whole group at once, rays that can't share a
+        // packet are traced one at a time.
+        static const uint32_t kMaxPacketSize = CpuMesh::kMaxPacketSize;
+        void intersectPacket(const CpuRay* rays, uint32_t rayCount, uint32_t flags, CpuHit* hitsOut, bool* hitFoundOut) const;
+
+        // True if anything is hit between tMin and tMax, stops at the first hit found. With
+        // CPU_RAY_MASK_SHADOW this is a shadow test that ignores the lights themselves.
+        bool occluded(const CpuRay& ray, uint32_t flags) const;
+
+        // Interpolated vertex attributes at a hit, the normal in world space.
+        bx::Vec3 getNormal(const CpuHit& hit) const;
+        bx::Vec3 getColor(const CpuHit& hit) const;
+        uint32_t getMaterialID(const CpuHit& hit) const;
+
+        // Picks a light in proportion to its power with select and samples a point on it
+        // with u and v. The color and pdf already include the chance of picking the light.
+        // False if the scene has no lights.
+        bool sampleLight(float select, float u, float v, bx::Vec3 position, bx::Vec3 vertexNormal, CpuLightSample& sampleOut) const;
+
+        // Chance per solid angle of sampleLight() picking the point a ray hit, zero if
+        // the hit isn't on a light.
+        float getLightPdf(const CpuRay& ray, const CpuHit& hit) const;
+
+        // Triangles across all instances.
+        uint32_t getTriangleCount() const;
+    };
+}
+
+#endif // CPU_SCENE_HEADER_GUARD
@@ -0,0 +1,166 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#include "CpuThreadPool.h"
+using namespace toyraygun;
+
+#include <bx/math.h>
+
+CpuThreadPool::CpuThreadPool() :
+    m_quit(false),
+    m_generation(0),
+    m_activeWorkers(0),
+    m_task(nullptr),
+    m_taskCount(0),
+    m_grainSize(1),
+    m_runOnAllThreads(false),
+    m_nextIndex(0)
+{
+
+}
+
+CpuThreadPool::~CpuThreadPool()
+{
+    destroy();
+}
+
+void CpuThreadPool::init(uint32_t threadCount)
+{
+    destroy();
+
+    if (threadCount == 0)
+    {
+        threadCount = bx::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    m_quit = false;
+
+    // The calling thread is thread 0 so we only need to spawn the rest.
+    for (uint32_t i = 1; i < threadCount; ++i)
+    {
+        m_threads.push_back(std::thread(&CpuThreadPool::workerLoop, this, i));
+    }
+}
+
+void CpuThreadPool::destroy()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_workCondition.notify_all();
+
+    for (size_t i = 0; i < m_threads.size(); ++i)
+    {
+        m_threads[i].join();
+    }
+    m_threads.clear();
+}
+
+uint32_t CpuThreadPool::getThreadCount()
+{
+    return (uint32_t)m_threads.size() + 1;
+}
+
+void CpuThreadPool::runTask(uint32_t threadIndex)
+{
+    if (m_runOnAllThreads)
+    {
+        (*m_task)(threadIndex, threadIndex + 1, threadIndex);
+        return;
+    }
+
+    while (true)
+    {
+        uint32_t start = m_nextIndex.fetch_add(m_grainSize);
+        if (start >= m_taskCount)
+        {
+            break;
+        }
+
+        uint32_t end = bx::min(start + m_grainSize, m_taskCount);
+        (*m_task)(start, end, threadIndex);
+    }
+}
+
+void CpuThreadPool::workerLoop(uint32_t threadIndex)
+{
+    uint64_t lastGeneration = 0;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_workCondition.wait(lock, [&] { return m_quit || m_generation != lastGeneration; });
+
+            if (m_quit)
+            {
+                return;
+            }
+
+            lastGeneration = m_generation;
+        }
+
+        runTask(threadIndex);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_activeWorkers--;
+        }
+        m_doneCondition.notify_one();
+    }
+}
+
+void CpuThreadPool::parallelFor(uint32_t count, uint32_t grainSize, const TaskFunction& task)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    grainSize = bx::max(grainSize, 1u);
+
+    // Not worth waking anyone up for a single chunk.
+    if (m_threads.empty() || count <= grainSize)
+    {
+        task(0, count, 0);
+        return;
+    }
+
+    dispatch(count, grainSize, false, task);
+}
+
+void CpuThreadPool::runOnAllThreads(const TaskFunction& task)
+{
+    if (m_threads.empty())
+    {
+        task(0, 1, 0);
+        return;
+    }
+
+    dispatch(getThreadCount(), 1, true, task);
+}
+
+void CpuThreadPool::dispatch(uint32_t count, uint32_t grainSize, bool runOnAllThreads, const TaskFunction& task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_task = &task;
+        m_taskCount = count;
+        m_grainSize = grainSize;
+        m_runOnAllThreads = runOnAllThreads;
+        m_nextIndex = 0;
+        m_activeWorkers = (uint32_t)m_threads.size();
+        m_generation++;
+    }
+    m_workCondition.notify_all();
+
+    runTask(0);
+
+    // Every worker has to check in, even if the range ran out before it woke up.
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_doneCondition.wait(lock, [&] { return m_activeWorkers == 0; });
+    m_task = nullptr;
+}
@@ -0,0 +1,65 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#ifndef CPU_THREADPOOL_HEADER_GUARD
+#define CPU_THREADPOOL_HEADER_GUARD
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace toyraygun
+{
+    // Persistent worker threads that split an index range between them. The calling
+    // thread takes part in the work as thread 0.
+    class CpuThreadPool
+    {
+    public:
+        typedef std::function<void(uint32_t start, uint32_t end, uint32_t threadIndex)> TaskFunction;
+
+    protected:
+        std::vector<std::thread> m_threads;
+        std::mutex m_mutex;
+        std::condition_variable m_workCondition;
+        std::condition_variable m_doneCondition;
+        bool m_quit;
+        uint64_t m_generation;
+        uint32_t m_activeWorkers;
+
+        // Current task
+        const TaskFunction* m_task;
+        uint32_t m_taskCount;
+        uint32_t m_grainSize;
+        bool m_runOnAllThreads;
+        std::atomic<uint32_t> m_nextIndex;
+
+        void workerLoop(uint32_t threadIndex);
+        void runTask(uint32_t threadIndex);
+        void dispatch(uint32_t count, uint32_t grainSize, bool runOnAllThreads, const TaskFunction& task);
+
+    public:
+        CpuThreadPool();
+        ~CpuThreadPool();
+
+        // Zero threads uses one per hardware thread.
+        void init(uint32_t threadCount = 0);
+        void destroy();
+
+        uint32_t getThreadCount();
+
+        // Calls task over [0, count) in chunks of grainSize and blocks until it is done.
+        void parallelFor(uint32_t count, uint32_t grainSize, const TaskFunction& task);
+
+        // Calls task exactly once on every thread as (threadIndex, threadIndex + 1, threadIndex),
+        // for work that does its own scheduling. Blocks until they all return.
+        void runOnAllThreads(const TaskFunction& task);
+    };
+}
+
+#endif // CPU_THREADPOOL_HEADER_GUARD
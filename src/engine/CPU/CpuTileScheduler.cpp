@@ -0,0 +1,257 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#include "CpuTileScheduler.h"
+using namespace toyraygun;
+
+#include <algorithm>
+#include <chrono>
+#include <bx/math.h>
+
+static inline uint64_t packRange(uint32_t head, uint32_t tail)
+{
+    return (uint64_t(tail) << 32) | head;
+}
+
+static inline uint32_t getHead(uint64_t range)
+{
+    return (uint32_t)(range & 0xffffffff);
+}
+
+static inline uint32_t getTail(uint64_t range)
+{
+    return (uint32_t)(range >> 32);
+}
+
+// Distance along a Hilbert curve covering an n x n grid, n a power of two.
+static uint32_t getHilbertIndex(uint32_t n, uint32_t x, uint32_t y)
+{
+    uint32_t d = 0;
+    for (uint32_t s = n / 2; s > 0; s /= 2)
+    {
+        uint32_t rx = (x & s) > 0 ? 1 : 0;
+        uint32_t ry = (y & s) > 0 ? 1 : 0;
+        d += s * s * ((3 * rx) ^ ry);
+
+        // Rotate the quadrant so the curve stays continuous.
+        if (ry == 0)
+        {
+            if (rx == 1)
+            {
+                x = n - 1 - x;
+                y = n - 1 - y;
+            }
+
+            std::swap(x, y);
+        }
+    }
+
+    return d;
+}
+
+CpuTileScheduler::CpuTileScheduler() :
+    m_width(0),
+    m_height(0),
+    m_tileSize(0),
+    m_queueCount(0)
+{
+
+}
+
+void CpuTileScheduler::init(uint32_t width, uint32_t height, uint32_t tileSize)
+{
+    m_width = width;
+    m_height = height;
+    m_tileSize = bx::max(tileSize, 1u);
+
+    const uint32_t tilesX = (width + m_tileSize - 1) / m_tileSize;
+    const uint32_t tilesY = (height + m_tileSize - 1) / m_tileSize;
+
+    uint32_t curveSize = 1;
+    while (curveSize < tilesX || curveSize < tilesY)
+    {
+        curveSize *= 2;
+    }
+
+    std::vector<std::pair<uint32_t, CpuTile>> orderedTiles;
+    orderedTiles.reserve(tilesX * tilesY);
+
+    for (uint32_t ty = 0; ty < tilesY; ++ty)
+    {
+        for (uint32_t tx = 0; tx < tilesX; ++tx)
+        {
+            CpuTile tile;
+            tile.x0 = tx * m_tileSize;
+            tile.y0 = ty * m_tileSize;
+            tile.x1 = bx::min(tile.x0 + m_tileSize, width);
+            tile.y1 = bx::min(tile.y0 + m_tileSize, height);
+
+            orderedTiles.push_back(std::make_pair(getHilbertIndex(curveSize, tx, ty), tile));
+        }
+    }
+
+    std::sort(orderedTiles.begin(), orderedTiles.end(),
+        [](const std::pair<uint32_t, CpuTile>& a, const std::pair<uint32_t, CpuTile>& b)
+        {
+            return a.first < b.first;
+        });
+
+    m_tiles.resize(orderedTiles.size());
+    for (size_t i = 0; i < orderedTiles.size(); ++i)
+    {
+        m_tiles[i] = orderedTiles[i].second;
+    }
+}
+
+bool CpuTileScheduler::popTile(uint32_t threadIndex, uint32_t& tileIndexOut)
+{
+    std::atomic<uint64_t>& queue = m_queues[threadIndex].range;
+
+    uint64_t range = queue.load();
+    while (getHead(range) < getTail(range))
+    {
+        if (queue.compare_exchange_weak(range, packRange(getHead(range) + 1, getTail(range))))
+        {
+            tileIndexOut = getHead(range);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Takes the back half of the fullest queue. Our own queue is empty at this point so
+// nobody else will be touching it.
+bool CpuTileScheduler::stealTiles(uint32_t threadIndex)
+{
+    while (true)
+    {
+        uint32_t victim = 0;
+        uint32_t mostRemaining = 0;
+        for (uint32_t i = 0; i < m_queueCount; ++i)
+        {
+            uint64_t range = m_queues[i].range.load();
+            uint32_t remaining = getTail(range) - bx::min(getHead(range), getTail(range));
+            if (i != threadIndex && remaining > mostRemaining)
+            {
+                victim = i;
+                mostRemaining = remaining;
+            }
+        }
+
+        if (mostRemaining == 0)
+        {
+            return false;
+        }
+
+        std::atomic<uint64_t>& victimQueue = m_queues[victim].range;
+        uint64_t range = victimQueue.load();
+        uint32_t head = getHead(range);
+        uint32_t tail = getTail(range);
+        if (head >= tail)
+        {
+            continue;
+        }
+
+        uint32_t newTail = tail - ((tail - head + 1) / 2);
+        if (victimQueue.compare_exchange_strong(range, packRange(head, newTail)))
+        {
+            m_queues[threadIndex].range.store(packRange(newTail, tail));
+            return true;
+        }
+    }
+}
+
+void CpuTileScheduler::run(CpuThreadPool& threadPool, const TileFunction& func)
+{
+    const uint32_t threadCount = threadPool.getThreadCount();
+    const uint32_t tileCount = (uint32_t)m_tiles.size();
+
+    if (m_queueCount != threadCount)
+    {
+        m_queues.reset(new WorkQueue[threadCount]);
+        m_queueCount = threadCount;
+    }
+
+    if (m_stats.size() != threadCount)
+    {
+        m_stats.resize(threadCount);
+        resetThreadStats();
+    }
+
+    // Deal contiguous runs of the curve to each thread.
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        uint32_t head = uint32_t((uint64_t(tileCount) * i) / threadCount);
+        uint32_t tail = uint32_t((uint64_t(tileCount) * (i + 1)) / threadCount);
+        m_queues[i].range.store(packRange(head, tail));
+    }
+
+    std::vector<double> frameBusyMs(threadCount, 0.0);
+    auto frameStart = std::chrono::high_resolution_clock::now();
+
+    threadPool.runOnAllThreads([&](uint32_t start, uint32_t end, uint32_t threadIndex)
+    {
+        ThreadStats& stats = m_stats[threadIndex];
+
+        while (true)
+        {
+            uint32_t tileIndex;
+            if (!popTile(threadIndex, tileIndex))
+            {
+                if (!stealTiles(threadIndex))
+                {
+                    break;
+                }
+
+                stats.stealCount++;
+                continue;
+            }
+
+            auto tileStart = std::chrono::high_resolution_clock::now();
+            func(m_tiles[tileIndex], threadIndex);
+            auto tileEnd = std::chrono::high_resolution_clock::now();
+
+            frameBusyMs[threadIndex] += std::chrono::duration<double, std::milli>(tileEnd - tileStart).count();
+            stats.tileCount++;
+        }
+    });
+
+    // Anything a thread wasn't spending on tiles, including waking up, counts as idle.
+    auto frameEnd = std::chrono::high_resolution_clock::now();
+    double frameMs = std::chrono::duration<double, std::milli>(frameEnd - frameStart).count();
+
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        m_stats[i].busyMs += frameBusyMs[i];
+        m_stats[i].idleMs += bx::max(frameMs - frameBusyMs[i], 0.0);
+    }
+}
+
+uint32_t CpuTileScheduler::getTileSize() const
+{
+    return m_tileSize;
+}
+
+uint32_t CpuTileScheduler::getTileCount() const
+{
+    return (uint32_t)m_tiles.size();
+}
+
+const std::vector<CpuTileScheduler::ThreadStats>& CpuTileScheduler::getThreadStats() const
+{
+    return m_stats;
+}
+
+void CpuTileScheduler::resetThreadStats()
+{
+    for (size_t i = 0; i < m_stats.size(); ++i)
+    {
+        m_stats[i].busyMs = 0.0;
+        m_stats[i].idleMs = 0.0;
+        m_stats[i].tileCount = 0;
+        m_stats[i].stealCount = 0;
+    }
+}
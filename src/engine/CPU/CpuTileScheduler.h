@@ -0,0 +1,83 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#ifndef CPU_TILESCHEDULER_HEADER_GUARD
+#define CPU_TILESCHEDULER_HEADER_GUARD
+
+#include "engine/CPU/CpuThreadPool.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace toyraygun
+{
+    // Pixel rectangle [x0, x1) x [y0, y1)
+    struct CpuTile
+    {
+        uint32_t x0;
+        uint32_t y0;
+        uint32_t x1;
+        uint32_t y1;
+    };
+
+    // Splits the screen into tiles along a Hilbert curve and deals each thread a contiguous
+    // run of them, so neighbouring tiles (and their BVH nodes) stay on the same core. A
+    // thread that runs out steals half of what's left from the busiest thread.
+    class CpuTileScheduler
+    {
+    public:
+        typedef std::function<void(const CpuTile& tile, uint32_t threadIndex)> TileFunction;
+
+        struct ThreadStats
+        {
+            double busyMs;
+            double idleMs;
+            uint32_t tileCount;
+            uint32_t stealCount;
+        };
+
+    protected:
+        // Remaining tiles of one thread as [head, tail) packed into one word, the owner
+        // takes from the head and thieves take from the tail.
+        struct WorkQueue
+        {
+            std::atomic<uint64_t> range;
+            uint8_t padding[64 - sizeof(std::atomic<uint64_t>)];
+        };
+
+        uint32_t m_width;
+        uint32_t m_height;
+        uint32_t m_tileSize;
+        std::vector<CpuTile> m_tiles;
+
+        std::unique_ptr<WorkQueue[]> m_queues;
+        uint32_t m_queueCount;
+
+        std::vector<ThreadStats> m_stats;
+
+        bool popTile(uint32_t threadIndex, uint32_t& tileIndexOut);
+        bool stealTiles(uint32_t threadIndex);
+
+    public:
+        CpuTileScheduler();
+
+        void init(uint32_t width, uint32_t height, uint32_t tileSize);
+
+        // Calls func for every tile, blocks until they're all done.
+        void run(CpuThreadPool& threadPool, const TileFunction& func);
+
+        uint32_t getTileSize() const;
+        uint32_t getTileCount() const;
+
+        // Accumulated since the last reset.
+        const std::vector<ThreadStats>& getThreadStats() const;
+        void resetThreadStats();
+    };
+}
+
+#endif // CPU_TILESCHEDULER_HEADER_GUARD
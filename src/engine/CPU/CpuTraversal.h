@@ -0,0 +1,280 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#ifndef CPU_TRAVERSAL_HEADER_GUARD
+#define CPU_TRAVERSAL_HEADER_GUARD
+
+#include "engine/CPU/CpuBVH.h"
+#include "engine/CPU/CpuBVH8.h"
+#include "engine/CPU/CpuRay.h"
+
+#include <algorithm>
+#include <float.h>
+#include <stdint.h>
+#include <vector>
+#include <bx/math.h>
+
+namespace toyraygun
+{
+    // Tree walks shared by both levels of the scene. They only find the leaves a ray
+    // enters, nearest first, and hand them to a leaf function that knows what the
+    // primitives are: triangle blocks in a mesh, instances in the scene.
+
+    // A binary walk pushes at most one node per level, CpuBVH keeps trees within kMaxDepth.
+    static const uint32_t kTraversalStackSize = CpuBVH::kMaxDepth;
+
+    // Each wide node visited replaces its own entry with up to 8. Collapsing never adds
+    // levels, so a BVH8 is no deeper than the binary tree it came from.
+    static const uint32_t kWideTraversalStackSize = 8 * CpuBVH::kMaxDepth;
+
+    // BVH8 traversal puts leaves on the stack too so everything is visited in distance order.
+    struct CpuWideStackEntry
+    {
+        uint32_t child;
+        uint32_t count;
+        float distance;
+    };
+
+    // Inserts the hit children sorted far to near so the nearest is popped first.
+    inline void pushChildren(CpuWideStackEntry* stack, uint32_t& stackSize, const CpuBVH8Node& node, uint32_t mask, const float* distances)
+    {
+        const uint32_t firstEntry = stackSize;
+        while (mask != 0)
+        {
+            uint32_t i = bx::uint32_cnttz(mask);
+            mask &= mask - 1;
+
+            CpuWideStackEntry childEntry = { node.child[i], node.count[i], distances[i] };
+
+            uint32_t j = stackSize++;
+            while (j > firstEntry && stack[j - 1].distance < childEntry.distance)
+            {
+                stack[j] = stack[j - 1];
+                j--;
+            }
+            stack[j] = childEntry;
+        }
+    }
+
+    // Slab test, returns the entry distance or FLT_MAX on a miss.
+    inline float intersectAABB(const CpuBVHNode& node, const CpuRay& ray, const float* invDir, float tMax)
+    {
+        float tx1 = (node.boundsMin[0] - ray.origin.x) * invDir[0];
+        float tx2 = (node.boundsMax[0] - ray.origin.x) * invDir[0];
+        float tNear = bx::min(tx1, tx2);
+        float tFar = bx::max(tx1, tx2);
+
+        float ty1 = (node.boundsMin[1] - ray.origin.y) * invDir[1];
+        float ty2 = (node.boundsMax[1] - ray.origin.y) * invDir[1];
+        tNear = bx::max(tNear, bx::min(ty1, ty2));
+        tFar = bx::min(tFar, bx::max(ty1, ty2));
+
+        float tz1 = (node.boundsMin[2] - ray.origin.z) * invDir[2];
+        float tz2 = (node.boundsMax[2] - ray.origin.z) * invDir[2];
+        tNear = bx::max(tNear, bx::min(tz1, tz2));
+        tFar = bx::min(tFar, bx::max(tz1, tz2));
+
+        if (tFar >= tNear && tFar > ray.tMin && tNear < tMax)
+        {
+            return tNear;
+        }
+
+        return FLT_MAX;
+    }
+
+    // leafFunc(first, count, closestT) tests a leaf's primitives, shortens closestT and
+    // returns true if it found a hit. AnyHit stops at the first leaf that does.
+    template<bool AnyHit, typename LeafFunc>
+    inline bool traverseBVH(const CpuBVH& bvh, const CpuRay& ray, float& closestT, const LeafFunc& leafFunc)
+    {
+        const std::vector<CpuBVHNode>& nodes = bvh.getNodes();
+        if (nodes.empty())
+        {
+            return false;
+        }
+
+        const float invDir[3] = { 1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z };
+
+        if (intersectAABB(nodes[0], ray, invDir, closestT) == FLT_MAX)
+        {
+            return false;
+        }
+
+        bool hit = false;
+
+        // Stack of nodes still to visit along with their entry distance.
+        uint32_t stack[kTraversalStackSize];
+        float stackDistance[kTraversalStackSize];
+        uint32_t stackSize = 0;
+
+        const CpuBVHNode* node = &nodes[0];
+        while (true)
+        {
+            if (node->isLeaf())
+            {
+                if (leafFunc(node->leftOrFirst, node->count, closestT))
+                {
+                    hit = true;
+                    if (AnyHit)
+                    {
+                        return true;
+                    }
+                }
+            }
+            else
+            {
+                const CpuBVHNode* nearNode = &nodes[node->leftOrFirst];
+                const CpuBVHNode* farNode = nearNode + 1;
+
+                float nearDistance = intersectAABB(*nearNode, ray, invDir, closestT);
+                float farDistance = intersectAABB(*farNode, ray, invDir, closestT);
+
+                // Visit the closer child first.
+                if (farDistance < nearDistance)
+                {
+                    std::swap(nearNode, farNode);
+                    std::swap(nearDistance, farDistance);
+                }
+
+                if (nearDistance != FLT_MAX)
+                {
+                    if (farDistance != FLT_MAX)
+                    {
+                        stack[stackSize] = (uint32_t)(farNode - &nodes[0]);
+                        stackDistance[stackSize] = farDistance;
+                        stackSize++;
+                    }
+
+                    node = nearNode;
+                    continue;
+                }
+            }
+
+            // Pop the next node, skipping any that are now further than the closest hit.
+            node = nullptr;
+            while (stackSize > 0)
+            {
+                stackSize--;
+                if (stackDistance[stackSize] < closestT)
+                {
+                    node = &nodes[stack[stackSize]];
+                    break;
+                }
+            }
+
+            if (node == nullptr)
+            {
+                break;
+            }
+        }
+
+        return hit;
+    }
+
+    // Same for the 8 wide tree.
+    template<bool AnyHit, typename LeafFunc>
+    inline bool traverseBVH8(const CpuBVH8& bvh8, const CpuRay& ray, float& closestT, const LeafFunc& leafFunc)
+    {
+        const std::vector<CpuBVH8Node>& nodes = bvh8.getNodes();
+        if (nodes.empty())
+        {
+            return false;
+        }
+
+        const CpuBVH8Ray wideRay(ray.origin, ray.direction, ray.tMin);
+
+        bool hit = false;
+
+        CpuWideStackEntry stack[kWideTraversalStackSize];
+        uint32_t stackSize = 0;
+
+        stack[stackSize++] = { 0, 0, ray.tMin };
+        while (stackSize > 0)
+        {
+            const CpuWideStackEntry entry = stack[--stackSize];
+            if (entry.distance >= closestT)
+            {
+                continue;
+            }
+
+            if (entry.count > 0)
+            {
+                if (leafFunc(entry.child, entry.count, closestT))
+                {
+                    hit = true;
+                    if (AnyHit)
+                    {
+                        return true;
+                    }
+                }
+
+                continue;
+            }
+
+            const CpuBVH8Node& node = nodes[entry.child];
+
+            float distances[8];
+            uint32_t mask = CpuBVH8::intersectChildren(node, wideRay, closestT, distances);
+
+            pushChildren(stack, stackSize, node, mask, distances);
+        }
+
+        return hit;
+    }
+
+    // Walks the tree once for a whole packet. leafFunc(first, count, entryDistance) tests
+    // the rays whose closestT is still beyond entryDistance, the entry distance is a lower
+    // bound for every ray so it can still skip some.
+    template<typename LeafFunc>
+    inline void traversePacketBVH8(const CpuBVH8& bvh8, const CpuBVH8Packet& packet, const float* closestT, uint32_t rayCount, const LeafFunc& leafFunc)
+    {
+        const std::vector<CpuBVH8Node>& nodes = bvh8.getNodes();
+        if (nodes.empty())
+        {
+            return;
+        }
+
+        float packetMaxT = 0.0f;
+        for (uint32_t i = 0; i < rayCount; ++i)
+        {
+            packetMaxT = bx::max(packetMaxT, closestT[i]);
+        }
+
+        CpuWideStackEntry stack[kWideTraversalStackSize];
+        uint32_t stackSize = 0;
+
+        stack[stackSize++] = { 0, 0, packet.tMin };
+        while (stackSize > 0)
+        {
+            const CpuWideStackEntry entry = stack[--stackSize];
+            if (entry.distance >= packetMaxT)
+            {
+                continue;
+            }
+
+            if (entry.count > 0)
+            {
+                leafFunc(entry.child, entry.count, entry.distance);
+
+                packetMaxT = 0.0f;
+                for (uint32_t i = 0; i < rayCount; ++i)
+                {
+                    packetMaxT = bx::max(packetMaxT, closestT[i]);
+                }
+
+                continue;
+            }
+
+            const CpuBVH8Node& node = nodes[entry.child];
+
+            float distances[8];
+            uint32_t mask = CpuBVH8::intersectChildren(node, packet, packetMaxT, distances);
+
+            pushChildren(stack, stackSize, node, mask, distances);
+        }
+    }
+}
+
+#endif // CPU_TRAVERSAL_HEADER_GUARD
@@ -0,0 +1,213 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#ifndef CPU_TRIANGLEBLOCK_HEADER_GUARD
+#define CPU_TRIANGLEBLOCK_HEADER_GUARD
+
+#include "engine/CPU/CpuRay.h"
+
+#include <stdint.h>
+#include <bx/math.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace toyraygun
+{
+    static const uint32_t kTriangleBlockSize = 8;
+
+    // Up to 8 triangles of a BVH leaf stored SoA so a ray can be tested against all of
+    // them at once. Vertices are indexed [axis][slot] and kept exact rather than as edges,
+    // two triangles sharing an edge then compute the same edge function and nothing leaks
+    // through the seam. Unused slots have a zero mask and never report a hit.
+    struct CpuTriangleBlock
+    {
+        float v0[3][8];
+        float v1[3][8];
+        float v2[3][8];
+        uint32_t primitiveIndex[8];
+        uint32_t mask[8];
+    };
+
+    // Per ray setup for the watertight test (Woop, Benthin and Wald 2013). The axis the
+    // ray travels furthest along becomes z and the other two are sheared so the ray
+    // points straight down it, the test is then done in 2D.
+    struct CpuTriangleRay
+    {
+        float origin[3];        // Permuted to kx, ky, kz.
+        uint32_t axis[3];       // kx, ky, kz
+        float shear[3];
+        float tMin;
+        uint32_t mask;
+
+        CpuTriangleRay() {}
+        CpuTriangleRay(const CpuRay& ray) { setup(ray); }
+
+        void setup(const CpuRay& ray);
+    };
+
+    inline void CpuTriangleRay::setup(const CpuRay& ray)
+    {
+        const float rayOrigin[3] = { ray.origin.x, ray.origin.y, ray.origin.z };
+        const float direction[3] = { ray.direction.x, ray.direction.y, ray.direction.z };
+
+        uint32_t kz = 0;
+        if (bx::abs(direction[1]) > bx::abs(direction[kz])) kz = 1;
+        if (bx::abs(direction[2]) > bx::abs(direction[kz])) kz = 2;
+
+        uint32_t kx = (kz + 1) % 3;
+        uint32_t ky = (kx + 1) % 3;
+
+        // Keeps the winding, and with it which side is the front, the same for every ray.
+        if (direction[kz] < 0.0f)
+        {
+            uint32_t swap = kx;
+            kx = ky;
+            ky = swap;
+        }
+
+        axis[0] = kx;
+        axis[1] = ky;
+        axis[2] = kz;
+
+        for (int i = 0; i < 3; ++i)
+        {
+            origin[i] = rayOrigin[axis[i]];
+        }
+
+        shear[0] = direction[kx] / direction[kz];
+        shear[1] = direction[ky] / direction[kz];
+        shear[2] = 1.0f / direction[kz];
+
+        tMin = ray.tMin;
+        mask = ray.mask;
+    }
+
+    // Tests the ray against every triangle in the block, writes the distance and
+    // barycentrics (weights of v1 and v2, as in BuiltInTriangleIntersectionAttributes)
+    // and returns a bit mask of the slots hit between tMin and tMax. Triangles are front
+    // facing when their bx::calcNormal normal points back towards the ray origin.
+    inline uint32_t intersectTriangleBlock(const CpuTriangleBlock& block, const CpuTriangleRay& ray, bool cullBackFaces, float tMax,
+                                           float* tOut, float* uOut, float* vOut)
+    {
+        const uint32_t kx = ray.axis[0];
+        const uint32_t ky = ray.axis[1];
+        const uint32_t kz = ray.axis[2];
+
+#if defined(__AVX2__)
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 originX = _mm256_set1_ps(ray.origin[0]);
+        const __m256 originY = _mm256_set1_ps(ray.origin[1]);
+        const __m256 originZ = _mm256_set1_ps(ray.origin[2]);
+        const __m256 shearX = _mm256_set1_ps(ray.shear[0]);
+        const __m256 shearY = _mm256_set1_ps(ray.shear[1]);
+        const __m256 shearZ = _mm256_set1_ps(ray.shear[2]);
+
+        // Vertices relative to the ray origin, then sheared into ray space.
+        const __m256 p0z = _mm256_sub_ps(_mm256_loadu_ps(block.v0[kz]), originZ);
+        const __m256 p1z = _mm256_sub_ps(_mm256_loadu_ps(block.v1[kz]), originZ);
+        const __m256 p2z = _mm256_sub_ps(_mm256_loadu_ps(block.v2[kz]), originZ);
+
+        const __m256 p0x = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(block.v0[kx]), originX), _mm256_mul_ps(shearX, p0z));
+        const __m256 p0y = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(block.v0[ky]), originY), _mm256_mul_ps(shearY, p0z));
+        const __m256 p1x = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(block.v1[kx]), originX), _mm256_mul_ps(shearX, p1z));
+        const __m256 p1y = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(block.v1[ky]), originY), _mm256_mul_ps(shearY, p1z));
+        const __m256 p2x = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(block.v2[kx]), originX), _mm256_mul_ps(shearX, p2z));
+        const __m256 p2y = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(block.v2[ky]), originY), _mm256_mul_ps(shearY, p2z));
+
+        // Edge functions, the ray passes inside when they all share a sign.
+        const __m256 u = _mm256_sub_ps(_mm256_mul_ps(p2x, p1y), _mm256_mul_ps(p2y, p1x));
+        const __m256 v = _mm256_sub_ps(_mm256_mul_ps(p0x, p2y), _mm256_mul_ps(p0y, p2x));
+        const __m256 w = _mm256_sub_ps(_mm256_mul_ps(p1x, p0y), _mm256_mul_ps(p1y, p0x));
+
+        const __m256 minEdge = _mm256_min_ps(u, _mm256_min_ps(v, w));
+        const __m256 maxEdge = _mm256_max_ps(u, _mm256_max_ps(v, w));
+
+        __m256 valid = _mm256_cmp_ps(minEdge, zero, _CMP_GE_OQ);
+        if (!cullBackFaces)
+        {
+            valid = _mm256_or_ps(valid, _mm256_cmp_ps(maxEdge, zero, _CMP_LE_OQ));
+        }
+
+        const __m256 det = _mm256_add_ps(u, _mm256_add_ps(v, w));
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(det, zero, _CMP_NEQ_OQ));
+
+        // Scaled distance, divided through once we know which lanes are left.
+        const __m256 t = _mm256_mul_ps(shearZ, _mm256_add_ps(_mm256_mul_ps(u, p0z), _mm256_add_ps(_mm256_mul_ps(v, p1z), _mm256_mul_ps(w, p2z))));
+        const __m256 invDet = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+        const __m256 distance = _mm256_mul_ps(t, invDet);
+
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(distance, _mm256_set1_ps(ray.tMin), _CMP_GT_OQ));
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(distance, _mm256_set1_ps(tMax), _CMP_LT_OQ));
+
+        const __m256i maskHit = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)block.mask), _mm256_set1_epi32((int)ray.mask));
+        valid = _mm256_andnot_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(maskHit, _mm256_setzero_si256())), valid);
+
+        const uint32_t hitMask = (uint32_t)_mm256_movemask_ps(valid);
+        if (hitMask != 0)
+        {
+            _mm256_storeu_ps(tOut, distance);
+            _mm256_storeu_ps(uOut, _mm256_mul_ps(v, invDet));
+            _mm256_storeu_ps(vOut, _mm256_mul_ps(w, invDet));
+        }
+
+        return hitMask;
+#else
+        uint32_t hitMask = 0;
+        for (uint32_t i = 0; i < 8; ++i)
+        {
+            if ((block.mask[i] & ray.mask) == 0)
+            {
+                continue;
+            }
+
+            const float p0z = block.v0[kz][i] - ray.origin[2];
+            const float p1z = block.v1[kz][i] - ray.origin[2];
+            const float p2z = block.v2[kz][i] - ray.origin[2];
+
+            const float p0x = (block.v0[kx][i] - ray.origin[0]) - (ray.shear[0] * p0z);
+            const float p0y = (block.v0[ky][i] - ray.origin[1]) - (ray.shear[1] * p0z);
+            const float p1x = (block.v1[kx][i] - ray.origin[0]) - (ray.shear[0] * p1z);
+            const float p1y = (block.v1[ky][i] - ray.origin[1]) - (ray.shear[1] * p1z);
+            const float p2x = (block.v2[kx][i] - ray.origin[0]) - (ray.shear[0] * p2z);
+            const float p2y = (block.v2[ky][i] - ray.origin[1]) - (ray.shear[1] * p2z);
+
+            const float u = (p2x * p1y) - (p2y * p1x);
+            const float v = (p0x * p2y) - (p0y * p2x);
+            const float w = (p1x * p0y) - (p1y * p0x);
+
+            const bool frontFacing = (u >= 0.0f && v >= 0.0f && w >= 0.0f);
+            const bool backFacing = (u <= 0.0f && v <= 0.0f && w <= 0.0f);
+            if (!frontFacing && (cullBackFaces || !backFacing))
+            {
+                continue;
+            }
+
+            const float det = u + (v + w);
+            if (det == 0.0f)
+            {
+                continue;
+            }
+
+            const float invDet = 1.0f / det;
+            const float distance = (ray.shear[2] * ((u * p0z) + ((v * p1z) + (w * p2z)))) * invDet;
+            if (!(distance > ray.tMin && distance < tMax))
+            {
+                continue;
+            }
+
+            tOut[i] = distance;
+            uOut[i] = v * invDet;
+            vOut[i] = w * invDet;
+            hitMask |= 1u << i;
+        }
+
+        return hitMask;
+#endif
+    }
+}
+
+#endif // CPU_TRIANGLEBLOCK_HEADER_GUARD
@@ -0,0 +1,50 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#ifndef CPU_UNIFORMS_HEADER_GUARD
+#define CPU_UNIFORMS_HEADER_GUARD
+
+#include "engine/Engine.h"
+
+#include <string.h>
+#include <bx/math.h>
+
+namespace toyraygun
+{
+    // Used on platforms without a GPU backend, so there is no shader side layout to match.
+    struct UniformFloat3
+    {
+        float data[3];
+
+        bx::Vec3 get()
+        {
+            return bx::Vec3(data[0], data[1], data[2]);
+        }
+
+        void set(bx::Vec3 value)
+        {
+            data[0] = value.x;
+            data[1] = value.y;
+            data[2] = value.z;
+        }
+    };
+
+    struct UniformFloat4x4
+    {
+        float data[16]; // Same layout as bx
+
+        void get(float* _mtxOut)
+        {
+            memcpy(_mtxOut, data, sizeof(data));
+        }
+
+        void set(float* _mtxIn)
+        {
+            memcpy(data, _mtxIn, sizeof(data));
+        }
+    };
+}
+
+#endif // CPU_UNIFORMS_HEADER_GUARD
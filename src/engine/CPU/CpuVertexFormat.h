@@ -0,0 +1,111 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#ifndef CPU_VERTEXFORMAT_HEADER_GUARD
+#define CPU_VERTEXFORMAT_HEADER_GUARD
+
+#include <stdint.h>
+#include <math.h>
+#include <string.h>
+#include <bx/math.h>
+
+namespace toyraygun
+{
+    // Shading attributes of one vertex in 8 bytes instead of 24, so a hit's three
+    // vertices are usually a single cache line.
+    struct CpuVertexAttributes
+    {
+        uint32_t normal;    // Octahedral, 16 bits per axis.
+        uint32_t color;     // RGB9E5
+    };
+
+    // Folds the unit sphere onto an octahedron and that onto a square, each half of the
+    // word holds one coordinate of the square as a snorm16, good to a few thousandths of
+    // a degree.
+    inline uint32_t encodeOctahedral(const bx::Vec3& normal)
+    {
+        float invLength = 1.0f / (bx::abs(normal.x) + bx::abs(normal.y) + bx::abs(normal.z));
+        float x = normal.x * invLength;
+        float y = normal.y * invLength;
+
+        if (normal.z < 0.0f)
+        {
+            float foldedX = (1.0f - bx::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+            float foldedY = (1.0f - bx::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+            x = foldedX;
+            y = foldedY;
+        }
+
+        int32_t qx = (int32_t)bx::round(bx::clamp(x, -1.0f, 1.0f) * 32767.0f);
+        int32_t qy = (int32_t)bx::round(bx::clamp(y, -1.0f, 1.0f) * 32767.0f);
+        return (uint32_t(uint16_t(qx))) | (uint32_t(uint16_t(qy)) << 16);
+    }
+
+    // Points the right way but isn't unit length, for callers that normalize later anyway.
+    inline bx::Vec3 decodeOctahedralDirection(uint32_t encoded)
+    {
+        float x = float(int16_t(encoded & 0xffff)) * (1.0f / 32767.0f);
+        float y = float(int16_t(encoded >> 16)) * (1.0f / 32767.0f);
+        float z = 1.0f - bx::abs(x) - bx::abs(y);
+
+        // Unfold the lower half.
+        float t = bx::max(-z, 0.0f);
+        x += (x >= 0.0f) ? -t : t;
+        y += (y >= 0.0f) ? -t : t;
+
+        return bx::Vec3(x, y, z);
+    }
+
+    inline bx::Vec3 decodeOctahedral(uint32_t encoded)
+    {
+        return bx::normalize(decodeOctahedralDirection(encoded));
+    }
+
+    // Shared exponent color as in EXT_texture_shared_exponent: 9 bit mantissas and one 5
+    // bit exponent. Keeps about 3 significant digits and goes well past 1 for emitters.
+    inline uint32_t encodeRGB9E5(const bx::Vec3& color)
+    {
+        const float kMaxValue = 65408.0f;   // (511 / 512) * 2^16
+
+        float r = bx::clamp(color.x, 0.0f, kMaxValue);
+        float g = bx::clamp(color.y, 0.0f, kMaxValue);
+        float b = bx::clamp(color.z, 0.0f, kMaxValue);
+        float maxChannel = bx::max(r, g, b);
+
+        int32_t exponent = 0;
+        if (maxChannel > 0.0f)
+        {
+            exponent = bx::max(-16, (int32_t)floorf(log2f(maxChannel))) + 1 + 15;
+        }
+
+        float scale = ldexpf(1.0f, 9 - (exponent - 15));
+
+        // Rounding can push the largest channel up to 512, which needs the next exponent.
+        if ((int32_t)floorf(maxChannel * scale + 0.5f) == 512)
+        {
+            scale *= 0.5f;
+            exponent++;
+        }
+
+        uint32_t mr = (uint32_t)floorf(r * scale + 0.5f);
+        uint32_t mg = (uint32_t)floorf(g * scale + 0.5f);
+        uint32_t mb = (uint32_t)floorf(b * scale + 0.5f);
+        return mr | (mg << 9) | (mb << 18) | (uint32_t(exponent) << 27);
+    }
+
+    inline bx::Vec3 decodeRGB9E5(uint32_t encoded)
+    {
+        // 2^(exponent - 15 - 9) built directly, it's always a normal float.
+        uint32_t scaleBits = ((encoded >> 27) + 127 - 15 - 9) << 23;
+        float scale;
+        memcpy(&scale, &scaleBits, sizeof(float));
+
+        return bx::Vec3(float(encoded & 0x1ff) * scale,
+                        float((encoded >> 9) & 0x1ff) * scale,
+                        float((encoded >> 18) & 0x1ff) * scale);
+    }
+}
+
+#endif // CPU_VERTEXFORMAT_HEADER_GUARD
@@ -0,0 +1,359 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#include "CpuWavefront.h"
+using namespace toyraygun;
+
+#include "engine/Renderer.h"
+
+// Camera rays are generated in 8x8 pixel blocks, like the threadgroups in MetalRenderer,
+// so the first bounce can be traced as packets.
+static const uint32_t kBlockWidth = 8;
+static const uint32_t kBlockSize = kBlockWidth * kBlockWidth;
+
+// Blocks in flight at once, bounds the queue memory regardless of resolution.
+static const uint32_t kWaveBlockCount = 4096;
+
+static const uint32_t kCompactChunkSize = 4096;
+
+// Stable stream compaction, copies the items that are kept to the front of out.
+template<typename T>
+uint32_t CpuWavefront::compact(CpuThreadPool& threadPool, const std::vector<T>& in, const std::vector<uint8_t>& keep, uint32_t count, std::vector<T>& out)
+{
+    const uint32_t chunkCount = (count + kCompactChunkSize - 1) / kCompactChunkSize;
+    m_chunkOffsets.assign(chunkCount + 1, 0);
+
+    // Count what survives in each chunk...
+    threadPool.parallelFor(chunkCount, 1, [&](uint32_t start, uint32_t end, uint32_t threadIndex)
+    {
+        for (uint32_t chunk = start; chunk < end; ++chunk)
+        {
+            uint32_t first = chunk * kCompactChunkSize;
+            uint32_t last = bx::min(first + kCompactChunkSize, count);
+
+            uint32_t survivors = 0;
+            for (uint32_t i = first; i < last; ++i)
+            {
+                survivors += keep[i];
+            }
+
+            m_chunkOffsets[chunk + 1] = survivors;
+        }
+    });
+
+    // ...turn the counts into output offsets...
+    for (uint32_t chunk = 0; chunk < chunkCount; ++chunk)
+    {
+        m_chunkOffsets[chunk + 1] += m_chunkOffsets[chunk];
+    }
+
+    // ...then copy in order.
+    threadPool.parallelFor(chunkCount, 1, [&](uint32_t start, uint32_t end, uint32_t threadIndex)
+    {
+        for (uint32_t chunk = start; chunk < end; ++chunk)
+        {
+            uint32_t first = chunk * kCompactChunkSize;
+            uint32_t last = bx::min(first + kCompactChunkSize, count);
+
+            uint32_t offset = m_chunkOffsets[chunk];
+            for (uint32_t i = first; i < last; ++i)
+            {
+                if (keep[i] != 0)
+                {
+                    out[offset++] = in[i];
+                }
+            }
+        }
+    });
+
+    return m_chunkOffsets[chunkCount];
+}
+
+uint64_t CpuWavefront::render(CpuThreadPool& threadPool, const CpuScene& scene, const CpuUniforms& uniforms, const CpuSampler& sampler,
+                              const uint32_t* randomValues, bool usePackets, float* output)
+{
+    const uint32_t blocksX = (uniforms.width + kBlockWidth - 1) / kBlockWidth;
+    const uint32_t blocksY = (uniforms.height + kBlockWidth - 1) / kBlockWidth;
+    const uint32_t blockCount = blocksX * blocksY;
+
+    const size_t queueSize = size_t(bx::min(blockCount, kWaveBlockCount)) * kBlockSize;
+    if (m_paths.size() < queueSize)
+    {
+        m_paths.resize(queueSize);
+        m_nextPaths.resize(queueSize);
+        m_hits.resize(queueSize);
+        m_hitFound.resize(queueSize);
+        m_pathAlive.resize(queueSize);
+        m_shadowRays.resize(queueSize);
+        m_shadowQueue.resize(queueSize);
+        m_shadowValid.resize(queueSize);
+    }
+
+    uint64_t rayCount = 0;
+    for (uint32_t firstBlock = 0; firstBlock < blockCount; firstBlock += kWaveBlockCount)
+    {
+        uint32_t pathCount = 0;
+        generateRays(threadPool, uniforms, sampler, randomValues, firstBlock, bx::min(kWaveBlockCount, blockCount - firstBlock), pathCount, output);
+
+        for (uint32_t bounce = 0; bounce < uniforms.maxBounces && pathCount > 0; ++bounce)
+        {
+            intersect(threadPool, scene, pathCount, usePackets && bounce == 0);
+            rayCount += pathCount;
+
+            shade(threadPool, scene, uniforms, sampler, randomValues, pathCount, bounce, output);
+
+            // Drop terminated paths and the shadow rays that weren't needed.
+            uint32_t shadowCount = compact(threadPool, m_shadowRays, m_shadowValid, pathCount, m_shadowQueue);
+            pathCount = compact(threadPool, m_nextPaths, m_pathAlive, pathCount, m_paths);
+
+            intersectShadows(threadPool, scene, shadowCount, output);
+            rayCount += shadowCount;
+        }
+    }
+
+    return rayCount;
+}
+
+void CpuWavefront::destroy()
+{
+    m_paths.clear();
+    m_nextPaths.clear();
+    m_hits.clear();
+    m_hitFound.clear();
+    m_pathAlive.clear();
+    m_shadowRays.clear();
+    m_shadowQueue.clear();
+    m_shadowValid.clear();
+    m_chunkOffsets.clear();
+}
+
+// Same as raygen() in Raytracing.metal
+void CpuWavefront::generateRays(CpuThreadPool& threadPool, const CpuUniforms& uniforms, const CpuSampler& sampler, const uint32_t* randomValues,
+                                uint32_t firstBlock, uint32_t blockCount, uint32_t& pathCountOut, float* output)
+{
+    const uint32_t blocksX = (uniforms.width + kBlockWidth - 1) / kBlockWidth;
+
+    threadPool.parallelFor(blockCount, 16, [&](uint32_t start, uint32_t end, uint32_t threadIndex)
+    {
+        for (uint32_t block = start; block < end; ++block)
+        {
+            uint32_t x0 = ((firstBlock + block) % blocksX) * kBlockWidth;
+            uint32_t y0 = ((firstBlock + block) / blocksX) * kBlockWidth;
+
+            for (uint32_t i = 0; i < kBlockSize; ++i)
+            {
+                uint32_t x = x0 + (i % kBlockWidth);
+                uint32_t y = y0 + (i / kBlockWidth);
+                uint32_t slot = block * kBlockSize + i;
+
+                // Blocks on the right and bottom edges can be partly off screen.
+                m_pathAlive[slot] = (x < uniforms.width && y < uniforms.height) ? 1 : 0;
+                if (m_pathAlive[slot] == 0)
+                {
+                    continue;
+                }
+
+                uint32_t pixelIndex = y * uniforms.width + x;
+                uint32_t pixelSeed = randomValues[pixelIndex];
+
+                CpuPath& path = m_nextPaths[slot];
+                path.ray = generateCameraRay(uniforms,
+                                             sampler.get(x, y, pixelSeed, uniforms.frameIndex, 0),
+                                             sampler.get(x, y, pixelSeed, uniforms.frameIndex, 1),
+                                             x, y);
+                path.throughput = bx::Vec3(1.0f, 1.0f, 1.0f);
+                path.bouncePdf = 0.0f;
+                path.pixelIndex = pixelIndex;
+
+                // Clear the destination image to black
+                float* pixel = &output[pixelIndex * 4];
+                pixel[0] = 0.0f;
+                pixel[1] = 0.0f;
+                pixel[2] = 0.0f;
+                pixel[3] = 1.0f;
+            }
+        }
+    });
+
+    pathCountOut = compact(threadPool, m_nextPaths, m_pathAlive, blockCount * kBlockSize, m_paths);
+}
+
+void CpuWavefront::intersect(CpuThreadPool& threadPool, const CpuScene& scene, uint32_t pathCount, bool usePackets)
+{
+    if (usePackets)
+    {
+        // Consecutive camera rays come from the same or neighbouring blocks.
+        const uint32_t packetCount = (pathCount + kBlockSize - 1) / kBlockSize;
+
+        threadPool.parallelFor(packetCount, 4, [&](uint32_t start, uint32_t end, uint32_t threadIndex)
+        {
+            CpuRay rays[kBlockSize];
+            bool hitFound[kBlockSize];
+
+            for (uint32_t packet = start; packet < end; ++packet)
+            {
+                uint32_t first = packet * kBlockSize;
+                uint32_t rayCount = bx::min(kBlockSize, pathCount - first);
+
+                for (uint32_t i = 0; i < rayCount; ++i)
+                {
+                    rays[i] = m_paths[first + i].ray;
+                }
+
+                scene.intersectPacket(rays, rayCount, CPU_RAY_FLAG_CULL_BACK_FACING_TRIANGLES, &m_hits[first], hitFound);
+
+                for (uint32_t i = 0; i < rayCount; ++i)
+                {
+                    m_hitFound[first + i] = hitFound[i] ? 1 : 0;
+                }
+            }
+        });
+
+        return;
+    }
+
+    threadPool.parallelFor(pathCount, 256, [&](uint32_t start, uint32_t end, uint32_t threadIndex)
+    {
+        for (uint32_t i = start; i < end; ++i)
+        {
+            m_hitFound[i] = scene.intersect(m_paths[i].ray, CPU_RAY_FLAG_CULL_BACK_FACING_TRIANGLES, m_hits[i]) ? 1 : 0;
+        }
+    });
+}
+
+// Same as primaryHit() in Raytracing.hlsl, with the recursion turned into a throughput
+// carried along the path. Writes the next path segment and a shadow ray for each hit.
+void CpuWavefront::shade(CpuThreadPool& threadPool, const CpuScene& scene, const CpuUniforms& uniforms, const CpuSampler& sampler, const uint32_t* randomValues,
+                         uint32_t pathCount, uint32_t bounce, float* output)
+{
+    // Recursion depth of these hits in the HLSL version.
+    const uint32_t recursionDepth = bounce + 1;
+
+    threadPool.parallelFor(pathCount, 256, [&](uint32_t start, uint32_t end, uint32_t threadIndex)
+    {
+        for (uint32_t i = start; i < end; ++i)
+        {
+            const CpuPath& path = m_paths[i];
+
+            m_pathAlive[i] = 0;
+            m_shadowValid[i] = 0;
+
+            // Miss
+            if (m_hitFound[i] == 0)
+            {
+                continue;
+            }
+
+            const CpuHit& hit = m_hits[i];
+            float* pixel = &output[path.pixelIndex * 4];
+
+            uint32_t materialID = scene.getMaterialID(hit);
+
+            // Default
+            if (materialID == MATERIAL_DEFAULT)
+            {
+                // Shadow rays from the last bounce count as shadowed and the bounce
+                // after it returns black, so the path ends here.
+                if (recursionDepth >= uniforms.maxBounces)
+                {
+                    continue;
+                }
+
+                bx::Vec3 hitPosition = bx::mad(path.ray.direction, hit.t, path.ray.origin);
+                bx::Vec3 vertexNormal = scene.getNormal(hit);
+                bx::Vec3 throughput = bx::mul(path.throughput, scene.getColor(hit));
+
+                // Pixels draw their own samples from the sampler to decorrelate them
+                const uint32_t pixelSeed = randomValues[path.pixelIndex];
+                const uint32_t x = path.pixelIndex % uniforms.width;
+                const uint32_t y = path.pixelIndex / uniforms.width;
+                auto sample = [&](CpuBounceDimension dimension)
+                {
+                    return sampler.get(x, y, pixelSeed, uniforms.frameIndex, getBounceDimension(recursionDepth, dimension));
+                };
+
+                CpuLightSample light;
+                if (scene.sampleLight(sample(CPU_DIMENSION_LIGHT_SELECT),
+                                      sample(CPU_DIMENSION_LIGHT_U),
+                                      sample(CPU_DIMENSION_LIGHT_V),
+                                      hitPosition,
+                                      vertexNormal,
+                                      light))
+                {
+                    CpuShadowRay& shadowRay = m_shadowRays[i];
+                    shadowRay.ray.origin = hitPosition;
+                    shadowRay.ray.direction = light.direction;
+                    shadowRay.ray.tMin = 0.001f;
+                    shadowRay.ray.tMax = light.distance - 0.001f;
+                    shadowRay.ray.mask = CPU_RAY_MASK_SHADOW;
+                    shadowRay.color = bx::mul(getDirectLighting(light, vertexNormal), throughput);
+                    shadowRay.pixelIndex = path.pixelIndex;
+                    m_shadowValid[i] = 1;
+                }
+
+                if (!continuePath(uniforms, recursionDepth, sample(CPU_DIMENSION_ROULETTE), throughput))
+                {
+                    continue;
+                }
+
+                float r0 = sample(CPU_DIMENSION_BOUNCE_U);
+                float r1 = sample(CPU_DIMENSION_BOUNCE_V);
+
+                bx::Vec3 sampleDirection = sampleCosineWeightedHemisphere(r0, r1);
+                float bouncePdf = cosineHemispherePdf(sampleDirection.y);
+                sampleDirection = alignHemisphereWithNormal(sampleDirection, vertexNormal);
+
+                CpuPath& nextPath = m_nextPaths[i];
+                nextPath.ray.origin = hitPosition;
+                nextPath.ray.direction = bx::normalize(sampleDirection);
+                nextPath.ray.tMin = 0.001f;
+                nextPath.ray.tMax = 10000.0f;
+                nextPath.ray.mask = CPU_RAY_MASK_ALL;
+                nextPath.throughput = throughput;
+                nextPath.bouncePdf = bouncePdf;
+                nextPath.pixelIndex = path.pixelIndex;
+                m_pathAlive[i] = 1;
+                continue;
+            }
+
+            // Emissive takes the light's color from the vertex color, magenta for an unknown material.
+            bx::Vec3 color = (materialID == MATERIAL_EMISSIVE) ? scene.getColor(hit) : bx::Vec3(1.0f, 0.0f, 1.0f);
+            color = bx::mul(color, path.throughput);
+
+            // Lights found by a bounce share them with the light samples, as in CpuRenderer.
+            if (materialID == MATERIAL_EMISSIVE && path.bouncePdf > 0.0f)
+            {
+                color = bx::mul(color, powerHeuristic(path.bouncePdf, scene.getLightPdf(path.ray, hit)));
+            }
+
+            pixel[0] += color.x;
+            pixel[1] += color.y;
+            pixel[2] += color.z;
+        }
+    });
+}
+
+// Same as shadowHit() in Raytracing.metal, an any hit query that ignores the lights.
+void CpuWavefront::intersectShadows(CpuThreadPool& threadPool, const CpuScene& scene, uint32_t shadowCount, float* output)
+{
+    threadPool.parallelFor(shadowCount, 256, [&](uint32_t start, uint32_t end, uint32_t threadIndex)
+    {
+        for (uint32_t i = start; i < end; ++i)
+        {
+            const CpuShadowRay& shadowRay = m_shadowQueue[i];
+
+            if (scene.occluded(shadowRay.ray, CPU_RAY_FLAG_NONE))
+            {
+                continue;
+            }
+
+            // Each pixel has at most one shadow ray per bounce so there's no race here.
+            float* pixel = &output[shadowRay.pixelIndex * 4];
+            pixel[0] += shadowRay.color.x;
+            pixel[1] += shadowRay.color.y;
+            pixel[2] += shadowRay.color.z;
+        }
+    });
+}
@@ -0,0 +1,89 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#ifndef CPU_WAVEFRONT_HEADER_GUARD
+#define CPU_WAVEFRONT_HEADER_GUARD
+
+#include "engine/CPU/CpuCommon.h"
+#include "engine/CPU/CpuRay.h"
+#include "engine/CPU/CpuSampler.h"
+#include "engine/CPU/CpuScene.h"
+#include "engine/CPU/CpuThreadPool.h"
+
+#include <stdint.h>
+#include <vector>
+#include <bx/math.h>
+
+namespace toyraygun
+{
+    // A path that is still bouncing, the CPU version of Ray in Raytracing.metal.
+    struct CpuPath
+    {
+        CpuRay ray;
+        bx::Vec3 throughput;
+        float bouncePdf;  // Of the bounce the ray came from, zero for camera rays.
+        uint32_t pixelIndex;
+
+        CpuPath() :
+            throughput(bx::init::Zero),
+            bouncePdf(0.0f),
+            pixelIndex(0)
+        {
+
+        }
+    };
+
+    struct CpuShadowRay
+    {
+        CpuRay ray;
+        bx::Vec3 color;
+        uint32_t pixelIndex;
+
+        CpuShadowRay() :
+            color(bx::init::Zero),
+            pixelIndex(0)
+        {
+
+        }
+    };
+
+    // Stage by stage integrator laid out like MetalRenderer: generate rays, then for each
+    // bounce intersect, shade, intersect shadow rays and add their light. Every stage runs
+    // over flat queues and finished paths are compacted out between bounces, so each stage
+    // is a tight loop over live rays instead of a recursion per pixel.
+    // Produces the same image as the per pixel integrator in CpuRenderer.
+    class CpuWavefront
+    {
+    protected:
+        // Queues
+        std::vector<CpuPath> m_paths;
+        std::vector<CpuPath> m_nextPaths;
+        std::vector<CpuHit> m_hits;
+        std::vector<uint8_t> m_hitFound;
+        std::vector<uint8_t> m_pathAlive;
+        std::vector<CpuShadowRay> m_shadowRays;
+        std::vector<CpuShadowRay> m_shadowQueue;
+        std::vector<uint8_t> m_shadowValid;
+        std::vector<uint32_t> m_chunkOffsets;
+
+        void generateRays(CpuThreadPool& threadPool, const CpuUniforms& uniforms, const CpuSampler& sampler, const uint32_t* randomValues,
+                          uint32_t firstBlock, uint32_t blockCount, uint32_t& pathCountOut, float* output);
+        void intersect(CpuThreadPool& threadPool, const CpuScene& scene, uint32_t pathCount, bool usePackets);
+        void shade(CpuThreadPool& threadPool, const CpuScene& scene, const CpuUniforms& uniforms, const CpuSampler& sampler, const uint32_t* randomValues,
+                   uint32_t pathCount, uint32_t bounce, float* output);
+        void intersectShadows(CpuThreadPool& threadPool, const CpuScene& scene, uint32_t shadowCount, float* output);
+
+        template<typename T>
+        uint32_t compact(CpuThreadPool& threadPool, const std::vector<T>& in, const std::vector<uint8_t>& keep, uint32_t count, std::vector<T>& out);
+
+    public:
+        // Traces one sample for every pixel into output (RGBA), returns the number of rays traced.
+        uint64_t render(CpuThreadPool& threadPool, const CpuScene& scene, const CpuUniforms& uniforms, const CpuSampler& sampler,
+                        const uint32_t* randomValues, bool usePackets, float* output);
+        void destroy();
+    };
+}
+
+#endif // CPU_WAVEFRONT_HEADER_GUARD
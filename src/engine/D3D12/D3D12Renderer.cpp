@@ -11,6 +11,7 @@
 #include "D3D12Utilities.h"
 #include "engine/Engine.h"
 #include "engine/Texture.h"
+#include "engine/CPU/CpuThreadPool.h"
 
 #include <bx/math.h>
 
@@ -19,7 +20,12 @@ using namespace DirectX;
 const wchar_t* D3D12Renderer::kPrimaryHitGroupName = L"PrimaryHitGroup";
 const wchar_t* D3D12Renderer::kShadowHitGroupName = L"ShadowHitGroup";
 
-D3D12Renderer::D3D12Renderer()
+D3D12Renderer::D3D12Renderer() :
+    m_indexFormat(toyraygun::GpuIndexFormat::UInt16),
+    m_indexCount(0),
+    m_vertexCount(0),
+    m_lightFirstTriangle(0),
+    m_lightTriangleCount(0)
 {
 
 }
@@ -61,6 +67,7 @@ void D3D12Renderer::updateUniforms()
     auto bufferIndex = m_device->GetCurrentBackBufferIndex();
 
     m_sceneCB[bufferIndex].frameIndex = m_frameIndex;
+    m_sceneCB[bufferIndex].indexSize = (m_indexFormat == toyraygun::GpuIndexFormat::UInt16) ? 2 : 4;
     m_sceneCB[bufferIndex].width = m_width;
     m_sceneCB[bufferIndex].height = m_height;
 
@@ -70,11 +77,13 @@ void D3D12Renderer::updateUniforms()
     bx::mtxInverse(invViewProjMtx, m_viewProjMtx);
     m_sceneCB[bufferIndex].camera.invViewProjMtx.set(invViewProjMtx);
 
-    m_sceneCB[bufferIndex].light.position.set(bx::Vec3(0.0f, 1.98f, 0.0f));
-    m_sceneCB[bufferIndex].light.forward.set(bx::Vec3(0.0f, -1.0f, 0.0f));
-    m_sceneCB[bufferIndex].light.right.set(bx::Vec3(0.25f, 0.0f, 0.0f));
-    m_sceneCB[bufferIndex].light.up.set(bx::Vec3(0.0f, 0.0f, 0.25f));
-    m_sceneCB[bufferIndex].light.color.set(bx::Vec3(1.0f, 1.0f, 1.0f));
+    m_sceneCB[bufferIndex].light.position.set(m_light.position);
+    m_sceneCB[bufferIndex].light.forward.set(m_light.normal);
+    m_sceneCB[bufferIndex].light.right.set(m_light.edge0);
+    m_sceneCB[bufferIndex].light.up.set(m_light.edge1);
+    m_sceneCB[bufferIndex].light.color.set(m_light.color);
+    m_sceneCB[bufferIndex].lightFirstTriangle = m_lightFirstTriangle;
+    m_sceneCB[bufferIndex].lightTriangleCount = m_lightTriangleCount;
 }
 
 // Initialize scene rendering parameters.
@@ -82,6 +91,15 @@ void D3D12Renderer::loadScene(toyraygun::Scene* scene)
 {
     auto bufferIndex = m_device->GetCurrentBackBufferIndex();
 
+    // No area light leaves the light black.
+    scene->buildLights();
+    m_lightFirstTriangle = 0;
+    m_lightTriangleCount = 0;
+    if (scene->getBrightestAreaLight(m_light))
+    {
+        scene->getBakedTriangles(m_light.instanceIndex, m_lightFirstTriangle, m_lightTriangleCount);
+    }
+
     // Setup uniforms.
     updateUniforms();
 
@@ -250,35 +268,41 @@ void D3D12Renderer::BuildGeometry(toyraygun::Scene* scene)
 {
     auto device = m_device->GetD3DDevice();
 
-    std::vector<Index> indices;
-    for (int i = 0; i < scene->m_indexBuffer.size(); ++i)
-    {
-        indices.push_back(scene->m_indexBuffer[i]);
-    }
-
-    std::vector<Vertex> vertices;
-    for (int i = 0; i < scene->m_vertexBuffer.size(); ++i)
-    {
-        vertices.push_back({ 
-            XMFLOAT3(scene->m_vertexBuffer[i].x, scene->m_vertexBuffer[i].y, scene->m_vertexBuffer[i].z),
-            XMFLOAT3(scene->m_normalBuffer[i].x, scene->m_normalBuffer[i].y, scene->m_normalBuffer[i].z),
-            XMFLOAT3(scene->m_colorBuffer[i].x, scene->m_colorBuffer[i].y, scene->m_colorBuffer[i].z),
-        });
-    }
-
-    std::vector<uint32_t> materialIDs;
-    for (int i = 0; i < scene->m_materialIDBuffer.size(); ++i)
-    {
-        materialIDs.push_back(scene->m_materialIDBuffer[i]);
-    }
-
-    AllocateUploadBuffer(device, &indices[0], sizeof(Index) * indices.size(), &m_indexBuffer.resource);
-    AllocateUploadBuffer(device, &vertices[0], sizeof(Vertex) * vertices.size(), &m_vertexBuffer.resource);
-    AllocateUploadBuffer(device, &materialIDs[0], sizeof(uint32_t) * materialIDs.size(), &m_materialIDBuffer.resource);
-
-    CreateBufferSRV(&m_indexBuffer, indices.size() / sizeof(Index), 0);
-    CreateBufferSRV(&m_vertexBuffer, vertices.size(), sizeof(Vertex));
-    CreateBufferSRV(&m_materialIDBuffer, materialIDs.size(), sizeof(uint32_t));
+    // Still a single BLAS, every instance is baked into world space.
+    toyraygun::CpuThreadPool threadPool;
+    threadPool.init();
+    scene->bakeInstances(&threadPool);
+
+    toyraygun::GpuGeometryPacker packer;
+    packer.init(scene);
+    m_indexFormat = packer.getIndexFormat();
+    m_indexCount = packer.getIndexCount();
+    m_vertexCount = packer.getVertexCount();
+
+    // Same layout as Vertex in Raytracing.hlsl.
+    const toyraygun::GpuVertexLayout vertexLayout = { sizeof(Vertex), offsetof(Vertex, position), offsetof(Vertex, normal), offsetof(Vertex, color) };
+
+    // Packed straight into the upload heap.
+    void* mappedData;
+    CreateUploadBuffer(device, packer.getIndexDataSize(), &m_indexBuffer.resource);
+    m_indexBuffer.resource->Map(0, nullptr, &mappedData);
+    packer.packIndices(mappedData);
+    m_indexBuffer.resource->Unmap(0, nullptr);
+
+    CreateUploadBuffer(device, packer.getVertexDataSize(vertexLayout), &m_vertexBuffer.resource);
+    m_vertexBuffer.resource->Map(0, nullptr, &mappedData);
+    packer.packVertices(vertexLayout, mappedData);
+    m_vertexBuffer.resource->Unmap(0, nullptr);
+
+    CreateUploadBuffer(device, packer.getMaterialIDDataSize(), &m_materialIDBuffer.resource);
+    m_materialIDBuffer.resource->Map(0, nullptr, &mappedData);
+    packer.packMaterialIDs(mappedData);
+    m_materialIDBuffer.resource->Unmap(0, nullptr);
+
+    // Indices are read as a raw buffer of 32 bit words.
+    CreateBufferSRV(&m_indexBuffer, static_cast<UINT>(packer.getIndexDataSize() / 4), 0);
+    CreateBufferSRV(&m_vertexBuffer, m_vertexCount, sizeof(Vertex));
+    CreateBufferSRV(&m_materialIDBuffer, packer.getTriangleCount(), sizeof(uint32_t));
 }
 
 // Build acceleration structures needed for raytracing.
@@ -295,11 +319,11 @@ void D3D12Renderer::BuildAccelerationStructures()
     D3D12_RAYTRACING_GEOMETRY_DESC geometryDesc = {};
     geometryDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
     geometryDesc.Triangles.IndexBuffer = m_indexBuffer.resource->GetGPUVirtualAddress();
-    geometryDesc.Triangles.IndexCount = static_cast<UINT>(m_indexBuffer.resource->GetDesc().Width) / sizeof(Index);
-    geometryDesc.Triangles.IndexFormat = DXGI_FORMAT_R16_UINT;
+    geometryDesc.Triangles.IndexCount = m_indexCount;
+    geometryDesc.Triangles.IndexFormat = (m_indexFormat == toyraygun::GpuIndexFormat::UInt16) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
     geometryDesc.Triangles.Transform3x4 = 0;
     geometryDesc.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
-    geometryDesc.Triangles.VertexCount = static_cast<UINT>(m_vertexBuffer.resource->GetDesc().Width) / sizeof(Vertex);
+    geometryDesc.Triangles.VertexCount = m_vertexCount;
     geometryDesc.Triangles.VertexBuffer.StartAddress = m_vertexBuffer.resource->GetGPUVirtualAddress();
     geometryDesc.Triangles.VertexBuffer.StrideInBytes = sizeof(Vertex);
 
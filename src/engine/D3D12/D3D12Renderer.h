@@ -10,6 +10,7 @@
 #pragma once
 
 #include "engine/Engine.h"
+#include "engine/GpuGeometryPacker.h"
 #include "engine/Renderer.h"
 #include "engine/D3D12/D3D12Shader.h"
 #include "engine/D3D12/D3D12Device.h"
@@ -42,9 +43,6 @@ public:
 
 private:
 
-    // Index Buffer Type
-    typedef UINT16 Index;
-
     // Vertex Buffer Type
     struct Vertex
     {
@@ -86,6 +84,13 @@ private:
     D3D12Buffer m_indexBuffer;
     D3D12Buffer m_vertexBuffer;
     D3D12Buffer m_materialIDBuffer;
+    toyraygun::GpuIndexFormat m_indexFormat;
+    UINT m_indexCount;
+    UINT m_vertexCount;
+    // Shaders take a single area light, the scene's brightest.
+    toyraygun::SceneLight m_light;
+    uint32_t m_lightFirstTriangle;
+    uint32_t m_lightTriangleCount;
 
     // Acceleration structure
     ComPtr<ID3D12Resource> m_bottomLevelAccelerationStructure;
@@ -298,7 +298,8 @@ inline void AllocateUAVBuffer(ID3D12Device* pDevice, UINT64 bufferSize, ID3D12Re
     }
 }
 
-inline void AllocateUploadBuffer(ID3D12Device* pDevice, void *pData, UINT64 datasize, ID3D12Resource **ppResource, const wchar_t* resourceName = nullptr)
+// Upload buffer the caller fills between Map and Unmap, e.g. by packing data straight into it.
+inline void CreateUploadBuffer(ID3D12Device* pDevice, UINT64 datasize, ID3D12Resource **ppResource, const wchar_t* resourceName = nullptr)
 {
     auto uploadHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
     auto bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(datasize);
@@ -313,6 +314,11 @@ inline void AllocateUploadBuffer(ID3D12Device* pDevice, void *pData, UINT64 data
     {
         (*ppResource)->SetName(resourceName);
     }
+}
+
+inline void AllocateUploadBuffer(ID3D12Device* pDevice, void *pData, UINT64 datasize, ID3D12Resource **ppResource, const wchar_t* resourceName = nullptr)
+{
+    CreateUploadBuffer(pDevice, datasize, ppResource, resourceName);
     void *pMappedData;
     (*ppResource)->Map(0, nullptr, &pMappedData);
     memcpy(pMappedData, pData, datasize);
@@ -12,11 +12,15 @@ using namespace toyraygun;
 
 #include <shlobj.h>
 #include <strsafe.h>
-#else
+#elif PLATFORM_OSX
 #include "engine/Metal/MetalShader.h"
 #include "engine/Metal/MetalRenderer.h"
 #endif
 
+#include "engine/CPU/CpuRenderer.h"
+
+#include <string.h>
+
 Engine* Engine::m_instance = nullptr;
 
 Engine* Engine::instance()
@@ -34,23 +38,63 @@ Shader* Engine::createShader()
 #ifdef PLATFORM_WINDOWS
     D3D12Shader* newShader = new D3D12Shader();
     return newShader;
-#else
+#elif PLATFORM_OSX
     MetalShader* newShader = new MetalShader();
     return newShader;
+#else
+    // No shader compiler on this platform, the CPU renderer doesn't need one.
+    Shader* newShader = new Shader();
+    return newShader;
 #endif
 }
 
-Renderer* Engine::createRenderer()
+RendererType Engine::getDefaultRendererType()
 {
 #ifdef PLATFORM_WINDOWS
-    D3D12Renderer* newRenderer = new D3D12Renderer();
-    return newRenderer;
+    return RendererType::D3D12;
+#elif PLATFORM_OSX
+    return RendererType::Metal;
 #else
-    MetalRenderer* newRenderer = new MetalRenderer();
-    return newRenderer;
+    return RendererType::CPU;
 #endif
 }
 
+Renderer* Engine::createRenderer(RendererType type)
+{
+    if (type == RendererType::Default)
+    {
+        type = getDefaultRendererType();
+    }
+
+    switch (type)
+    {
+#ifdef PLATFORM_WINDOWS
+        case RendererType::D3D12:
+        {
+            D3D12Renderer* newRenderer = new D3D12Renderer();
+            return newRenderer;
+        }
+#elif PLATFORM_OSX
+        case RendererType::Metal:
+        {
+            MetalRenderer* newRenderer = new MetalRenderer();
+            return newRenderer;
+        }
+#endif
+        case RendererType::CPU:
+        {
+            CpuRenderer* newRenderer = new CpuRenderer();
+            return newRenderer;
+        }
+
+        default:
+            break;
+    }
+
+    // Requested backend isn't available on this platform.
+    return nullptr;
+}
+
 std::string Engine::getRuntimeShaderPath()
 {
 #ifdef PLATFORM_WINDOWS
@@ -69,6 +113,11 @@ std::string Engine::getRuntimeShaderExt()
 #endif
 }
 
+std::string Engine::getRuntimeTexturePath()
+{
+    return "textures/";
+}
+
 void Engine::init(int width, int height)
 {
     m_quit = false;
@@ -84,6 +133,38 @@ void Engine::init(int width, int height)
     m_renderer = SDL_CreateRenderer(m_window, -1, SDL_RENDERER_PRESENTVSYNC);
 }
 
+void Engine::setCommandLine(int argc, char** argv)
+{
+    m_argc = argc;
+    m_argv = argv;
+}
+
+bool Engine::hasArg(const char* name)
+{
+    for (int i = 1; i < m_argc; ++i)
+    {
+        if (strcmp(m_argv[i], name) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const char* Engine::getArgValue(const char* name)
+{
+    for (int i = 1; i < m_argc - 1; ++i)
+    {
+        if (strcmp(m_argv[i], name) == 0)
+        {
+            return m_argv[i + 1];
+        }
+    }
+
+    return nullptr;
+}
+
 void Engine::destroy()
 {
     SDL_DestroyRenderer(m_renderer);
@@ -18,6 +18,10 @@
 #           define PLATFORM_WINDOWS_64 1
 #        endif
 #    endif
+#elif defined(__APPLE__)
+#    define PLATFORM_OSX 1
+#elif defined(__linux__)
+#    define PLATFORM_LINUX 1
 #endif
 
 namespace toyraygun
@@ -25,6 +29,15 @@ namespace toyraygun
     class Shader;
     class Renderer;
 
+    enum class RendererType {
+        // Picks the GPU backend for the platform, or CPU when there isn't one.
+        Default = 0,
+        D3D12,
+        Metal,
+        CPU,
+        Count
+    };
+
     class Engine
     {
     protected:
@@ -33,6 +46,8 @@ namespace toyraygun
         int m_width;
         int m_height;
         bool m_quit;
+        int m_argc;
+        char** m_argv;
         SDL_Window* m_window;
         SDL_Renderer* m_renderer;
         
@@ -41,11 +56,14 @@ namespace toyraygun
         static void initPIXDebugger();
         
         static Shader* createShader();
-        static Renderer* createRenderer();
+        static RendererType getDefaultRendererType();
+        static Renderer* createRenderer(RendererType type = RendererType::Default);
         static std::string getRuntimeShaderPath();
         static std::string getRuntimeShaderExt();
+        static std::string getRuntimeTexturePath();
 
         virtual void init(int width, int height);
+        virtual void setCommandLine(int argc, char** argv);
         virtual void destroy();
 
         virtual int getWidth();
@@ -53,6 +71,10 @@ namespace toyraygun
         virtual bool hasQuit();
         virtual void pollEvents();
 
+        // Command line options, e.g. hasArg("--cpu") or getArgValue("--threads").
+        bool hasArg(const char* name);
+        const char* getArgValue(const char* name);
+
         SDL_Renderer* getRenderer() { return m_renderer; }
     };
 }
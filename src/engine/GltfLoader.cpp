@@ -0,0 +1,1076 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#include "GltfLoader.h"
+#include "engine/MappedFile.h"
+#include "engine/Renderer.h"
+using namespace toyraygun;
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <stdlib.h>
+#include <string.h>
+#include <utility>
+#include <bx/math.h>
+
+static const uint32_t kGlbMagic = 0x46546C67; // "glTF"
+static const uint32_t kGlbVersion = 2;
+static const uint32_t kGlbChunkJson = 0x4E4F534A; // "JSON"
+static const uint32_t kGlbChunkBin = 0x004E4942; // "BIN\0"
+
+static const uint32_t kComponentByte = 5120;
+static const uint32_t kComponentUnsignedByte = 5121;
+static const uint32_t kComponentShort = 5122;
+static const uint32_t kComponentUnsignedShort = 5123;
+static const uint32_t kComponentUnsignedInt = 5125;
+static const uint32_t kComponentFloat = 5126;
+
+static const int64_t kModeTriangles = 4;
+
+// Nesting deeper than any real glTF file needs, stops malformed ones blowing the stack.
+static const uint32_t kMaxJsonDepth = 64;
+
+static_assert(sizeof(bx::Vec3) == sizeof(float) * 3, "Float VEC3 accessors are viewed as bx::Vec3 arrays.");
+
+struct GltfLoader::JsonValue
+{
+    enum Type
+    {
+        TYPE_NULL,
+        TYPE_BOOL,
+        TYPE_NUMBER,
+        TYPE_STRING,
+        TYPE_ARRAY,
+        TYPE_OBJECT,
+    };
+
+    Type type;
+    bool boolean;
+    double number;
+    std::string string;
+
+    // Elements of an array, or the members of an object with their keys alongside.
+    std::vector<JsonValue> values;
+    std::vector<std::string> keys;
+
+    JsonValue() :
+        type(TYPE_NULL),
+        boolean(false),
+        number(0.0)
+    {
+    }
+
+    size_t size() const
+    {
+        return values.size();
+    }
+
+    const JsonValue& operator[](size_t index) const
+    {
+        return values[index];
+    }
+
+    // Member of an object, null if there's no such key.
+    const JsonValue* find(const char* key) const
+    {
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            if (keys[i] == key)
+            {
+                return &values[i];
+            }
+        }
+
+        return nullptr;
+    }
+
+    const JsonValue* findArray(const char* key) const
+    {
+        const JsonValue* value = find(key);
+        return (value != nullptr && value->type == TYPE_ARRAY) ? value : nullptr;
+    }
+
+    int64_t getInt(const char* key, int64_t defaultValue) const
+    {
+        const JsonValue* value = find(key);
+        if (value == nullptr || value->type != TYPE_NUMBER || value->number < -9.0e15 || value->number > 9.0e15)
+        {
+            return defaultValue;
+        }
+
+        return (int64_t)value->number;
+    }
+
+    // Reads an array of exactly count numbers, outValues is left alone otherwise.
+    bool getNumbers(const char* key, float* outValues, uint32_t count) const
+    {
+        const JsonValue* value = findArray(key);
+        if (value == nullptr || value->size() != count)
+        {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if ((*value)[i].type != TYPE_NUMBER)
+            {
+                return false;
+            }
+        }
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            outValues[i] = (float)(*value)[i].number;
+        }
+
+        return true;
+    }
+
+    static bool parse(const char*& p, const char* end, JsonValue& out, uint32_t depth);
+    static bool parseString(const char*& p, const char* end, std::string& out);
+};
+
+static void skipWhitespace(const char*& p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+    {
+        p++;
+    }
+}
+
+static bool matchLiteral(const char*& p, const char* end, const char* literal)
+{
+    const size_t length = strlen(literal);
+    if ((size_t)(end - p) < length || memcmp(p, literal, length) != 0)
+    {
+        return false;
+    }
+
+    p += length;
+    return true;
+}
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool GltfLoader::JsonValue::parseString(const char*& p, const char* end, std::string& out)
+{
+    // Skip the opening quote.
+    p++;
+    out.clear();
+
+    while (p < end)
+    {
+        // Copy everything up to the next quote or escape at once.
+        const char* runStart = p;
+        while (p < end && *p != '"' && *p != '\\')
+        {
+            p++;
+        }
+        out.append(runStart, p - runStart);
+
+        if (p >= end)
+        {
+            break;
+        }
+
+        if (*p++ == '"')
+        {
+            return true;
+        }
+
+        if (p >= end)
+        {
+            break;
+        }
+
+        const char escape = *p++;
+        switch (escape)
+        {
+            case '"':
+            case '\\':
+            case '/':
+                out.push_back(escape);
+                break;
+            case 'b': out.push_back('\b'); break;
+            case 'f': out.push_back('\f'); break;
+            case 'n': out.push_back('\n'); break;
+            case 'r': out.push_back('\r'); break;
+            case 't': out.push_back('\t'); break;
+            case 'u':
+            {
+                if (end - p < 4)
+                {
+                    return false;
+                }
+
+                uint32_t code = 0;
+                for (int i = 0; i < 4; ++i)
+                {
+                    const int digit = hexValue(*p++);
+                    if (digit < 0)
+                    {
+                        return false;
+                    }
+                    code = (code << 4) | (uint32_t)digit;
+                }
+
+                // Written out as UTF-8. Surrogate pairs aren't joined, names only have to
+                // compare equal to themselves.
+                if (code < 0x80)
+                {
+                    out.push_back((char)code);
+                }
+                else if (code < 0x800)
+                {
+                    out.push_back((char)(0xC0 | (code >> 6)));
+                    out.push_back((char)(0x80 | (code & 0x3F)));
+                }
+                else
+                {
+                    out.push_back((char)(0xE0 | (code >> 12)));
+                    out.push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+                    out.push_back((char)(0x80 | (code & 0x3F)));
+                }
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+
+    return false;
+}
+
+bool GltfLoader::JsonValue::parse(const char*& p, const char* end, JsonValue& out, uint32_t depth)
+{
+    skipWhitespace(p, end);
+    if (p >= end || depth > kMaxJsonDepth)
+    {
+        return false;
+    }
+
+    if (*p == '{' || *p == '[')
+    {
+        const bool isObject = (*p == '{');
+        const char closing = isObject ? '}' : ']';
+        out.type = isObject ? TYPE_OBJECT : TYPE_ARRAY;
+        p++;
+
+        skipWhitespace(p, end);
+        if (p < end && *p == closing)
+        {
+            p++;
+            return true;
+        }
+
+        while (true)
+        {
+            if (isObject)
+            {
+                skipWhitespace(p, end);
+                if (p >= end || *p != '"')
+                {
+                    return false;
+                }
+
+                out.keys.push_back(std::string());
+                if (!parseString(p, end, out.keys.back()))
+                {
+                    return false;
+                }
+
+                skipWhitespace(p, end);
+                if (p >= end || *p != ':')
+                {
+                    return false;
+                }
+                p++;
+            }
+
+            out.values.push_back(JsonValue());
+            if (!parse(p, end, out.values.back(), depth + 1))
+            {
+                return false;
+            }
+
+            skipWhitespace(p, end);
+            if (p < end && *p == ',')
+            {
+                p++;
+                continue;
+            }
+
+            if (p < end && *p == closing)
+            {
+                p++;
+                return true;
+            }
+
+            return false;
+        }
+    }
+
+    if (*p == '"')
+    {
+        out.type = TYPE_STRING;
+        return parseString(p, end, out.string);
+    }
+
+    if (matchLiteral(p, end, "true"))
+    {
+        out.type = TYPE_BOOL;
+        out.boolean = true;
+        return true;
+    }
+
+    if (matchLiteral(p, end, "false"))
+    {
+        out.type = TYPE_BOOL;
+        out.boolean = false;
+        return true;
+    }
+
+    if (matchLiteral(p, end, "null"))
+    {
+        out.type = TYPE_NULL;
+        return true;
+    }
+
+    // The chunk isn't null terminated, copy the number out for strtod.
+    char number[64];
+    size_t length = 0;
+    while (p < end && length < sizeof(number) - 1 && (((*p >= '0') && (*p <= '9')) || *p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E'))
+    {
+        number[length++] = *p++;
+    }
+    number[length] = '\0';
+
+    char* numberEnd = nullptr;
+    out.type = TYPE_NUMBER;
+    out.number = strtod(number, &numberEnd);
+    return (length > 0 && numberEnd == number + length);
+}
+
+static uint32_t readUint32(const uint8_t* data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static uint32_t getComponentSize(uint32_t componentType)
+{
+    switch (componentType)
+    {
+        case kComponentByte:
+        case kComponentUnsignedByte:
+            return 1;
+        case kComponentShort:
+        case kComponentUnsignedShort:
+            return 2;
+        case kComponentUnsignedInt:
+        case kComponentFloat:
+            return 4;
+    }
+
+    return 0;
+}
+
+static uint32_t getComponentCount(const std::string& type)
+{
+    if (type == "SCALAR") return 1;
+    if (type == "VEC2") return 2;
+    if (type == "VEC3") return 3;
+    if (type == "VEC4") return 4;
+    return 0;
+}
+
+// One component as a float, normalized integers are mapped to [0, 1] or [-1, 1].
+static float readComponent(const uint8_t* data, uint32_t componentType, bool normalized)
+{
+    switch (componentType)
+    {
+        case kComponentByte:
+        {
+            int8_t value;
+            memcpy(&value, data, sizeof(value));
+            return normalized ? bx::max(value / 127.0f, -1.0f) : (float)value;
+        }
+        case kComponentUnsignedByte:
+            return normalized ? (data[0] / 255.0f) : (float)data[0];
+        case kComponentShort:
+        {
+            int16_t value;
+            memcpy(&value, data, sizeof(value));
+            return normalized ? bx::max(value / 32767.0f, -1.0f) : (float)value;
+        }
+        case kComponentUnsignedShort:
+        {
+            uint16_t value;
+            memcpy(&value, data, sizeof(value));
+            return normalized ? (value / 65535.0f) : (float)value;
+        }
+        case kComponentUnsignedInt:
+            return (float)readUint32(data);
+        case kComponentFloat:
+        {
+            float value;
+            memcpy(&value, data, sizeof(value));
+            return value;
+        }
+    }
+
+    return 0.0f;
+}
+
+// The first three components of every element, optionally scaled, in one pass.
+static void convertVec3(const uint8_t* data, uint32_t count, uint32_t stride, uint32_t componentType, bool normalized, const float* scale, SceneBuffer<bx::Vec3>& bufferOut)
+{
+    bufferOut.clear();
+    if (count == 0)
+    {
+        return;
+    }
+
+    bufferOut.resize(count, bx::Vec3(0.0f, 0.0f, 0.0f));
+    bx::Vec3* dest = &bufferOut[0];
+
+    const uint32_t componentSize = getComponentSize(componentType);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const uint8_t* element = data + (size_t)i * stride;
+        bx::Vec3 value(readComponent(element, componentType, normalized),
+                       readComponent(element + componentSize, componentType, normalized),
+                       readComponent(element + componentSize * 2, componentType, normalized));
+
+        if (scale != nullptr)
+        {
+            value = bx::Vec3(value.x * scale[0], value.y * scale[1], value.z * scale[2]);
+        }
+
+        dest[i] = value;
+    }
+}
+
+GltfLoader::GltfLoader() :
+    m_root(nullptr),
+    m_binData(nullptr),
+    m_binSize(0),
+    m_loadTimeMs(0.0f),
+    m_fileSize(0),
+    m_viewedAccessors(0),
+    m_convertedAccessors(0),
+    m_skippedPrimitives(0)
+{
+}
+
+bool GltfLoader::getAccessor(int index, Accessor& accessorOut)
+{
+    const JsonValue* accessors = m_root->findArray("accessors");
+    const JsonValue* bufferViews = m_root->findArray("bufferViews");
+    const JsonValue* buffers = m_root->findArray("buffers");
+    if (accessors == nullptr || bufferViews == nullptr || buffers == nullptr || index < 0 || (size_t)index >= accessors->size())
+    {
+        return false;
+    }
+
+    // Sparse accessors and accessors without a buffer view would need their own storage.
+    const JsonValue& accessor = (*accessors)[index];
+    const int64_t viewIndex = accessor.getInt("bufferView", -1);
+    if (accessor.find("sparse") != nullptr || viewIndex < 0 || (size_t)viewIndex >= bufferViews->size())
+    {
+        return false;
+    }
+
+    // Only the GLB's own binary chunk, external buffers aren't loaded.
+    const JsonValue& view = (*bufferViews)[viewIndex];
+    const int64_t bufferIndex = view.getInt("buffer", -1);
+    if (bufferIndex != 0 || buffers->size() == 0 || m_binData == nullptr || (*buffers)[0].find("uri") != nullptr)
+    {
+        return false;
+    }
+
+    const int64_t bufferLength = (*buffers)[0].getInt("byteLength", -1);
+    const int64_t viewOffset = view.getInt("byteOffset", 0);
+    const int64_t viewLength = view.getInt("byteLength", -1);
+    if (bufferLength < 0 || (uint64_t)bufferLength > m_binSize || viewOffset < 0 || viewLength < 0 || viewOffset + viewLength > bufferLength)
+    {
+        return false;
+    }
+
+    const JsonValue* type = accessor.find("type");
+    const uint32_t componentType = (uint32_t)accessor.getInt("componentType", 0);
+    const uint32_t componentSize = getComponentSize(componentType);
+    const uint32_t componentCount = (type != nullptr) ? getComponentCount(type->string) : 0;
+    if (componentSize == 0 || componentCount == 0)
+    {
+        return false;
+    }
+
+    const int64_t elementSize = componentSize * componentCount;
+    const int64_t stride = view.getInt("byteStride", 0);
+    const int64_t accessorOffset = accessor.getInt("byteOffset", 0);
+    const int64_t count = accessor.getInt("count", -1);
+    if ((stride != 0 && stride < elementSize) || stride > 252 || accessorOffset < 0 || count < 0 || count > UINT32_MAX)
+    {
+        return false;
+    }
+
+    accessorOut.stride = (uint32_t)((stride != 0) ? stride : elementSize);
+    if (count > 0 && accessorOffset + (count - 1) * accessorOut.stride + elementSize > viewLength)
+    {
+        return false;
+    }
+
+    accessorOut.data = m_binData + viewOffset + accessorOffset;
+    accessorOut.count = (uint32_t)count;
+    accessorOut.componentType = componentType;
+    accessorOut.componentCount = componentCount;
+
+    const JsonValue* normalized = accessor.find("normalized");
+    accessorOut.normalized = (normalized != nullptr && normalized->boolean);
+    return true;
+}
+
+bool GltfLoader::readVec3(const Accessor& accessor, SceneBuffer<bx::Vec3>& bufferOut)
+{
+    if (accessor.componentCount < 3)
+    {
+        return false;
+    }
+
+    // Tightly packed floats already are an array of bx::Vec3.
+    if (accessor.componentType == kComponentFloat && accessor.componentCount == 3 && accessor.stride == sizeof(bx::Vec3) &&
+        ((uintptr_t)accessor.data % sizeof(float)) == 0)
+    {
+        bufferOut.setView((const bx::Vec3*)accessor.data, accessor.count);
+        m_viewedAccessors++;
+        return true;
+    }
+
+    convertVec3(accessor.data, accessor.count, accessor.stride, accessor.componentType, accessor.normalized, nullptr, bufferOut);
+    m_convertedAccessors++;
+    return true;
+}
+
+bool GltfLoader::readColors(const Accessor& accessor, const float* colorFactor, SceneBuffer<bx::Vec3>& bufferOut)
+{
+    if (accessor.componentCount < 3)
+    {
+        return false;
+    }
+
+    if (accessor.componentCount == 3 && colorFactor[0] == 1.0f && colorFactor[1] == 1.0f && colorFactor[2] == 1.0f)
+    {
+        return readVec3(accessor, bufferOut);
+    }
+
+    // Alpha is dropped.
+    convertVec3(accessor.data, accessor.count, accessor.stride, accessor.componentType, accessor.normalized, colorFactor, bufferOut);
+    m_convertedAccessors++;
+    return true;
+}
+
+bool GltfLoader::readIndices(const Accessor& accessor, uint32_t vertexCount, SceneBuffer<uint32_t>& bufferOut)
+{
+    if (accessor.componentCount != 1)
+    {
+        return false;
+    }
+
+    // A trailing partial triangle is dropped.
+    const uint32_t indexCount = accessor.count - (accessor.count % 3);
+
+    if (accessor.componentType == kComponentUnsignedInt && accessor.stride == sizeof(uint32_t) &&
+        ((uintptr_t)accessor.data % sizeof(uint32_t)) == 0)
+    {
+        bufferOut.setView((const uint32_t*)accessor.data, indexCount);
+        m_viewedAccessors++;
+    }
+    else if (accessor.componentType == kComponentUnsignedInt || accessor.componentType == kComponentUnsignedShort || accessor.componentType == kComponentUnsignedByte)
+    {
+        bufferOut.clear();
+        if (indexCount > 0)
+        {
+            bufferOut.resize(indexCount, 0);
+            uint32_t* dest = &bufferOut[0];
+
+            const uint8_t* src = accessor.data;
+            for (uint32_t i = 0; i < indexCount; ++i, src += accessor.stride)
+            {
+                if (accessor.componentType == kComponentUnsignedShort)
+                {
+                    uint16_t index;
+                    memcpy(&index, src, sizeof(index));
+                    dest[i] = index;
+                }
+                else
+                {
+                    dest[i] = (accessor.componentType == kComponentUnsignedByte) ? src[0] : readUint32(src);
+                }
+            }
+        }
+        m_convertedAccessors++;
+    }
+    else
+    {
+        return false;
+    }
+
+    // Out of range indices would read past the end of the vertex buffers.
+    const uint32_t* indices = bufferOut.data();
+    uint32_t maxIndex = 0;
+    for (uint32_t i = 0; i < indexCount; ++i)
+    {
+        maxIndex = bx::max(maxIndex, indices[i]);
+    }
+
+    if (indexCount > 0 && maxIndex >= vertexCount)
+    {
+        bufferOut.clear();
+        return false;
+    }
+
+    return true;
+}
+
+void GltfLoader::getMaterial(int materialIndex, float* colorOut, uint32_t& materialIDOut)
+{
+    // The spec's default material is plain white.
+    colorOut[0] = colorOut[1] = colorOut[2] = 1.0f;
+    materialIDOut = MATERIAL_DEFAULT;
+
+    const JsonValue* materials = m_root->findArray("materials");
+    if (materials == nullptr || materialIndex < 0 || (size_t)materialIndex >= materials->size())
+    {
+        return;
+    }
+
+    const JsonValue& material = (*materials)[materialIndex];
+
+    float baseColor[4];
+    const JsonValue* pbr = material.find("pbrMetallicRoughness");
+    if (pbr != nullptr && pbr->getNumbers("baseColorFactor", baseColor, 4))
+    {
+        memcpy(colorOut, baseColor, sizeof(float) * 3);
+    }
+
+    float emissive[3];
+    if (material.getNumbers("emissiveFactor", emissive, 3) && (emissive[0] > 0.0f || emissive[1] > 0.0f || emissive[2] > 0.0f))
+    {
+        float strength = 1.0f;
+        const JsonValue* extensions = material.find("extensions");
+        const JsonValue* emissiveStrength = (extensions != nullptr) ? extensions->find("KHR_materials_emissive_strength") : nullptr;
+        const JsonValue* strengthValue = (emissiveStrength != nullptr) ? emissiveStrength->find("emissiveStrength") : nullptr;
+        if (strengthValue != nullptr && strengthValue->type == JsonValue::TYPE_NUMBER)
+        {
+            strength = (float)strengthValue->number;
+        }
+
+        for (int i = 0; i < 3; ++i)
+        {
+            colorOut[i] = emissive[i] * strength;
+        }
+        materialIDOut = MATERIAL_EMISSIVE;
+    }
+}
+
+bool GltfLoader::loadPrimitive(const JsonValue& primitive, SceneMesh& meshOut)
+{
+    const JsonValue* attributes = primitive.find("attributes");
+    if (primitive.getInt("mode", kModeTriangles) != kModeTriangles || attributes == nullptr)
+    {
+        return false;
+    }
+
+    Accessor positions;
+    if (!getAccessor((int)attributes->getInt("POSITION", -1), positions) || !readVec3(positions, meshOut.vertexBuffer))
+    {
+        return false;
+    }
+    const uint32_t vertexCount = (uint32_t)meshOut.vertexBuffer.size();
+
+    const int indicesIndex = (int)primitive.getInt("indices", -1);
+    if (indicesIndex >= 0)
+    {
+        Accessor indices;
+        if (!getAccessor(indicesIndex, indices) || !readIndices(indices, vertexCount, meshOut.indexBuffer))
+        {
+            return false;
+        }
+    }
+    else if (vertexCount >= 3)
+    {
+        // Without indices every three vertices are a triangle.
+        const uint32_t indexCount = vertexCount - (vertexCount % 3);
+        meshOut.indexBuffer.resize(indexCount, 0);
+
+        uint32_t* dest = &meshOut.indexBuffer[0];
+        for (uint32_t i = 0; i < indexCount; ++i)
+        {
+            dest[i] = i;
+        }
+    }
+
+    if (meshOut.indexBuffer.empty())
+    {
+        return false;
+    }
+
+    float color[3];
+    uint32_t materialID;
+    getMaterial((int)primitive.getInt("material", -1), color, materialID);
+
+    // Lights are one color, everything else is tinted by the vertex colors if it has them.
+    Accessor colors;
+    const bool hasColors = materialID != MATERIAL_EMISSIVE &&
+                           getAccessor((int)attributes->getInt("COLOR_0", -1), colors) &&
+                           colors.count == vertexCount &&
+                           readColors(colors, color, meshOut.colorBuffer);
+    if (!hasColors)
+    {
+        meshOut.colorBuffer.clear();
+        meshOut.colorBuffer.resize(vertexCount, bx::Vec3(color[0], color[1], color[2]));
+    }
+
+    Accessor normals;
+    const bool hasNormals = getAccessor((int)attributes->getInt("NORMAL", -1), normals) &&
+                            normals.count == vertexCount &&
+                            readVec3(normals, meshOut.normalBuffer);
+
+    const size_t cornerCount = meshOut.indexBuffer.size();
+    if (!hasNormals)
+    {
+        // Flat normals need a vertex per triangle corner, so nothing is left viewing the file.
+        const uint32_t views = (meshOut.vertexBuffer.isView() ? 1 : 0) + (meshOut.indexBuffer.isView() ? 1 : 0) + (meshOut.colorBuffer.isView() ? 1 : 0);
+        m_viewedAccessors -= views;
+        m_convertedAccessors += views;
+
+        SceneBuffer<bx::Vec3> flatPositions;
+        SceneBuffer<bx::Vec3> flatNormals;
+        SceneBuffer<bx::Vec3> flatColors;
+        SceneBuffer<uint32_t> flatIndices;
+        flatPositions.resize(cornerCount, bx::Vec3(0.0f, 0.0f, 0.0f));
+        flatNormals.resize(cornerCount, bx::Vec3(0.0f, 0.0f, 0.0f));
+        flatColors.resize(cornerCount, bx::Vec3(0.0f, 0.0f, 0.0f));
+        flatIndices.resize(cornerCount, 0);
+
+        bx::Vec3* destPositions = &flatPositions[0];
+        bx::Vec3* destNormals = &flatNormals[0];
+        bx::Vec3* destColors = &flatColors[0];
+        uint32_t* destIndices = &flatIndices[0];
+
+        const bx::Vec3* srcPositions = meshOut.vertexBuffer.data();
+        const bx::Vec3* srcColors = meshOut.colorBuffer.data();
+        const uint32_t* srcIndices = meshOut.indexBuffer.data();
+
+        for (size_t i = 0; i < cornerCount; i += 3)
+        {
+            const bx::Vec3 faceNormal = bx::cross(bx::sub(srcPositions[srcIndices[i + 1]], srcPositions[srcIndices[i]]),
+                                                  bx::sub(srcPositions[srcIndices[i + 2]], srcPositions[srcIndices[i]]));
+            const float length = bx::length(faceNormal);
+            const bx::Vec3 normal = (length > 0.0f) ? bx::mul(faceNormal, 1.0f / length) : bx::Vec3(0.0f, 1.0f, 0.0f);
+
+            for (size_t j = i; j < i + 3; ++j)
+            {
+                destPositions[j] = srcPositions[srcIndices[j]];
+                destNormals[j] = normal;
+                destColors[j] = srcColors[srcIndices[j]];
+                destIndices[j] = (uint32_t)j;
+            }
+        }
+
+        meshOut.vertexBuffer = std::move(flatPositions);
+        meshOut.normalBuffer = std::move(flatNormals);
+        meshOut.colorBuffer = std::move(flatColors);
+        meshOut.indexBuffer = std::move(flatIndices);
+    }
+
+    // Materials are per triangle.
+    meshOut.materialIDBuffer.resize(cornerCount / 3, materialID);
+    return true;
+}
+
+const std::vector<uint32_t>& GltfLoader::loadMesh(Scene* scene, uint32_t meshIndex)
+{
+    if (!m_meshLoaded[meshIndex])
+    {
+        m_meshLoaded[meshIndex] = true;
+
+        const JsonValue* primitives = (*m_root->findArray("meshes"))[meshIndex].findArray("primitives");
+        for (size_t i = 0; primitives != nullptr && i < primitives->size(); ++i)
+        {
+            SceneMesh mesh;
+            if (loadPrimitive((*primitives)[i], mesh))
+            {
+                m_meshIDs[meshIndex].push_back(scene->addMesh(std::move(mesh)));
+            }
+            else
+            {
+                m_skippedPrimitives++;
+            }
+        }
+    }
+
+    return m_meshIDs[meshIndex];
+}
+
+void GltfLoader::getLocalTransform(const JsonValue& node, float* mtxOut)
+{
+    // glTF matrices are column major, the same memory layout as bx ones.
+    if (node.getNumbers("matrix", mtxOut, 16))
+    {
+        return;
+    }
+
+    float translation[3] = { 0.0f, 0.0f, 0.0f };
+    float rotation[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    float scale[3] = { 1.0f, 1.0f, 1.0f };
+    node.getNumbers("translation", translation, 3);
+    node.getNumbers("rotation", rotation, 4);
+    node.getNumbers("scale", scale, 3);
+
+    // Translation * rotation * scale, each column is a rotated and scaled axis.
+    const float x = rotation[0];
+    const float y = rotation[1];
+    const float z = rotation[2];
+    const float w = rotation[3];
+
+    mtxOut[0] = (1.0f - 2.0f * (y * y + z * z)) * scale[0];
+    mtxOut[1] = (2.0f * (x * y + z * w)) * scale[0];
+    mtxOut[2] = (2.0f * (x * z - y * w)) * scale[0];
+    mtxOut[3] = 0.0f;
+
+    mtxOut[4] = (2.0f * (x * y - z * w)) * scale[1];
+    mtxOut[5] = (1.0f - 2.0f * (x * x + z * z)) * scale[1];
+    mtxOut[6] = (2.0f * (y * z + x * w)) * scale[1];
+    mtxOut[7] = 0.0f;
+
+    mtxOut[8] = (2.0f * (x * z + y * w)) * scale[2];
+    mtxOut[9] = (2.0f * (y * z - x * w)) * scale[2];
+    mtxOut[10] = (1.0f - 2.0f * (x * x + y * y)) * scale[2];
+    mtxOut[11] = 0.0f;
+
+    mtxOut[12] = translation[0];
+    mtxOut[13] = translation[1];
+    mtxOut[14] = translation[2];
+    mtxOut[15] = 1.0f;
+}
+
+bool GltfLoader::load(const std::string& path, Scene* scene)
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    std::unique_ptr<MappedFile> file(new MappedFile());
+    if (!file->open(path))
+    {
+        std::cout << "GLTF: couldn't open " << path << std::endl;
+        return false;
+    }
+
+    // 12 byte header followed by a JSON chunk and an optional binary one.
+    const uint8_t* data = file->getData();
+    const size_t size = file->getSize();
+    if (size < 20 || readUint32(data) != kGlbMagic || readUint32(data + 4) != kGlbVersion || readUint32(data + 8) > size)
+    {
+        std::cout << "GLTF: " << path << " isn't a binary glTF 2.0 file." << std::endl;
+        return false;
+    }
+
+    const size_t length = readUint32(data + 8);
+    const size_t jsonLength = readUint32(data + 12);
+    if (readUint32(data + 16) != kGlbChunkJson || jsonLength > length - 20)
+    {
+        std::cout << "GLTF: " << path << " has no JSON chunk." << std::endl;
+        return false;
+    }
+
+    const char* json = (const char*)(data + 20);
+    const size_t binChunk = 20 + jsonLength;
+    m_binData = nullptr;
+    m_binSize = 0;
+    if (binChunk + 8 <= length && readUint32(data + binChunk + 4) == kGlbChunkBin && readUint32(data + binChunk) <= length - binChunk - 8)
+    {
+        m_binData = data + binChunk + 8;
+        m_binSize = readUint32(data + binChunk);
+    }
+
+    JsonValue root;
+    const char* p = json;
+    if (!JsonValue::parse(p, json + jsonLength, root, 0) || root.type != JsonValue::TYPE_OBJECT)
+    {
+        std::cout << "GLTF: " << path << " has malformed JSON." << std::endl;
+        return false;
+    }
+
+    const JsonValue* asset = root.find("asset");
+    const JsonValue* version = (asset != nullptr) ? asset->find("version") : nullptr;
+    if (version == nullptr || version->string.empty() || version->string[0] != '2')
+    {
+        std::cout << "GLTF: " << path << " isn't glTF 2.0." << std::endl;
+        return false;
+    }
+
+    const JsonValue* extensionsRequired = root.findArray("extensionsRequired");
+    for (size_t i = 0; extensionsRequired != nullptr && i < extensionsRequired->size(); ++i)
+    {
+        const std::string& extension = (*extensionsRequired)[i].string;
+        if (extension != "KHR_mesh_quantization" && extension != "KHR_materials_emissive_strength")
+        {
+            std::cout << "GLTF: " << path << " requires unsupported extension " << extension << "." << std::endl;
+            return false;
+        }
+    }
+
+    m_root = &root;
+    m_fileSize = size;
+    m_viewedAccessors = 0;
+    m_convertedAccessors = 0;
+    m_skippedPrimitives = 0;
+
+    const JsonValue* meshes = root.findArray("meshes");
+    const JsonValue* nodes = root.findArray("nodes");
+    const size_t meshCount = (meshes != nullptr) ? meshes->size() : 0;
+    const size_t nodeCount = (nodes != nullptr) ? nodes->size() : 0;
+    m_meshIDs.assign(meshCount, std::vector<uint32_t>());
+    m_meshLoaded.assign(meshCount, false);
+
+    // The default scene's root nodes, or every node that isn't a child if there are no scenes.
+    std::vector<uint32_t> rootNodes;
+    const JsonValue* scenes = root.findArray("scenes");
+    const int64_t sceneIndex = root.getInt("scene", 0);
+    if (scenes != nullptr && sceneIndex >= 0 && (size_t)sceneIndex < scenes->size())
+    {
+        const JsonValue* sceneNodes = (*scenes)[sceneIndex].findArray("nodes");
+        for (size_t i = 0; sceneNodes != nullptr && i < sceneNodes->size(); ++i)
+        {
+            rootNodes.push_back((uint32_t)(*sceneNodes)[i].number);
+        }
+    }
+    else
+    {
+        std::vector<bool> isChild(nodeCount, false);
+        for (size_t i = 0; i < nodeCount; ++i)
+        {
+            const JsonValue* children = (*nodes)[i].findArray("children");
+            for (size_t c = 0; children != nullptr && c < children->size(); ++c)
+            {
+                const size_t child = (size_t)(*children)[c].number;
+                if (child < nodeCount)
+                {
+                    isChild[child] = true;
+                }
+            }
+        }
+
+        for (size_t i = 0; i < nodeCount; ++i)
+        {
+            if (!isChild[i])
+            {
+                rootNodes.push_back((uint32_t)i);
+            }
+        }
+    }
+
+    const size_t firstMesh = scene->m_meshes.size();
+    const size_t firstInstance = scene->m_instances.size();
+
+    struct PendingNode
+    {
+        uint32_t node;
+        float parentMtx[16];
+    };
+
+    // Walk the node trees, each node is visited once even if a malformed file has cycles.
+    std::vector<PendingNode> stack;
+    std::vector<bool> visited(nodeCount, false);
+    for (size_t i = rootNodes.size(); i > 0; --i)
+    {
+        PendingNode pending;
+        pending.node = rootNodes[i - 1];
+        bx::mtxIdentity(pending.parentMtx);
+        stack.push_back(pending);
+    }
+
+    while (!stack.empty())
+    {
+        const PendingNode pending = stack.back();
+        stack.pop_back();
+
+        if (pending.node >= nodeCount || visited[pending.node])
+        {
+            continue;
+        }
+        visited[pending.node] = true;
+
+        const JsonValue& node = (*nodes)[pending.node];
+
+        float localMtx[16];
+        float worldMtx[16];
+        getLocalTransform(node, localMtx);
+        bx::mtxMul(worldMtx, localMtx, pending.parentMtx);
+
+        const int64_t meshIndex = node.getInt("mesh", -1);
+        if (meshIndex >= 0 && (size_t)meshIndex < meshCount)
+        {
+            const std::vector<uint32_t>& meshIDs = loadMesh(scene, (uint32_t)meshIndex);
+            for (size_t i = 0; i < meshIDs.size(); ++i)
+            {
+                scene->addInstance(meshIDs[i], worldMtx);
+            }
+        }
+
+        const JsonValue* children = node.findArray("children");
+        for (size_t c = (children != nullptr) ? children->size() : 0; c > 0; --c)
+        {
+            PendingNode child;
+            child.node = (uint32_t)(*children)[c - 1].number;
+            memcpy(child.parentMtx, worldMtx, sizeof(worldMtx));
+            stack.push_back(child);
+        }
+    }
+
+    uint64_t triangleCount = 0;
+    for (size_t i = firstMesh; i < scene->m_meshes.size(); ++i)
+    {
+        triangleCount += scene->m_meshes[i].indexBuffer.size() / 3;
+    }
+
+    // Meshes viewing the binary chunk need the mapping to stay around.
+    if (m_viewedAccessors > 0)
+    {
+        scene->addMappedFile(std::move(file));
+    }
+
+    m_root = nullptr;
+    m_binData = nullptr;
+    m_binSize = 0;
+
+    m_loadTimeMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+    std::cout << "GLTF: " << path << ", " << (m_fileSize / (1024.0f * 1024.0f)) << " MB in " << m_loadTimeMs << " ms, "
+              << (scene->m_meshes.size() - firstMesh) << " meshes, " << (scene->m_instances.size() - firstInstance) << " instances, "
+              << triangleCount << " triangles, " << m_viewedAccessors << " of " << (m_viewedAccessors + m_convertedAccessors)
+              << " accessors used in place." << std::endl;
+
+    if (m_skippedPrimitives > 0)
+    {
+        std::cout << "GLTF: skipped " << m_skippedPrimitives << " primitives that aren't triangle lists or use data outside the binary chunk." << std::endl;
+    }
+
+    return true;
+}
+
+float GltfLoader::getLoadTimeMs() const
+{
+    return m_loadTimeMs;
+}
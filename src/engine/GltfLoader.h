@@ -0,0 +1,77 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#ifndef GLTFLOADER_HEADER_GUARD
+#define GLTFLOADER_HEADER_GUARD
+
+#include "engine/Scene.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace toyraygun
+{
+    // Loads binary glTF 2.0 (.glb) files into a Scene. The file is memory mapped and kept
+    // open by the scene: accessors already in the layout SceneMesh uses, float VEC3
+    // positions and normals and uint32 indices without padding between elements, are
+    // viewed in place in the binary chunk. Anything else is converted in one pass.
+    //
+    // Every primitive becomes a mesh and every node that has a mesh becomes an instance
+    // of its primitives with the node's world transform, so meshes used by several nodes
+    // are only loaded once. Only triangle lists are supported. Materials use
+    // baseColorFactor times COLOR_0 as the color, a non zero emissiveFactor makes the
+    // material MATERIAL_EMISSIVE with the emissive color. Primitives without normals get
+    // flat ones as the spec asks.
+    class GltfLoader
+    {
+    protected:
+        struct JsonValue;
+
+        // An accessor resolved to memory in the binary chunk.
+        struct Accessor
+        {
+            const uint8_t* data;
+            uint32_t count;
+            uint32_t stride;
+            uint32_t componentType;
+            uint32_t componentCount;
+            bool normalized;
+        };
+
+        const JsonValue* m_root;
+        const uint8_t* m_binData;
+        size_t m_binSize;
+
+        // Scene mesh of each primitive of each glTF mesh, filled in the first time a node uses it.
+        std::vector<std::vector<uint32_t>> m_meshIDs;
+        std::vector<bool> m_meshLoaded;
+
+        // Stats
+        float m_loadTimeMs;
+        uint64_t m_fileSize;
+        uint32_t m_viewedAccessors;
+        uint32_t m_convertedAccessors;
+        uint32_t m_skippedPrimitives;
+
+        bool getAccessor(int index, Accessor& accessorOut);
+        bool readVec3(const Accessor& accessor, SceneBuffer<bx::Vec3>& bufferOut);
+        bool readColors(const Accessor& accessor, const float* colorFactor, SceneBuffer<bx::Vec3>& bufferOut);
+        bool readIndices(const Accessor& accessor, uint32_t vertexCount, SceneBuffer<uint32_t>& bufferOut);
+        void getMaterial(int materialIndex, float* colorOut, uint32_t& materialIDOut);
+        bool loadPrimitive(const JsonValue& primitive, SceneMesh& meshOut);
+        const std::vector<uint32_t>& loadMesh(Scene* scene, uint32_t meshIndex);
+        void getLocalTransform(const JsonValue& node, float* mtxOut);
+
+    public:
+        GltfLoader();
+
+        bool load(const std::string& path, Scene* scene);
+
+        float getLoadTimeMs() const;
+    };
+}
+
+#endif // GLTFLOADER_HEADER_GUARD
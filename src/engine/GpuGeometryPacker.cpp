@@ -0,0 +1,119 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#include "GpuGeometryPacker.h"
+using namespace toyraygun;
+
+#include <string.h>
+
+// The largest 16 bit index is kept free, it's the strip cut value on some APIs.
+static const size_t kMaxUInt16VertexCount = 0xffff;
+
+GpuGeometryPacker::GpuGeometryPacker() :
+    m_scene(nullptr),
+    m_indexFormat(GpuIndexFormat::UInt16)
+{
+
+}
+
+void GpuGeometryPacker::init(const Scene* scene)
+{
+    m_scene = scene;
+    m_indexFormat = (scene->m_vertexBuffer.size() <= kMaxUInt16VertexCount) ? GpuIndexFormat::UInt16 : GpuIndexFormat::UInt32;
+}
+
+GpuIndexFormat GpuGeometryPacker::getIndexFormat() const
+{
+    return m_indexFormat;
+}
+
+uint32_t GpuGeometryPacker::getIndexSize() const
+{
+    return (m_indexFormat == GpuIndexFormat::UInt16) ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+uint32_t GpuGeometryPacker::getVertexCount() const
+{
+    return (uint32_t)m_scene->m_vertexBuffer.size();
+}
+
+uint32_t GpuGeometryPacker::getIndexCount() const
+{
+    return (uint32_t)m_scene->m_indexBuffer.size();
+}
+
+uint32_t GpuGeometryPacker::getTriangleCount() const
+{
+    return (uint32_t)(m_scene->m_indexBuffer.size() / 3);
+}
+
+size_t GpuGeometryPacker::getVertexDataSize(const GpuVertexLayout& layout) const
+{
+    return m_scene->m_vertexBuffer.size() * layout.stride;
+}
+
+size_t GpuGeometryPacker::getIndexDataSize() const
+{
+    return ((m_scene->m_indexBuffer.size() * getIndexSize()) + 3) & ~(size_t)3;
+}
+
+size_t GpuGeometryPacker::getMaterialIDDataSize() const
+{
+    return m_scene->m_materialIDBuffer.size() * sizeof(uint32_t);
+}
+
+void GpuGeometryPacker::packVertices(const GpuVertexLayout& layout, void* dataOut) const
+{
+    const bx::Vec3* positions = m_scene->m_vertexBuffer.data();
+    const bx::Vec3* normals = m_scene->m_normalBuffer.data();
+    const bx::Vec3* colors = m_scene->m_colorBuffer.data();
+    const size_t vertexCount = m_scene->m_vertexBuffer.size();
+
+    uint8_t* vertex = (uint8_t*)dataOut;
+    for (size_t i = 0; i < vertexCount; ++i, vertex += layout.stride)
+    {
+        if (layout.positionOffset >= 0)
+        {
+            memcpy(vertex + layout.positionOffset, &positions[i], sizeof(bx::Vec3));
+        }
+
+        if (layout.normalOffset >= 0)
+        {
+            memcpy(vertex + layout.normalOffset, &normals[i], sizeof(bx::Vec3));
+        }
+
+        if (layout.colorOffset >= 0)
+        {
+            memcpy(vertex + layout.colorOffset, &colors[i], sizeof(bx::Vec3));
+        }
+    }
+}
+
+void GpuGeometryPacker::packIndices(void* dataOut) const
+{
+    const uint32_t* indices = m_scene->m_indexBuffer.data();
+    const size_t indexCount = m_scene->m_indexBuffer.size();
+    const size_t dataSize = indexCount * getIndexSize();
+
+    if (m_indexFormat == GpuIndexFormat::UInt32)
+    {
+        memcpy(dataOut, indices, dataSize);
+    }
+    else
+    {
+        uint16_t* indices16 = (uint16_t*)dataOut;
+        for (size_t i = 0; i < indexCount; ++i)
+        {
+            indices16[i] = (uint16_t)indices[i];
+        }
+    }
+
+    memset((uint8_t*)dataOut + dataSize, 0, getIndexDataSize() - dataSize);
+}
+
+void GpuGeometryPacker::packMaterialIDs(void* dataOut) const
+{
+    memcpy(dataOut, m_scene->m_materialIDBuffer.data(), getMaterialIDDataSize());
+}
@@ -0,0 +1,67 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#ifndef GPUGEOMETRYPACKER_HEADER_GUARD
+#define GPUGEOMETRYPACKER_HEADER_GUARD
+
+#include "engine/Scene.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace toyraygun
+{
+    enum class GpuIndexFormat
+    {
+        UInt16,
+        UInt32,
+    };
+
+    // Where each attribute goes in a packed vertex, in bytes. Attributes with a negative
+    // offset are left out, so a backend that keeps attributes in separate buffers packs
+    // each one with its own layout.
+    struct GpuVertexLayout
+    {
+        uint32_t stride;
+        int32_t positionOffset;
+        int32_t normalOffset;
+        int32_t colorOffset;
+    };
+
+    // Turns a Scene's baked world space buffers into the vertex and index data GPU backends
+    // upload. Sizes are known before packing so backends can pack straight into mapped
+    // upload memory, and every vertex is written in one pass whatever the layout.
+    //
+    // Indices are 16 bit when every vertex can be addressed with them, 32 bit otherwise.
+    // Index data is padded to a multiple of 4 bytes for shaders that read it as words.
+    class GpuGeometryPacker
+    {
+    protected:
+        const Scene* m_scene;
+        GpuIndexFormat m_indexFormat;
+
+    public:
+        GpuGeometryPacker();
+
+        // Call after Scene::bakeInstances(), the scene has to outlive the packer.
+        void init(const Scene* scene);
+
+        GpuIndexFormat getIndexFormat() const;
+        uint32_t getIndexSize() const;
+        uint32_t getVertexCount() const;
+        uint32_t getIndexCount() const;
+        uint32_t getTriangleCount() const;
+
+        size_t getVertexDataSize(const GpuVertexLayout& layout) const;
+        size_t getIndexDataSize() const;
+        size_t getMaterialIDDataSize() const;
+
+        void packVertices(const GpuVertexLayout& layout, void* dataOut) const;
+        void packIndices(void* dataOut) const;
+        void packMaterialIDs(void* dataOut) const;
+    };
+}
+
+#endif // GPUGEOMETRYPACKER_HEADER_GUARD
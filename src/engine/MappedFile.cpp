@@ -0,0 +1,154 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#include "MappedFile.h"
+#include "engine/Engine.h"
+using namespace toyraygun;
+
+#ifdef PLATFORM_WINDOWS
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() :
+    m_data(nullptr),
+    m_size(0),
+    m_fileHandle(-1),
+    m_mappingHandle(nullptr)
+{
+
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const std::string& path)
+{
+    close();
+
+#ifdef PLATFORM_WINDOWS
+    HANDLE fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    m_fileHandle = (intptr_t)fileHandle;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize))
+    {
+        close();
+        return false;
+    }
+
+    m_size = (size_t)fileSize.QuadPart;
+
+    // Empty files can't be mapped, they're still valid.
+    if (m_size == 0)
+    {
+        return true;
+    }
+
+    m_mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_mappingHandle == nullptr)
+    {
+        close();
+        return false;
+    }
+
+    m_data = (const uint8_t*)MapViewOfFile(m_mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    if (m_data == nullptr)
+    {
+        close();
+        return false;
+    }
+#else
+    int fileDescriptor = ::open(path.c_str(), O_RDONLY);
+    if (fileDescriptor < 0)
+    {
+        return false;
+    }
+    m_fileHandle = fileDescriptor;
+
+    struct stat fileStat;
+    if (fstat(fileDescriptor, &fileStat) != 0)
+    {
+        close();
+        return false;
+    }
+
+    m_size = (size_t)fileStat.st_size;
+
+    // Empty files can't be mapped, they're still valid.
+    if (m_size == 0)
+    {
+        return true;
+    }
+
+    void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+    if (data == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+
+    // Files are read front to back, let the OS read ahead.
+    madvise(data, m_size, MADV_SEQUENTIAL);
+    m_data = (const uint8_t*)data;
+#endif
+
+    return true;
+}
+
+void MappedFile::close()
+{
+#ifdef PLATFORM_WINDOWS
+    if (m_data != nullptr)
+    {
+        UnmapViewOfFile((LPCVOID)m_data);
+    }
+
+    if (m_mappingHandle != nullptr)
+    {
+        CloseHandle(m_mappingHandle);
+        m_mappingHandle = nullptr;
+    }
+
+    if (m_fileHandle != -1)
+    {
+        CloseHandle((HANDLE)m_fileHandle);
+    }
+#else
+    if (m_data != nullptr)
+    {
+        munmap((void*)m_data, m_size);
+    }
+
+    if (m_fileHandle != -1)
+    {
+        ::close((int)m_fileHandle);
+    }
+#endif
+
+    m_fileHandle = -1;
+    m_data = nullptr;
+    m_size = 0;
+}
+
+const uint8_t* MappedFile::getData() const
+{
+    return m_data;
+}
+
+size_t MappedFile::getSize() const
+{
+    return m_size;
+}
@@ -0,0 +1,39 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#ifndef MAPPEDFILE_HEADER_GUARD
+#define MAPPEDFILE_HEADER_GUARD
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+namespace toyraygun
+{
+    // Read only view of a whole file mapped into memory. Pages are read in by the OS as
+    // they're touched, so big files can be parsed without copying them first.
+    class MappedFile
+    {
+    protected:
+        const uint8_t* m_data;
+        size_t m_size;
+
+        // HANDLEs on Windows, a file descriptor and no mapping elsewhere.
+        intptr_t m_fileHandle;
+        void* m_mappingHandle;
+
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        bool open(const std::string& path);
+        void close();
+
+        const uint8_t* getData() const;
+        size_t getSize() const;
+    };
+}
+
+#endif // MAPPEDFILE_HEADER_GUARD
@@ -12,10 +12,12 @@
 #import <MetalPerformanceShaders/MetalPerformanceShaders.h>
 
 #import "MetalRenderer.h"
+#include "engine/GpuGeometryPacker.h"
 #include "engine/Renderer.h"
 #include "engine/Scene.h"
 #include "engine/Shader.h"
 #include "engine/Texture.h"
+#include "engine/CPU/CpuThreadPool.h"
 
 #include <fstream>
 #include <string>
@@ -82,6 +84,10 @@ static const size_t intersectionStride = sizeof(MPSIntersectionDistancePrimitive
     NSUInteger _uniformBufferIndex;
 
     unsigned int _frameIndex;
+    unsigned int _indexSize;
+    toyraygun::SceneLight _light;  // Shaders take a single area light, the scene's brightest.
+    uint32_t _lightFirstTriangle;
+    uint32_t _lightTriangleCount;
     
 @public
     toyraygun::MetalRenderer* _parent;
@@ -203,6 +209,20 @@ static const size_t intersectionStride = sizeof(MPSIntersectionDistancePrimitive
 
 - (void)loadScene:(toyraygun::Scene*)scene
 {
+    // One acceleration structure over every instance baked into world space.
+    toyraygun::CpuThreadPool threadPool;
+    threadPool.init();
+    scene->bakeInstances(&threadPool);
+
+    // No area light leaves the light black.
+    scene->buildLights();
+    _lightFirstTriangle = 0;
+    _lightTriangleCount = 0;
+    if (scene->getBrightestAreaLight(_light))
+    {
+        scene->getBakedTriangles(_light.instanceIndex, _lightFirstTriangle, _lightTriangleCount);
+    }
+
     _sem = dispatch_semaphore_create(maxFramesInFlight);
     
     [self createPipelines];
@@ -226,30 +246,28 @@ static const size_t intersectionStride = sizeof(MPSIntersectionDistancePrimitive
     
     _uniformBuffer = [_device newBufferWithLength:uniformBufferSize options:options];
 
-    // Convert 12-byte vec3s to 16-byte float3s for vertex positions.
-    float3* vertices = new float3[scene->m_vertexBuffer.size()];
-    for (int i = 0; i < scene->m_vertexBuffer.size(); ++i)
-    {
-        vertices[i] = { scene->m_vertexBuffer[i].x, scene->m_vertexBuffer[i].y, scene->m_vertexBuffer[i].z };
-    }
-    
-    // Allocate buffers for vertex positions, colors, and normals. Note that each vertex position is a
-    // float3, which is a 16 byte aligned type.
-    _vertexPositionBuffer = [_device newBufferWithLength:scene->m_vertexBuffer.size() * sizeof(float3) options:options];
-    _indexBuffer = [_device newBufferWithLength:scene->m_indexBuffer.size() * sizeof(uint32_t) options:options];
-    _vertexColorBuffer = [_device newBufferWithLength:scene->m_colorBuffer.size() * sizeof(bx::Vec3) options:options];
-    _vertexNormalBuffer = [_device newBufferWithLength:scene->m_normalBuffer.size() * sizeof(bx::Vec3) options:options];
-    _triangleMaskBuffer = [_device newBufferWithLength:scene->m_materialIDBuffer.size() * sizeof(uint32_t) options:options];
-    
-    // Copy vertex data into buffers
-    memcpy(_vertexPositionBuffer.contents, &vertices[0], _vertexPositionBuffer.length);
-    memcpy(_indexBuffer.contents, &scene->m_indexBuffer[0], _indexBuffer.length);
-    memcpy(_vertexColorBuffer.contents, &scene->m_colorBuffer[0], _vertexColorBuffer.length);
-    memcpy(_vertexNormalBuffer.contents, &scene->m_normalBuffer[0], _vertexNormalBuffer.length);
-    memcpy(_triangleMaskBuffer.contents, &scene->m_materialIDBuffer[0], _triangleMaskBuffer.length);;
-    
-    // Cleanup.
-    delete[] vertices;
+    toyraygun::GpuGeometryPacker packer;
+    packer.init(scene);
+    _indexSize = packer.getIndexSize();
+
+    // Positions are 16 byte float3s for the acceleration structure, colors and normals
+    // stay packed 12 byte vec3s. Each attribute has its own buffer.
+    const toyraygun::GpuVertexLayout positionLayout = { sizeof(float3), 0, -1, -1 };
+    const toyraygun::GpuVertexLayout colorLayout = { sizeof(bx::Vec3), -1, -1, 0 };
+    const toyraygun::GpuVertexLayout normalLayout = { sizeof(bx::Vec3), -1, 0, -1 };
+
+    _vertexPositionBuffer = [_device newBufferWithLength:packer.getVertexDataSize(positionLayout) options:options];
+    _indexBuffer = [_device newBufferWithLength:packer.getIndexDataSize() options:options];
+    _vertexColorBuffer = [_device newBufferWithLength:packer.getVertexDataSize(colorLayout) options:options];
+    _vertexNormalBuffer = [_device newBufferWithLength:packer.getVertexDataSize(normalLayout) options:options];
+    _triangleMaskBuffer = [_device newBufferWithLength:packer.getMaterialIDDataSize() options:options];
+    
+    // Packed straight into the buffers.
+    packer.packVertices(positionLayout, _vertexPositionBuffer.contents);
+    packer.packIndices(_indexBuffer.contents);
+    packer.packVertices(colorLayout, _vertexColorBuffer.contents);
+    packer.packVertices(normalLayout, _vertexNormalBuffer.contents);
+    packer.packMaterialIDs(_triangleMaskBuffer.contents);
     
     // When using managed buffers, we need to indicate that we modified the buffer so that the GPU
     // copy can be updated
@@ -273,8 +291,9 @@ static const size_t intersectionStride = sizeof(MPSIntersectionDistancePrimitive
     
     _accelerationStructure.vertexBuffer = _vertexPositionBuffer;
     _accelerationStructure.indexBuffer = _indexBuffer;
+    _accelerationStructure.indexType = (packer.getIndexFormat() == toyraygun::GpuIndexFormat::UInt16) ? MPSDataTypeUInt16 : MPSDataTypeUInt32;
     _accelerationStructure.maskBuffer = _triangleMaskBuffer;
-    _accelerationStructure.triangleCount = scene->m_indexBuffer.size() / 3;
+    _accelerationStructure.triangleCount = packer.getTriangleCount();
     
     [_accelerationStructure rebuild];
 }
@@ -352,15 +371,18 @@ static const size_t intersectionStride = sizeof(MPSIntersectionDistancePrimitive
     uniforms->camera.position.set(_parent->getCameraPosition());
     uniforms->camera.invViewProjMtx.set(invViewProjMtx);
     
-    uniforms->light.position.set(bx::Vec3(0.0f, 1.98f, 0.0f));
-    uniforms->light.forward.set(bx::Vec3(0.0f, -1.0f, 0.0f));
-    uniforms->light.right.set(bx::Vec3(0.25f, 0.0f, 0.0f));
-    uniforms->light.up.set(bx::Vec3(0.0f, 0.0f, 0.25f));
-    uniforms->light.color.set(bx::Vec3(1.0f, 1.0f, 1.0f));
+    uniforms->light.position.set(_light.position);
+    uniforms->light.forward.set(_light.normal);
+    uniforms->light.right.set(_light.edge0);
+    uniforms->light.up.set(_light.edge1);
+    uniforms->light.color.set(_light.color);
+    uniforms->lightFirstTriangle = _lightFirstTriangle;
+    uniforms->lightTriangleCount = _lightTriangleCount;
     
     uniforms->width = (unsigned int)_size.width;
     uniforms->height = (unsigned int)_size.height;
     uniforms->frameIndex = _frameIndex++;
+    uniforms->indexSize = _indexSize;
     
 #if !TARGET_OS_IPHONE
     [_uniformBuffer didModifyRange:NSMakeRange(_uniformBufferOffset, alignedUniformsSize)];
@@ -447,6 +469,7 @@ static const size_t intersectionStride = sizeof(MPSIntersectionDistancePrimitive
         [computeEncoder setBuffer:_vertexNormalBuffer offset:0                    atIndex:5];
         [computeEncoder setBuffer:_triangleMaskBuffer offset:0                    atIndex:6];
         [computeEncoder setBytes:&bounce              length:sizeof(bounce)       atIndex:7];
+        [computeEncoder setBuffer:_indexBuffer        offset:0                    atIndex:8];
         
         [computeEncoder setTexture:_randomTexture    atIndex:0];
         [computeEncoder setTexture:_renderTargets[0] atIndex:1];
@@ -0,0 +1,774 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#include "ObjLoader.h"
+#include "engine/MappedFile.h"
+#include "engine/Renderer.h"
+#include "engine/CPU/CpuThreadPool.h"
+using namespace toyraygun;
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string.h>
+#include <unordered_map>
+#include <utility>
+#include <bx/math.h>
+
+// Every thread gets a few chunks so one full of slow lines doesn't hold up the rest.
+static const size_t kMinChunkSize = 1024 * 1024;
+static const uint32_t kChunksPerThread = 4;
+
+static const uint32_t kInvalidIndex = 0xffffffff;
+
+// Color of faces without a material, the same white as the Cornell box.
+static const float kDefaultColor[3] = { 0.725f, 0.71f, 0.68f };
+
+struct ObjLoader::Chunk
+{
+    struct MaterialSwitch
+    {
+        uint32_t triangleIndex;
+        std::string name;
+    };
+
+    const char* begin;
+    const char* end;
+
+    std::vector<float> positions;
+    std::vector<float> normals;
+
+    // Position and normal index of every triangle corner, the normal is -1 if it has none.
+    std::vector<int32_t> corners;
+
+    // Corners that negative OBJ indices made relative to the start of the chunk.
+    std::vector<uint32_t> relativePositions;
+    std::vector<uint32_t> relativeNormals;
+
+    std::vector<MaterialSwitch> materialSwitches;
+    std::vector<std::string> materialLibraries;
+    uint32_t skippedLines;
+};
+
+static const double kPowersOfTen[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline bool isDigit(char c)
+{
+    return (unsigned)(c - '0') < 10;
+}
+
+static inline const char* skipSpaces(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+    {
+        ++p;
+    }
+    return p;
+}
+
+// Much faster than strtof since it doesn't deal with locales or round exactly, the
+// result can be off from the nearest float by one ulp. Up to 19 significant digits are
+// kept in an integer and scaled by a power of ten in double precision.
+static inline bool parseFloat(const char*& p, const char* end, float& out)
+{
+    p = skipSpaces(p, end);
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = (*p == '-');
+        ++p;
+    }
+
+    uint64_t mantissa = 0;
+    int32_t exponent = 0;
+    uint32_t digitCount = 0;
+    bool anyDigits = false;
+
+    for (; p < end && isDigit(*p); ++p)
+    {
+        anyDigits = true;
+        if (digitCount < 19)
+        {
+            mantissa = (mantissa * 10) + (*p - '0');
+            digitCount += (mantissa != 0) ? 1 : 0;
+        }
+        else
+        {
+            exponent++;
+        }
+    }
+
+    if (p < end && *p == '.')
+    {
+        for (++p; p < end && isDigit(*p); ++p)
+        {
+            anyDigits = true;
+            if (digitCount < 19)
+            {
+                mantissa = (mantissa * 10) + (*p - '0');
+                digitCount += (mantissa != 0) ? 1 : 0;
+                exponent--;
+            }
+        }
+    }
+
+    if (!anyDigits)
+    {
+        return false;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char* exponentStart = ++p;
+        bool negativeExponent = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negativeExponent = (*p == '-');
+            ++p;
+        }
+
+        int32_t value = 0;
+        for (; p < end && isDigit(*p); ++p)
+        {
+            value = bx::min(value * 10 + (*p - '0'), 1000);
+        }
+
+        if (p == exponentStart)
+        {
+            return false;
+        }
+
+        exponent += negativeExponent ? -value : value;
+    }
+
+    double value = (double)mantissa;
+    for (; exponent > 22; exponent -= 22)
+    {
+        value *= 1e22;
+    }
+    for (; exponent < -22; exponent += 22)
+    {
+        value /= 1e22;
+    }
+    value = (exponent >= 0) ? (value * kPowersOfTen[exponent]) : (value / kPowersOfTen[-exponent]);
+
+    out = (float)(negative ? -value : value);
+    return true;
+}
+
+static inline bool parseInt(const char*& p, const char* end, int32_t& out)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = (*p == '-');
+        ++p;
+    }
+
+    if (p >= end || !isDigit(*p))
+    {
+        return false;
+    }
+
+    int64_t value = 0;
+    for (; p < end && isDigit(*p); ++p)
+    {
+        value = bx::min<int64_t>(value * 10 + (*p - '0'), INT32_MAX);
+    }
+
+    out = (int32_t)(negative ? -value : value);
+    return true;
+}
+
+// Rest of the line without surrounding whitespace.
+static inline std::string parseName(const char* p, const char* end)
+{
+    p = skipSpaces(p, end);
+    while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+    {
+        --end;
+    }
+    return std::string(p, end);
+}
+
+static inline bool startsWith(const char* p, const char* end, const char* keyword)
+{
+    const size_t length = strlen(keyword);
+    return (size_t)(end - p) > length && memcmp(p, keyword, length) == 0 && (p[length] == ' ' || p[length] == '\t');
+}
+
+ObjLoader::ObjLoader() :
+    m_loadTimeMs(0.0f),
+    m_parseTimeMs(0.0f),
+    m_fileSize(0),
+    m_threadCount(0)
+{
+
+}
+
+void ObjLoader::parseChunk(Chunk& chunk)
+{
+    struct Corner
+    {
+        int32_t position;
+        int32_t normal;
+        bool relativePosition;
+        bool relativeNormal;
+    };
+
+    std::vector<Corner> face;
+
+    // Corners go out as first, previous, current to fan triangulate.
+    auto emitCorner = [&](const Corner& corner)
+    {
+        if (corner.relativePosition)
+        {
+            chunk.relativePositions.push_back((uint32_t)chunk.corners.size());
+        }
+        if (corner.relativeNormal)
+        {
+            chunk.relativeNormals.push_back((uint32_t)chunk.corners.size() + 1);
+        }
+
+        chunk.corners.push_back(corner.position);
+        chunk.corners.push_back(corner.normal);
+    };
+
+    const char* p = chunk.begin;
+    while (p < chunk.end)
+    {
+        const char* lineEnd = (const char*)memchr(p, '\n', chunk.end - p);
+        if (lineEnd == nullptr)
+        {
+            lineEnd = chunk.end;
+        }
+
+        p = skipSpaces(p, lineEnd);
+
+        if (p + 1 < lineEnd && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            float position[3];
+            const char* value = p + 1;
+            if (parseFloat(value, lineEnd, position[0]) && parseFloat(value, lineEnd, position[1]) && parseFloat(value, lineEnd, position[2]))
+            {
+                chunk.positions.insert(chunk.positions.end(), position, position + 3);
+            }
+            else
+            {
+                chunk.skippedLines++;
+            }
+        }
+        else if (startsWith(p, lineEnd, "vn"))
+        {
+            float normal[3];
+            const char* value = p + 2;
+            if (parseFloat(value, lineEnd, normal[0]) && parseFloat(value, lineEnd, normal[1]) && parseFloat(value, lineEnd, normal[2]))
+            {
+                chunk.normals.insert(chunk.normals.end(), normal, normal + 3);
+            }
+            else
+            {
+                chunk.skippedLines++;
+            }
+        }
+        else if (p + 1 < lineEnd && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            // v, v/vt, v//vn or v/vt/vn for each corner.
+            const int32_t positionCount = (int32_t)(chunk.positions.size() / 3);
+            const int32_t normalCount = (int32_t)(chunk.normals.size() / 3);
+
+            face.clear();
+            bool valid = true;
+
+            const char* value = p + 1;
+            while (true)
+            {
+                value = skipSpaces(value, lineEnd);
+                if (value >= lineEnd || *value == '\r' || *value == '#')
+                {
+                    break;
+                }
+
+                int32_t position = 0;
+                int32_t texCoord = 0;
+                int32_t normal = 0;
+
+                valid = parseInt(value, lineEnd, position) && position != 0;
+                if (valid && value < lineEnd && *value == '/')
+                {
+                    ++value;
+                    if (value < lineEnd && *value != '/')
+                    {
+                        valid = parseInt(value, lineEnd, texCoord);
+                    }
+                    if (valid && value < lineEnd && *value == '/')
+                    {
+                        ++value;
+                        valid = parseInt(value, lineEnd, normal) && normal != 0;
+                    }
+                }
+
+                if (!valid)
+                {
+                    break;
+                }
+
+                // Positive indices count from the start of the file, negative ones back
+                // from the last vertex, which is only known in this chunk so far.
+                Corner corner;
+                corner.relativePosition = (position < 0);
+                corner.position = (position > 0) ? (position - 1) : (positionCount + position);
+                corner.relativeNormal = (normal < 0);
+                corner.normal = (normal > 0) ? (normal - 1) : ((normal < 0) ? (normalCount + normal) : -1);
+                face.push_back(corner);
+            }
+
+            if (valid && face.size() >= 3)
+            {
+                for (size_t i = 2; i < face.size(); ++i)
+                {
+                    emitCorner(face[0]);
+                    emitCorner(face[i - 1]);
+                    emitCorner(face[i]);
+                }
+            }
+            else
+            {
+                chunk.skippedLines++;
+            }
+        }
+        else if (startsWith(p, lineEnd, "usemtl"))
+        {
+            Chunk::MaterialSwitch materialSwitch;
+            materialSwitch.triangleIndex = (uint32_t)(chunk.corners.size() / 6);
+            materialSwitch.name = parseName(p + 6, lineEnd);
+            chunk.materialSwitches.push_back(materialSwitch);
+        }
+        else if (startsWith(p, lineEnd, "mtllib"))
+        {
+            chunk.materialLibraries.push_back(parseName(p + 6, lineEnd));
+        }
+
+        // Anything else (comments, vt, groups, smoothing groups, lines) isn't used.
+        p = lineEnd + 1;
+    }
+}
+
+void ObjLoader::loadMaterialLibrary(const std::string& path)
+{
+    MappedFile file;
+    if (!file.open(path))
+    {
+        std::cout << "OBJ: couldn't open material library " << path << std::endl;
+        return;
+    }
+
+    const char* p = (const char*)file.getData();
+    const char* end = p + file.getSize();
+
+    Material* material = nullptr;
+    float emission[3] = { 0.0f, 0.0f, 0.0f };
+
+    // Emissive materials take their color from Ke, it's only known once the material ends.
+    auto finishMaterial = [&]()
+    {
+        if (material != nullptr && (emission[0] > 0.0f || emission[1] > 0.0f || emission[2] > 0.0f))
+        {
+            memcpy(material->color, emission, sizeof(emission));
+            material->materialID = MATERIAL_EMISSIVE;
+        }
+    };
+
+    while (p < end)
+    {
+        const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+        if (lineEnd == nullptr)
+        {
+            lineEnd = end;
+        }
+
+        p = skipSpaces(p, lineEnd);
+
+        if (startsWith(p, lineEnd, "newmtl"))
+        {
+            finishMaterial();
+
+            Material newMaterial;
+            newMaterial.name = parseName(p + 6, lineEnd);
+            memcpy(newMaterial.color, kDefaultColor, sizeof(kDefaultColor));
+            newMaterial.materialID = MATERIAL_DEFAULT;
+
+            m_materials.push_back(newMaterial);
+            material = &m_materials.back();
+            emission[0] = emission[1] = emission[2] = 0.0f;
+        }
+        else if (material != nullptr && (startsWith(p, lineEnd, "Kd") || startsWith(p, lineEnd, "Ke")))
+        {
+            float* color = (p[1] == 'd') ? material->color : emission;
+            const char* value = p + 2;
+            float rgb[3];
+            if (parseFloat(value, lineEnd, rgb[0]))
+            {
+                // A single value is grey.
+                rgb[1] = rgb[2] = rgb[0];
+                if (parseFloat(value, lineEnd, rgb[1]))
+                {
+                    parseFloat(value, lineEnd, rgb[2]);
+                }
+                memcpy(color, rgb, sizeof(rgb));
+            }
+        }
+
+        p = lineEnd + 1;
+    }
+
+    finishMaterial();
+}
+
+uint32_t ObjLoader::findMaterial(const std::string& name)
+{
+    for (uint32_t i = 0; i < (uint32_t)m_materials.size(); ++i)
+    {
+        if (m_materials[i].name == name)
+        {
+            return i;
+        }
+    }
+
+    std::cout << "OBJ: material " << name << " not found, using the default." << std::endl;
+
+    // Added under its name so it's only reported once.
+    Material material = m_materials[0];
+    material.name = name;
+    m_materials.push_back(material);
+    return (uint32_t)(m_materials.size() - 1);
+}
+
+bool ObjLoader::load(const std::string& path, Scene* scene, uint32_t threadCount)
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    MappedFile file;
+    if (!file.open(path))
+    {
+        std::cout << "OBJ: couldn't open " << path << std::endl;
+        return false;
+    }
+
+    CpuThreadPool threadPool;
+    threadPool.init(threadCount);
+    m_threadCount = threadPool.getThreadCount();
+    m_fileSize = file.getSize();
+
+    // Split the file at line breaks.
+    const char* data = (const char*)file.getData();
+    const char* dataEnd = data + file.getSize();
+    const size_t chunkSize = bx::max(kMinChunkSize, file.getSize() / (m_threadCount * kChunksPerThread) + 1);
+
+    std::vector<Chunk> chunks;
+    for (const char* p = data; p < dataEnd;)
+    {
+        const char* chunkEnd = p + bx::min<size_t>(chunkSize, dataEnd - p);
+        if (chunkEnd < dataEnd)
+        {
+            const char* lineEnd = (const char*)memchr(chunkEnd - 1, '\n', dataEnd - (chunkEnd - 1));
+            chunkEnd = (lineEnd != nullptr) ? (lineEnd + 1) : dataEnd;
+        }
+
+        Chunk chunk;
+        chunk.begin = p;
+        chunk.end = chunkEnd;
+        chunk.skippedLines = 0;
+        chunks.push_back(chunk);
+
+        p = chunkEnd;
+    }
+
+    const uint32_t chunkCount = (uint32_t)chunks.size();
+    threadPool.parallelFor(chunkCount, 1, [&](uint32_t start, uint32_t end, uint32_t threadIndex)
+    {
+        for (uint32_t i = start; i < end; ++i)
+        {
+            parseChunk(chunks[i]);
+        }
+    });
+
+    m_parseTimeMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+    // Where each chunk's vertices start in the whole file.
+    std::vector<uint32_t> positionOffsets(chunkCount);
+    std::vector<uint32_t> normalOffsets(chunkCount);
+    uint32_t positionCount = 0;
+    uint32_t normalCount = 0;
+    uint32_t skippedLines = 0;
+    for (uint32_t i = 0; i < chunkCount; ++i)
+    {
+        positionOffsets[i] = positionCount;
+        normalOffsets[i] = normalCount;
+        positionCount += (uint32_t)(chunks[i].positions.size() / 3);
+        normalCount += (uint32_t)(chunks[i].normals.size() / 3);
+        skippedLines += chunks[i].skippedLines;
+    }
+
+    std::vector<float> positions(positionCount * 3);
+    std::vector<float> normals(normalCount * 3);
+
+    threadPool.parallelFor(chunkCount, 1, [&](uint32_t start, uint32_t end, uint32_t threadIndex)
+    {
+        for (uint32_t i = start; i < end; ++i)
+        {
+            Chunk& chunk = chunks[i];
+            if (!chunk.positions.empty())
+            {
+                memcpy(&positions[positionOffsets[i] * 3], &chunk.positions[0], chunk.positions.size() * sizeof(float));
+            }
+            if (!chunk.normals.empty())
+            {
+                memcpy(&normals[normalOffsets[i] * 3], &chunk.normals[0], chunk.normals.size() * sizeof(float));
+            }
+
+            for (size_t j = 0; j < chunk.relativePositions.size(); ++j)
+            {
+                chunk.corners[chunk.relativePositions[j]] += (int32_t)positionOffsets[i];
+            }
+            for (size_t j = 0; j < chunk.relativeNormals.size(); ++j)
+            {
+                chunk.corners[chunk.relativeNormals[j]] += (int32_t)normalOffsets[i];
+            }
+
+            std::vector<float>().swap(chunk.positions);
+            std::vector<float>().swap(chunk.normals);
+        }
+    });
+
+    // Materials, the first one is for faces before any usemtl.
+    m_materials.clear();
+    Material defaultMaterial;
+    memcpy(defaultMaterial.color, kDefaultColor, sizeof(kDefaultColor));
+    defaultMaterial.materialID = MATERIAL_DEFAULT;
+    m_materials.push_back(defaultMaterial);
+
+    const size_t directoryEnd = path.find_last_of("/\\");
+    const std::string directory = (directoryEnd != std::string::npos) ? path.substr(0, directoryEnd + 1) : std::string();
+
+    std::vector<std::string> loadedLibraries;
+    for (uint32_t i = 0; i < chunkCount; ++i)
+    {
+        for (size_t j = 0; j < chunks[i].materialLibraries.size(); ++j)
+        {
+            const std::string& library = chunks[i].materialLibraries[j];
+            if (std::find(loadedLibraries.begin(), loadedLibraries.end(), library) == loadedLibraries.end())
+            {
+                loadedLibraries.push_back(library);
+                loadMaterialLibrary(directory + library);
+            }
+        }
+    }
+
+    // Runs of triangles with the same material, the material carries over from the
+    // previous chunk until the first usemtl in a chunk.
+    struct Run
+    {
+        uint32_t chunk;
+        uint32_t firstTriangle;
+        uint32_t endTriangle;
+    };
+
+    std::vector<std::vector<Run>> materialRuns(m_materials.size());
+    uint32_t currentMaterial = 0;
+    for (uint32_t i = 0; i < chunkCount; ++i)
+    {
+        const Chunk& chunk = chunks[i];
+        const uint32_t triangleCount = (uint32_t)(chunk.corners.size() / 6);
+
+        uint32_t firstTriangle = 0;
+        for (size_t j = 0; j <= chunk.materialSwitches.size(); ++j)
+        {
+            const uint32_t endTriangle = (j < chunk.materialSwitches.size()) ? chunk.materialSwitches[j].triangleIndex : triangleCount;
+            if (endTriangle > firstTriangle)
+            {
+                Run run = { i, firstTriangle, endTriangle };
+                materialRuns[currentMaterial].push_back(run);
+            }
+
+            if (j < chunk.materialSwitches.size())
+            {
+                currentMaterial = findMaterial(chunk.materialSwitches[j].name);
+                materialRuns.resize(m_materials.size());
+                firstTriangle = endTriangle;
+            }
+        }
+    }
+
+    // One mesh per material. Corners with the same position and normal share a vertex,
+    // the first normal seen for a position is looked up directly and the rare others
+    // through a hash map.
+    std::vector<uint32_t> positionVertices(positionCount, kInvalidIndex);
+    std::unordered_map<uint64_t, uint32_t> splitVertices;
+    uint32_t triangleCount = 0;
+    uint32_t invalidTriangles = 0;
+    uint32_t meshCount = 0;
+
+    float identity[16];
+    bx::mtxIdentity(identity);
+
+    for (uint32_t materialIndex = 0; materialIndex < (uint32_t)m_materials.size(); ++materialIndex)
+    {
+        const std::vector<Run>& runs = materialRuns[materialIndex];
+        if (runs.empty())
+        {
+            continue;
+        }
+
+        const Material& material = m_materials[materialIndex];
+        const bx::Vec3 color(material.color[0], material.color[1], material.color[2]);
+
+        uint32_t runTriangles = 0;
+        for (size_t r = 0; r < runs.size(); ++r)
+        {
+            runTriangles += runs[r].endTriangle - runs[r].firstTriangle;
+        }
+
+        // Can't have more vertices than corners or than the whole file has.
+        const size_t maxVertices = bx::min<size_t>(positionCount, runTriangles * 3);
+
+        SceneMesh mesh;
+        mesh.vertexBuffer.reserve(maxVertices);
+        mesh.normalBuffer.reserve(maxVertices);
+        mesh.colorBuffer.reserve(maxVertices);
+        mesh.indexBuffer.reserve(runTriangles * 3);
+        mesh.materialIDBuffer.reserve(runTriangles);
+
+        std::vector<uint32_t> vertexPositions;
+        std::vector<int32_t> vertexNormals;
+        vertexPositions.reserve(maxVertices);
+        vertexNormals.reserve(maxVertices);
+        bool smoothNormals = false;
+
+        auto getVertex = [&](int32_t position, int32_t normal)
+        {
+            uint32_t& vertex = positionVertices[position];
+            if (vertex != kInvalidIndex && vertexNormals[vertex] == normal)
+            {
+                return vertex;
+            }
+
+            const uint32_t newVertex = (uint32_t)mesh.vertexBuffer.size();
+            if (vertex != kInvalidIndex)
+            {
+                auto result = splitVertices.insert(std::make_pair((uint64_t(position) << 32) | uint32_t(normal), newVertex));
+                if (!result.second)
+                {
+                    return result.first->second;
+                }
+            }
+            else
+            {
+                vertex = newVertex;
+            }
+
+            const float* p = &positions[position * 3];
+            mesh.vertexBuffer.push_back(bx::Vec3(p[0], p[1], p[2]));
+            mesh.normalBuffer.push_back((normal >= 0) ? bx::Vec3(normals[normal * 3], normals[normal * 3 + 1], normals[normal * 3 + 2]) : bx::Vec3(0.0f, 0.0f, 0.0f));
+            mesh.colorBuffer.push_back(color);
+            vertexPositions.push_back(position);
+            vertexNormals.push_back(normal);
+            return newVertex;
+        };
+
+        for (size_t r = 0; r < runs.size(); ++r)
+        {
+            const Run& run = runs[r];
+            const int32_t* corners = &chunks[run.chunk].corners[run.firstTriangle * 6];
+
+            for (uint32_t t = run.firstTriangle; t < run.endTriangle; ++t, corners += 6)
+            {
+                bool valid = true;
+                for (int j = 0; j < 3; ++j)
+                {
+                    valid &= (corners[j * 2] >= 0 && corners[j * 2] < (int32_t)positionCount);
+                    valid &= (corners[j * 2 + 1] >= -1 && corners[j * 2 + 1] < (int32_t)normalCount);
+                }
+
+                if (!valid)
+                {
+                    invalidTriangles++;
+                    continue;
+                }
+
+                uint32_t idx[3];
+                for (int j = 0; j < 3; ++j)
+                {
+                    idx[j] = getVertex(corners[j * 2], corners[j * 2 + 1]);
+                    mesh.indexBuffer.push_back(idx[j]);
+                }
+                mesh.materialIDBuffer.push_back(material.materialID);
+
+                // Vertices without a normal get the area weighted average of their faces'.
+                if (corners[1] < 0 || corners[3] < 0 || corners[5] < 0)
+                {
+                    const bx::Vec3 faceNormal = bx::cross(bx::sub(mesh.vertexBuffer[idx[1]], mesh.vertexBuffer[idx[0]]),
+                                                          bx::sub(mesh.vertexBuffer[idx[2]], mesh.vertexBuffer[idx[0]]));
+                    for (int j = 0; j < 3; ++j)
+                    {
+                        if (corners[j * 2 + 1] < 0)
+                        {
+                            mesh.normalBuffer[idx[j]] = bx::add(mesh.normalBuffer[idx[j]], faceNormal);
+                        }
+                    }
+                    smoothNormals = true;
+                }
+            }
+        }
+
+        for (size_t v = 0; v < vertexPositions.size(); ++v)
+        {
+            positionVertices[vertexPositions[v]] = kInvalidIndex;
+
+            if (smoothNormals && vertexNormals[v] < 0)
+            {
+                const float length = bx::length(mesh.normalBuffer[v]);
+                mesh.normalBuffer[v] = (length > 0.0f) ? bx::mul(mesh.normalBuffer[v], 1.0f / length) : bx::Vec3(0.0f, 1.0f, 0.0f);
+            }
+        }
+        splitVertices.clear();
+
+        if (mesh.indexBuffer.empty())
+        {
+            continue;
+        }
+
+        triangleCount += (uint32_t)mesh.materialIDBuffer.size();
+        scene->addInstance(scene->addMesh(std::move(mesh)), identity);
+        meshCount++;
+    }
+
+    m_loadTimeMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+    std::cout << "OBJ: " << path << ", " << (m_fileSize / (1024.0f * 1024.0f)) << " MB in " << m_loadTimeMs << " ms ("
+              << getThroughputMBs() << " MB/s, parsed in " << m_parseTimeMs << " ms on " << m_threadCount << " threads), "
+              << positionCount << " vertices, " << triangleCount << " triangles, " << meshCount << " meshes." << std::endl;
+
+    if (skippedLines > 0 || invalidTriangles > 0)
+    {
+        std::cout << "OBJ: skipped " << skippedLines << " malformed lines and " << invalidTriangles << " triangles with out of range indices." << std::endl;
+    }
+
+    return true;
+}
+
+float ObjLoader::getLoadTimeMs() const
+{
+    return m_loadTimeMs;
+}
+
+float ObjLoader::getThroughputMBs() const
+{
+    return (m_loadTimeMs > 0.0f) ? ((m_fileSize / (1024.0f * 1024.0f)) / (m_loadTimeMs / 1000.0f)) : 0.0f;
+}
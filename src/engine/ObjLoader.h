@@ -0,0 +1,61 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#ifndef OBJLOADER_HEADER_GUARD
+#define OBJLOADER_HEADER_GUARD
+
+#include "engine/Scene.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace toyraygun
+{
+    class CpuThreadPool;
+
+    // Loads Wavefront OBJ files into a Scene. The file is memory mapped, split into chunks
+    // at line breaks and the chunks are parsed in parallel, then merged into one mesh per
+    // material with an identity instance each.
+    //
+    // Faces are fan triangulated. Vertex normals are used when the file has them and
+    // smoothed from the faces otherwise. Materials come from the mtllib files next to
+    // the OBJ: Kd is the color, a non zero Ke makes the material MATERIAL_EMISSIVE.
+    class ObjLoader
+    {
+    protected:
+        struct Material
+        {
+            std::string name;
+            float color[3];
+            uint32_t materialID;
+        };
+
+        struct Chunk;
+
+        std::vector<Material> m_materials;
+
+        // Stats
+        float m_loadTimeMs;
+        float m_parseTimeMs;
+        uint64_t m_fileSize;
+        uint32_t m_threadCount;
+
+        void parseChunk(Chunk& chunk);
+        void loadMaterialLibrary(const std::string& path);
+        uint32_t findMaterial(const std::string& name);
+
+    public:
+        ObjLoader();
+
+        // Zero threads uses one per hardware thread.
+        bool load(const std::string& path, Scene* scene, uint32_t threadCount = 0);
+
+        float getLoadTimeMs() const;
+        float getThroughputMBs() const;
+    };
+}
+
+#endif // OBJLOADER_HEADER_GUARD
@@ -36,6 +36,11 @@ void Renderer::loadScene(Scene* scene)
 
 }
 
+void Renderer::updateScene(Scene* scene)
+{
+    scene->clearDirtyInstances();
+}
+
 void Renderer::addShader(Shader* shader)
 {
     m_shaders.push_back(shader);
@@ -43,6 +43,10 @@ namespace toyraygun
         virtual bool init();
         virtual void destroy();
         virtual void loadScene(Scene* scene);
+
+        // Picks up instances moved since the scene was loaded or last updated. Backends
+        // that can't update in place keep rendering the scene as it was loaded.
+        virtual void updateScene(Scene* scene);
         virtual void renderFrame();
 
         // Camera
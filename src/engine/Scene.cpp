@@ -5,11 +5,26 @@
 
 #include "Scene.h"
 #include "engine/Renderer.h"
+#include "engine/CPU/CpuThreadPool.h"
 using namespace toyraygun;
 
 #include <iostream>
+#include <string.h>
+#include <utility>
 #include <bx/math.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Entries in the simulated post transform vertex cache, a FIFO like most GPUs use.
+static const uint32_t kVertexCacheSize = 16;
+
+// Baked scenes smaller than this aren't worth starting threads for.
+static const size_t kMinParallelBakeVertices = 64 * 1024;
+// Vertices and triangles baked by one task.
+static const size_t kBakeChunkSize = 16 * 1024;
+
 static bx::Vec3 cubeVertices[] = {
     bx::Vec3(-0.5f, -0.5f, -0.5f),
     bx::Vec3( 0.5f, -0.5f, -0.5f),
@@ -21,109 +36,777 @@ static bx::Vec3 cubeVertices[] = {
     bx::Vec3( 0.5f,  0.5f,  0.5f),
 };
 
-void Scene::addCube(bx::Vec3 color, float* transformMtx)
-{
-    bx::Vec3 verts[] = {
-        cubeVertices[0],
-        cubeVertices[1],
-        cubeVertices[2],
-        cubeVertices[3],
-        cubeVertices[4],
-        cubeVertices[5],
-        cubeVertices[6],
-        cubeVertices[7]
-    };
-    
-    uint32_t tris[] = {
-        0, 4, 6,
-        0, 6, 2,
-        
-        1, 3, 7,
-        1, 7, 5,
-        
-        0, 1, 5,
-        0, 5, 4,
-        
-        2, 6, 7,
-        2, 7, 3,
-        
-        0, 2, 3,
-        0, 3, 1,
-        
-        4, 5, 7,
-        4, 7, 6
-    };
-    
-    addGeometry(verts, tris, 12, transformMtx, color, MATERIAL_DEFAULT);
+static uint32_t cubeIndices[] = {
+    0, 4, 6,
+    0, 6, 2,
+
+    1, 3, 7,
+    1, 7, 5,
+
+    0, 1, 5,
+    0, 5, 4,
+
+    2, 6, 7,
+    2, 7, 3,
+
+    0, 2, 3,
+    0, 3, 1,
+
+    4, 5, 7,
+    4, 7, 6
+};
+
+static bx::Vec3 planeVertices[] = {
+    cubeVertices[0],
+    cubeVertices[1],
+    cubeVertices[5],
+    cubeVertices[4]
+};
+
+static uint32_t planeIndices[] = {
+    0, 2, 1,
+    0, 3, 2,
+};
+
+SceneLight::SceneLight() :
+    type(SceneLightType::Triangle),
+    position(bx::init::Zero),
+    edge0(bx::init::Zero),
+    edge1(bx::init::Zero),
+    normal(bx::init::Zero),
+    color(bx::init::Zero),
+    area(0.0f),
+    pdf(0.0f),
+    instanceIndex(0),
+    primitiveIndex(UINT32_MAX)
+{
+
 }
 
-void Scene::addPlane(bx::Vec3 color, float* transformMtx)
+Scene::Scene() :
+    m_weldVertices(false)
 {
-    bx::Vec3 verts[] = {
-        cubeVertices[0],
-        cubeVertices[1],
-        cubeVertices[5],
-        cubeVertices[4]
-    };
-    
-    uint32_t tris[] = {
-        0, 2, 1,
-        0, 3, 2,
-    };
-    
-    addGeometry(verts, tris, 2, transformMtx, color, MATERIAL_DEFAULT);
+
 }
 
-void Scene::addAreaLight(bx::Vec3 color, float* transformMtx)
+bool Scene::VertexKey::operator==(const VertexKey& other) const
 {
-    bx::Vec3 verts[] = {
-        cubeVertices[0],
-        cubeVertices[1],
-        cubeVertices[5],
-        cubeVertices[4]
-    };
-    
-    uint32_t tris[] = {
-        0, 2, 1,
-        0, 3, 2,
+    return memcmp(bits, other.bits, sizeof(bits)) == 0;
+}
+
+size_t Scene::VertexKeyHash::operator()(const VertexKey& key) const
+{
+    // FNV-1a over the 9 words.
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 9; ++i)
+    {
+        hash = (hash ^ key.bits[i]) * 16777619u;
+    }
+    return hash;
+}
+
+void Scene::setVertexWelding(bool enabled)
+{
+    m_weldVertices = enabled;
+}
+
+bool Scene::getVertexWelding() const
+{
+    return m_weldVertices;
+}
+
+uint32_t Scene::getShapeMesh(Shape shape, bx::Vec3 color, unsigned int materialID)
+{
+    for (size_t i = 0; i < m_shapeMeshes.size(); ++i)
+    {
+        const ShapeMesh& shapeMesh = m_shapeMeshes[i];
+        if (shapeMesh.shape == shape && shapeMesh.materialID == materialID &&
+            shapeMesh.color[0] == color.x && shapeMesh.color[1] == color.y && shapeMesh.color[2] == color.z)
+        {
+            return shapeMesh.meshID;
+        }
+    }
+
+    ShapeMesh shapeMesh;
+    shapeMesh.shape = shape;
+    shapeMesh.color[0] = color.x;
+    shapeMesh.color[1] = color.y;
+    shapeMesh.color[2] = color.z;
+    shapeMesh.materialID = materialID;
+
+    if (shape == SHAPE_CUBE)
+    {
+        shapeMesh.meshID = addMesh(cubeVertices, cubeIndices, 12, color, materialID);
+    }
+    else
+    {
+        shapeMesh.meshID = addMesh(planeVertices, planeIndices, 2, color, materialID);
+    }
+
+    m_shapeMeshes.push_back(shapeMesh);
+    return shapeMesh.meshID;
+}
+
+uint32_t Scene::addCube(bx::Vec3 color, float* transformMtx)
+{
+    return addInstance(getShapeMesh(SHAPE_CUBE, color, MATERIAL_DEFAULT), transformMtx);
+}
+
+uint32_t Scene::addPlane(bx::Vec3 color, float* transformMtx)
+{
+    return addInstance(getShapeMesh(SHAPE_PLANE, color, MATERIAL_DEFAULT), transformMtx);
+}
+
+uint32_t Scene::addAreaLight(bx::Vec3 color, float* transformMtx)
+{
+    return addInstance(getShapeMesh(SHAPE_PLANE, color, MATERIAL_EMISSIVE), transformMtx);
+}
+
+// Same operation order as bx::vec4MulMtx so baked scenes match the old ones exactly.
+static bx::Vec3 transformPoint(const bx::Vec3& input, const float* transform)
+{
+    return bx::Vec3(input.x * transform[0] + input.y * transform[1] + input.z * transform[2] + transform[3],
+                    input.x * transform[4] + input.y * transform[5] + input.z * transform[6] + transform[7],
+                    input.x * transform[8] + input.y * transform[9] + input.z * transform[10] + transform[11]);
+}
+
+// Normals go through the inverse transpose, which is the cofactor matrix scaled by one
+// over the determinant. Only the sign of the scale matters before normalizing. Written
+// as a 3x4 transform with no translation so normals can share the point kernels.
+static void getNormalTransform(const float* transform, float* normalTransformOut)
+{
+    const bx::Vec3 row0(transform[0], transform[1], transform[2]);
+    const bx::Vec3 row1(transform[4], transform[5], transform[6]);
+    const bx::Vec3 row2(transform[8], transform[9], transform[10]);
+
+    const float sign = (bx::dot(row0, bx::cross(row1, row2)) < 0.0f) ? -1.0f : 1.0f;
+    const bx::Vec3 cofactors[3] = {
+        bx::mul(bx::cross(row1, row2), sign),
+        bx::mul(bx::cross(row2, row0), sign),
+        bx::mul(bx::cross(row0, row1), sign),
     };
-    
-    addGeometry(verts, tris, 2, transformMtx, color, MATERIAL_EMISSIVE);
+
+    for (int row = 0; row < 3; ++row)
+    {
+        normalTransformOut[(row * 4) + 0] = cofactors[row].x;
+        normalTransformOut[(row * 4) + 1] = cofactors[row].y;
+        normalTransformOut[(row * 4) + 2] = cofactors[row].z;
+        normalTransformOut[(row * 4) + 3] = 0.0f;
+    }
+}
+
+static bx::Vec3 transformNormal(const bx::Vec3& normal, const float* normalTransform)
+{
+    return bx::normalize(transformPoint(normal, normalTransform));
+}
+
+#if defined(__AVX2__)
+// Eight packed Vec3s are three registers of x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3, with
+// points 0-3 in the low lanes and 4-7 in the high ones. Shuffles work per lane so this
+// is the usual four wide transpose done twice at once.
+static inline void loadVec3x8(const bx::Vec3* input, __m256& x, __m256& y, __m256& z)
+{
+    const float* values = &input[0].x;
+    const __m256 a = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(values + 0)), _mm_loadu_ps(values + 12), 1);
+    const __m256 b = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(values + 4)), _mm_loadu_ps(values + 16), 1);
+    const __m256 c = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(values + 8)), _mm_loadu_ps(values + 20), 1);
+
+    x = _mm256_shuffle_ps(_mm256_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 0, 0)), _mm256_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+    y = _mm256_shuffle_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm256_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+    z = _mm256_shuffle_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm256_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
 }
 
-bx::Vec3 applyTransform(bx::Vec3 input, float* transformMtx, float w)
+static inline void storeVec3x8(bx::Vec3* output, __m256 x, __m256 y, __m256 z)
 {
-    float point[4] = { input.x, input.y, input.z, w };
-    float transformedPoint[4];
-    bx::vec4MulMtx(transformedPoint, point, transformMtx);
-    return bx::Vec3(transformedPoint[0], transformedPoint[1], transformedPoint[2]);
+    const __m256 a = _mm256_shuffle_ps(_mm256_shuffle_ps(x, y, _MM_SHUFFLE(0, 0, 0, 0)), _mm256_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+    const __m256 b = _mm256_shuffle_ps(_mm256_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)), _mm256_shuffle_ps(x, y, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+    const __m256 c = _mm256_shuffle_ps(_mm256_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)), _mm256_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+
+    float* values = &output[0].x;
+    _mm_storeu_ps(values + 0, _mm256_castps256_ps128(a));
+    _mm_storeu_ps(values + 4, _mm256_castps256_ps128(b));
+    _mm_storeu_ps(values + 8, _mm256_castps256_ps128(c));
+    _mm_storeu_ps(values + 12, _mm256_extractf128_ps(a, 1));
+    _mm_storeu_ps(values + 16, _mm256_extractf128_ps(b, 1));
+    _mm_storeu_ps(values + 20, _mm256_extractf128_ps(c, 1));
+}
+
+// No FMA so the results round exactly like transformPoint's.
+static inline void transformVec3x8(const float* transform, __m256& x, __m256& y, __m256& z)
+{
+    __m256 result[3];
+    for (int row = 0; row < 3; ++row)
+    {
+        const float* m = &transform[row * 4];
+        __m256 value = _mm256_mul_ps(x, _mm256_set1_ps(m[0]));
+        value = _mm256_add_ps(value, _mm256_mul_ps(y, _mm256_set1_ps(m[1])));
+        value = _mm256_add_ps(value, _mm256_mul_ps(z, _mm256_set1_ps(m[2])));
+        result[row] = _mm256_add_ps(value, _mm256_set1_ps(m[3]));
+    }
+
+    x = result[0];
+    y = result[1];
+    z = result[2];
 }
+#endif
+
+static void transformPoints(const bx::Vec3* input, bx::Vec3* output, size_t count, const float* transform)
+{
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 x, y, z;
+        loadVec3x8(&input[i], x, y, z);
+        transformVec3x8(transform, x, y, z);
+        storeVec3x8(&output[i], x, y, z);
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        output[i] = transformPoint(input[i], transform);
+    }
+}
+
+static void transformNormals(const bx::Vec3* input, bx::Vec3* output, size_t count, const float* normalTransform)
+{
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256 one = _mm256_set1_ps(1.0f);
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 x, y, z;
+        loadVec3x8(&input[i], x, y, z);
+        transformVec3x8(normalTransform, x, y, z);
+
+        // Same as bx::normalize: a true square root and divide, not the estimates.
+        __m256 lengthSq = _mm256_mul_ps(x, x);
+        lengthSq = _mm256_add_ps(lengthSq, _mm256_mul_ps(y, y));
+        lengthSq = _mm256_add_ps(lengthSq, _mm256_mul_ps(z, z));
+        const __m256 invLength = _mm256_div_ps(one, _mm256_sqrt_ps(lengthSq));
+
+        storeVec3x8(&output[i], _mm256_mul_ps(x, invLength), _mm256_mul_ps(y, invLength), _mm256_mul_ps(z, invLength));
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        output[i] = transformNormal(input[i], normalTransform);
+    }
+}
+
+uint32_t Scene::addVertex(SceneMesh& mesh, const bx::Vec3& position, const bx::Vec3& normal, const bx::Vec3& color)
+{
+    if (m_weldVertices)
+    {
+        const float values[9] = { position.x, position.y, position.z, normal.x, normal.y, normal.z, color.x, color.y, color.z };
+
+        VertexKey key;
+        for (int i = 0; i < 9; ++i)
+        {
+            // -0 and 0 are the same vertex.
+            float value = (values[i] == 0.0f) ? 0.0f : values[i];
+            memcpy(&key.bits[i], &value, sizeof(float));
+        }
+
+        auto result = m_vertexLookup.insert(std::make_pair(key, (uint32_t)mesh.vertexBuffer.size()));
+        if (!result.second)
+        {
+            return result.first->second;
+        }
+    }
 
-void Scene::addGeometry(bx::Vec3* vertices,
-                        uint32_t* indices,
+    mesh.vertexBuffer.push_back(position);
+    mesh.normalBuffer.push_back(normal);
+    mesh.colorBuffer.push_back(color);
+    return (uint32_t)(mesh.vertexBuffer.size() - 1);
+}
+
+uint32_t Scene::addMesh(const bx::Vec3* vertices,
+                        const uint32_t* indices,
                         int triangleCount,
-                        float* transformMtx,
                         bx::Vec3 color,
                         unsigned int materialID)
 {
+    m_meshes.push_back(SceneMesh());
+    SceneMesh& mesh = m_meshes.back();
+
+    // Indices are per mesh so welding is too.
+    m_vertexLookup.clear();
+
+    // Unwelded is the worst case, every triangle corner gets its own vertex.
+    mesh.vertexBuffer.reserve(triangleCount * 3);
+    mesh.normalBuffer.reserve(triangleCount * 3);
+    mesh.colorBuffer.reserve(triangleCount * 3);
+    mesh.indexBuffer.reserve(triangleCount * 3);
+    // Materials are per-triangle, not per vertex.
+    mesh.materialIDBuffer.resize(triangleCount, materialID);
+
     for (int i = 0; i < triangleCount; ++i)
     {
         uint32_t idx[] = { indices[(i * 3) + 0], indices[(i * 3) + 1], indices[(i * 3) + 2] };
         bx::Vec3 normal = bx::calcNormal(vertices[idx[0]], vertices[idx[1]], vertices[idx[2]]);
-        
+
         for (int j = 0; j < 3; ++j)
         {
-            bx::Vec3 xfrmVert = applyTransform(vertices[idx[j]], transformMtx, 1.0f);
-            bx::Vec3 xfrmNormal = applyTransform(normal, transformMtx, 0.0f);
-            xfrmNormal = bx::normalize(xfrmNormal);
+            mesh.indexBuffer.push_back(addVertex(mesh, vertices[idx[j]], normal, color));
+        }
+    }
+
+    m_vertexLookup.clear();
+    return (uint32_t)(m_meshes.size() - 1);
+}
+
+uint32_t Scene::addMesh(SceneMesh&& mesh)
+{
+    m_meshes.push_back(std::move(mesh));
+    return (uint32_t)(m_meshes.size() - 1);
+}
+
+// bx matrices transform row vectors, transpose the top three columns into rows.
+static void setInstanceTransform(SceneInstance& instance, const float* transformMtx)
+{
+    for (int row = 0; row < 3; ++row)
+    {
+        for (int column = 0; column < 4; ++column)
+        {
+            instance.transform[(row * 4) + column] = transformMtx[(column * 4) + row];
+        }
+    }
+}
+
+uint32_t Scene::addInstance(uint32_t meshID, const float* transformMtx, uint32_t mask)
+{
+    SceneInstance instance;
+    instance.meshID = meshID;
+    instance.mask = mask;
+
+    setInstanceTransform(instance, transformMtx);
+
+    m_instances.push_back(instance);
+    return (uint32_t)(m_instances.size() - 1);
+}
+
+void Scene::setTransform(uint32_t instanceID, const float* transformMtx)
+{
+    setInstanceTransform(m_instances[instanceID], transformMtx);
+
+    if (m_instanceDirty.size() < m_instances.size())
+    {
+        m_instanceDirty.resize(m_instances.size(), 0);
+    }
+
+    if (!m_instanceDirty[instanceID])
+    {
+        m_instanceDirty[instanceID] = 1;
+        m_dirtyInstances.push_back(instanceID);
+    }
+}
+
+void Scene::getTransform(uint32_t instanceID, float* transformMtxOut) const
+{
+    const SceneInstance& instance = m_instances[instanceID];
+    for (int row = 0; row < 3; ++row)
+    {
+        for (int column = 0; column < 4; ++column)
+        {
+            transformMtxOut[(column * 4) + row] = instance.transform[(row * 4) + column];
+        }
+    }
+
+    transformMtxOut[3] = 0.0f;
+    transformMtxOut[7] = 0.0f;
+    transformMtxOut[11] = 0.0f;
+    transformMtxOut[15] = 1.0f;
+}
+
+const std::vector<uint32_t>& Scene::getDirtyInstances() const
+{
+    return m_dirtyInstances;
+}
+
+void Scene::clearDirtyInstances()
+{
+    for (size_t i = 0; i < m_dirtyInstances.size(); ++i)
+    {
+        m_instanceDirty[m_dirtyInstances[i]] = 0;
+    }
+    m_dirtyInstances.clear();
+}
+
+const MappedFile* Scene::addMappedFile(std::unique_ptr<MappedFile> file)
+{
+    m_mappedFiles.push_back(std::move(file));
+    return m_mappedFiles.back().get();
+}
+
+void Scene::bakeInstances(CpuThreadPool* threadPool)
+{
+    // Every instance writes its own range of the world buffers, so size them all up front
+    // and the instances can be baked in any order on any thread.
+    std::vector<size_t> firstVertices(m_instances.size() + 1);
+    std::vector<size_t> firstIndices(m_instances.size() + 1);
+    firstVertices[0] = 0;
+    firstIndices[0] = 0;
+
+    for (size_t i = 0; i < m_instances.size(); ++i)
+    {
+        const SceneMesh& mesh = m_meshes[m_instances[i].meshID];
+        firstVertices[i + 1] = firstVertices[i] + mesh.vertexBuffer.size();
+        firstIndices[i + 1] = firstIndices[i] + mesh.indexBuffer.size();
+    }
+
+    const size_t vertexCount = firstVertices.back();
+    const size_t indexCount = firstIndices.back();
+    const bx::Vec3 zero(0.0f, 0.0f, 0.0f);
+
+    m_vertexBuffer.clear();
+    m_indexBuffer.clear();
+    m_normalBuffer.clear();
+    m_colorBuffer.clear();
+    m_materialIDBuffer.clear();
+
+    m_vertexBuffer.resize(vertexCount, zero);
+    m_normalBuffer.resize(vertexCount, zero);
+    m_colorBuffer.resize(vertexCount, zero);
+    m_indexBuffer.resize(indexCount);
+    m_materialIDBuffer.resize(indexCount / 3);
+
+    // Big meshes are split into chunks of vertices and triangles so a scene that's one
+    // huge instance still bakes on every thread.
+    std::vector<std::pair<uint32_t, uint32_t>> tasks;
+    tasks.reserve(m_instances.size());
+    for (size_t i = 0; i < m_instances.size(); ++i)
+    {
+        const SceneMesh& mesh = m_meshes[m_instances[i].meshID];
+        const size_t chunkCount = (bx::max(mesh.vertexBuffer.size(), mesh.indexBuffer.size() / 3) + kBakeChunkSize - 1) / kBakeChunkSize;
+        for (size_t chunk = 0; chunk < chunkCount; ++chunk)
+        {
+            tasks.push_back(std::make_pair((uint32_t)i, (uint32_t)chunk));
+        }
+    }
+
+    auto bakeChunk = [&](const std::pair<uint32_t, uint32_t>& task)
+    {
+        const SceneInstance& instance = m_instances[task.first];
+        const SceneMesh& mesh = m_meshes[instance.meshID];
+        const size_t firstVertex = firstVertices[task.first];
+        const size_t firstIndex = firstIndices[task.first];
+
+        const size_t vertexStart = bx::min(task.second * kBakeChunkSize, mesh.vertexBuffer.size());
+        const size_t vertexEnd = bx::min(vertexStart + kBakeChunkSize, mesh.vertexBuffer.size());
+        const size_t triangleStart = bx::min(task.second * kBakeChunkSize, mesh.indexBuffer.size() / 3);
+        const size_t triangleEnd = bx::min(triangleStart + kBakeChunkSize, mesh.indexBuffer.size() / 3);
+
+        if (vertexEnd > vertexStart)
+        {
+            const size_t count = vertexEnd - vertexStart;
+            const size_t output = firstVertex + vertexStart;
+
+            float normalTransform[12];
+            getNormalTransform(instance.transform, normalTransform);
+
+            transformPoints(&mesh.vertexBuffer.data()[vertexStart], &m_vertexBuffer[output], count, instance.transform);
+            transformNormals(&mesh.normalBuffer.data()[vertexStart], &m_normalBuffer[output], count, normalTransform);
+            memcpy(&m_colorBuffer[output], &mesh.colorBuffer.data()[vertexStart], count * sizeof(bx::Vec3));
+        }
+
+        for (size_t n = triangleStart * 3; n < triangleEnd * 3; ++n)
+        {
+            m_indexBuffer[firstIndex + n] = (uint32_t)firstVertex + mesh.indexBuffer.data()[n];
+        }
+
+        if (triangleEnd > triangleStart)
+        {
+            memcpy(&m_materialIDBuffer[(firstIndex / 3) + triangleStart], &mesh.materialIDBuffer.data()[triangleStart],
+                   (triangleEnd - triangleStart) * sizeof(uint32_t));
+        }
+    };
+
+    // Handing out tasks costs more than baking a few small meshes.
+    if (threadPool == nullptr || vertexCount < kMinParallelBakeVertices || tasks.size() < 2)
+    {
+        for (size_t i = 0; i < tasks.size(); ++i)
+        {
+            bakeChunk(tasks[i]);
+        }
+        return;
+    }
+
+    const uint32_t grainSize = bx::max(1u, (uint32_t)(tasks.size() / (threadPool->getThreadCount() * 8)));
+    threadPool->parallelFor((uint32_t)tasks.size(), grainSize, [&](uint32_t start, uint32_t end, uint32_t threadIndex)
+    {
+        for (uint32_t i = start; i < end; ++i)
+        {
+            bakeChunk(tasks[i]);
+        }
+    });
+}
+
+void Scene::getBakedTriangles(uint32_t instanceID, uint32_t& firstOut, uint32_t& countOut) const
+{
+    firstOut = 0;
+    for (uint32_t i = 0; i < instanceID; ++i)
+    {
+        firstOut += (uint32_t)(m_meshes[m_instances[i].meshID].indexBuffer.size() / 3);
+    }
+    countOut = (uint32_t)(m_meshes[m_instances[instanceID].meshID].indexBuffer.size() / 3);
+}
+
+static float getLuminance(const bx::Vec3& color)
+{
+    return (color.x * 0.2126f) + (color.y * 0.7152f) + (color.z * 0.0722f);
+}
+
+void Scene::buildLights()
+{
+    m_lights.clear();
+    m_lightAliases.clear();
+
+    // Planes from addAreaLight() become one quad light, other meshes are only visited for
+    // their emissive triangles if they have any.
+    std::vector<int32_t> areaLightShapes(m_meshes.size(), -1);
+    for (size_t i = 0; i < m_shapeMeshes.size(); ++i)
+    {
+        if (m_shapeMeshes[i].shape == SHAPE_PLANE && m_shapeMeshes[i].materialID == MATERIAL_EMISSIVE)
+        {
+            areaLightShapes[m_shapeMeshes[i].meshID] = (int32_t)i;
+        }
+    }
+
+    m_meshEmissive.assign(m_meshes.size(), 0);
+    for (size_t m = 0; m < m_meshes.size(); ++m)
+    {
+        const SceneMesh& mesh = m_meshes[m];
+        for (size_t t = 0; t < mesh.materialIDBuffer.size(); ++t)
+        {
+            if (mesh.materialIDBuffer[t] == MATERIAL_EMISSIVE)
+            {
+                m_meshEmissive[m] = 1;
+                break;
+            }
+        }
 
-            m_vertexBuffer.push_back(xfrmVert);
-            m_indexBuffer.push_back(m_vertexBuffer.size() - 1);
-            m_normalBuffer.push_back(xfrmNormal);
-            m_colorBuffer.push_back(color);
+        if (areaLightShapes[m] >= 0)
+        {
+            m_meshEmissive[m] = 1;
         }
-        
-        // Materials are per-triangle, not per vertex.
-        m_materialIDBuffer.push_back(materialID);
     }
+
+    for (size_t i = 0; i < m_instances.size(); ++i)
+    {
+        const SceneInstance& instance = m_instances[i];
+        const float* transform = instance.transform;
+
+        if (areaLightShapes[instance.meshID] >= 0)
+        {
+            const ShapeMesh& shapeMesh = m_shapeMeshes[areaLightShapes[instance.meshID]];
+
+            float normalTransform[12];
+            getNormalTransform(transform, normalTransform);
+
+            // The plane is the unit square at y = -0.5 facing up.
+            SceneLight light;
+            light.type = SceneLightType::Quad;
+            light.position = transformPoint(bx::Vec3(0.0f, -0.5f, 0.0f), transform);
+            light.edge0 = bx::Vec3(transform[0] * 0.5f, transform[4] * 0.5f, transform[8] * 0.5f);
+            light.edge1 = bx::Vec3(transform[2] * 0.5f, transform[6] * 0.5f, transform[10] * 0.5f);
+            light.normal = transformNormal(bx::Vec3(0.0f, 1.0f, 0.0f), normalTransform);
+            light.color = bx::Vec3(shapeMesh.color[0], shapeMesh.color[1], shapeMesh.color[2]);
+            light.area = bx::length(bx::cross(light.edge0, light.edge1)) * 4.0f;
+            light.instanceIndex = (uint32_t)i;
+            m_lights.push_back(light);
+            continue;
+        }
+
+        if (!m_meshEmissive[instance.meshID])
+        {
+            continue;
+        }
+
+        const SceneMesh& mesh = m_meshes[instance.meshID];
+        const size_t triangleCount = mesh.indexBuffer.size() / 3;
+        for (size_t t = 0; t < triangleCount; ++t)
+        {
+            if (mesh.materialIDBuffer[t] != MATERIAL_EMISSIVE)
+            {
+                continue;
+            }
+
+            const uint32_t* idx = &mesh.indexBuffer[t * 3];
+            const bx::Vec3 v0 = transformPoint(mesh.vertexBuffer[idx[0]], transform);
+            const bx::Vec3 v1 = transformPoint(mesh.vertexBuffer[idx[1]], transform);
+            const bx::Vec3 v2 = transformPoint(mesh.vertexBuffer[idx[2]], transform);
+
+            SceneLight light;
+            light.type = SceneLightType::Triangle;
+            light.position = v0;
+            light.edge0 = bx::sub(v1, v0);
+            light.edge1 = bx::sub(v2, v0);
+
+            const bx::Vec3 normal = bx::cross(light.edge0, light.edge1);
+            const float normalLength = bx::length(normal);
+            if (normalLength <= 0.0f)
+            {
+                continue;
+            }
+
+            // Emissive triangles carry their emission in the vertex colors.
+            light.normal = bx::mul(normal, 1.0f / normalLength);
+            light.color = bx::mul(bx::add(bx::add(mesh.colorBuffer[idx[0]], mesh.colorBuffer[idx[1]]), mesh.colorBuffer[idx[2]]), 1.0f / 3.0f);
+            light.area = normalLength * 0.5f;
+            light.instanceIndex = (uint32_t)i;
+            light.primitiveIndex = (uint32_t)t;
+            m_lights.push_back(light);
+        }
+    }
+
+    // Lights that give off nothing can never be picked, drop them.
+    std::vector<float> powers;
+    powers.reserve(m_lights.size());
+    double totalPower = 0.0;
+    size_t lightCount = 0;
+    for (size_t i = 0; i < m_lights.size(); ++i)
+    {
+        const float power = getLuminance(m_lights[i].color) * m_lights[i].area;
+        if (power > 0.0f)
+        {
+            m_lights[lightCount++] = m_lights[i];
+            powers.push_back(power);
+            totalPower += power;
+        }
+    }
+    m_lights.resize(lightCount);
+
+    // Vose's method: buckets over their share give the rest of it to buckets under it, so
+    // every bucket ends up holding exactly one share split between at most two lights.
+    std::vector<float> shares(lightCount);
+    std::vector<uint32_t> small;
+    std::vector<uint32_t> large;
+    for (size_t i = 0; i < lightCount; ++i)
+    {
+        m_lights[i].pdf = (float)(powers[i] / totalPower);
+        shares[i] = (float)((powers[i] * (double)lightCount) / totalPower);
+        (shares[i] < 1.0f ? small : large).push_back((uint32_t)i);
+    }
+
+    m_lightAliases.resize(lightCount);
+    while (!small.empty() && !large.empty())
+    {
+        const uint32_t under = small.back();
+        const uint32_t over = large.back();
+        small.pop_back();
+        large.pop_back();
+
+        m_lightAliases[under].probability = shares[under];
+        m_lightAliases[under].alias = over;
+
+        shares[over] = (shares[over] + shares[under]) - 1.0f;
+        (shares[over] < 1.0f ? small : large).push_back(over);
+    }
+
+    // Whatever is left is within rounding of a full share.
+    for (size_t i = 0; i < small.size(); ++i)
+    {
+        m_lightAliases[small[i]].probability = 1.0f;
+        m_lightAliases[small[i]].alias = small[i];
+    }
+    for (size_t i = 0; i < large.size(); ++i)
+    {
+        m_lightAliases[large[i]].probability = 1.0f;
+        m_lightAliases[large[i]].alias = large[i];
+    }
+}
+
+bool Scene::getDirtyInstancesHaveLights() const
+{
+    if (m_meshEmissive.size() != m_meshes.size())
+    {
+        return true;
+    }
+
+    for (size_t i = 0; i < m_dirtyInstances.size(); ++i)
+    {
+        if (m_meshEmissive[m_instances[m_dirtyInstances[i]].meshID])
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Scene::getBrightestAreaLight(SceneLight& lightOut) const
+{
+    bool found = false;
+    for (size_t i = 0; i < m_lights.size(); ++i)
+    {
+        if (m_lights[i].type == SceneLightType::Quad && (!found || m_lights[i].pdf > lightOut.pdf))
+        {
+            lightOut = m_lights[i];
+            found = true;
+        }
+    }
+    return found;
+}
+
+void Scene::printVertexStats() const
+{
+    // Position, normal and color per vertex plus an index per triangle corner.
+    const size_t vertexSize = sizeof(bx::Vec3) * 3;
+
+    size_t meshTriangleCount = 0;
+    size_t meshVertexCount = 0;
+    size_t meshBytes = 0;
+    size_t unweldedBytes = 0;
+    uint64_t missCount = 0;
+
+    std::vector<size_t> meshSizes(m_meshes.size());
+    for (size_t m = 0; m < m_meshes.size(); ++m)
+    {
+        const SceneMesh& mesh = m_meshes[m];
+        meshSizes[m] = (mesh.vertexBuffer.size() * vertexSize) + (mesh.indexBuffer.size() * sizeof(uint32_t));
+
+        meshTriangleCount += mesh.indexBuffer.size() / 3;
+        meshVertexCount += mesh.vertexBuffer.size();
+        meshBytes += meshSizes[m];
+        unweldedBytes += mesh.indexBuffer.size() * (vertexSize + sizeof(uint32_t));
+
+        // Run the index buffer through a FIFO cache, a vertex is a hit if fewer than
+        // kVertexCacheSize misses happened since it went in.
+        std::vector<uint64_t> insertedAt(mesh.vertexBuffer.size(), UINT64_MAX);
+        for (size_t i = 0; i < mesh.indexBuffer.size(); ++i)
+        {
+            uint64_t& inserted = insertedAt[mesh.indexBuffer[i]];
+            if (inserted == UINT64_MAX || missCount - inserted >= kVertexCacheSize)
+            {
+                inserted = missCount++;
+            }
+        }
+    }
+
+    // What a copy of the mesh per instance would take.
+    size_t instancedTriangleCount = 0;
+    size_t bakedBytes = 0;
+    for (size_t i = 0; i < m_instances.size(); ++i)
+    {
+        const SceneMesh& mesh = m_meshes[m_instances[i].meshID];
+        instancedTriangleCount += mesh.indexBuffer.size() / 3;
+        bakedBytes += meshSizes[m_instances[i].meshID];
+    }
+
+    if (meshTriangleCount == 0)
+    {
+        return;
+    }
+
+    std::cout << "Scene: " << m_meshes.size() << " meshes, " << m_instances.size() << " instances, "
+              << meshTriangleCount << " mesh triangles (" << instancedTriangleCount << " instanced), "
+              << meshVertexCount << " vertices" << (m_weldVertices ? " (welded), " : ", ")
+              << (meshBytes / 1024.0) << " KB of geometry, " << ((unweldedBytes - meshBytes) / 1024.0)
+              << " KB saved by welding, " << ((bakedBytes > meshBytes ? bakedBytes - meshBytes : 0) / 1024.0)
+              << " KB saved by instancing. Vertex cache (" << kVertexCacheSize << " entry FIFO): ACMR "
+              << (double(missCount) / meshTriangleCount) << ", ATVR " << (double(missCount) / meshVertexCount) << std::endl;
 }
@@ -6,32 +6,246 @@
 #ifndef SCENE_HEADER_GUARD
 #define SCENE_HEADER_GUARD
 
+#include "engine/MappedFile.h"
+
+#include <memory>
+#include <stdint.h>
+#include <unordered_map>
 #include <vector>
 #include <bx/math.h>
 
 namespace toyraygun
 {
+    class CpuThreadPool;
+
+    // An array that either owns its elements or looks at memory owned by someone else,
+    // e.g. a mapped file the Scene keeps open. Reading works the same either way, the
+    // first write to a view copies it into owned storage.
+    template<typename T>
+    class SceneBuffer
+    {
+    protected:
+        std::vector<T> m_storage;
+        const T* m_view;
+        size_t m_viewSize;
+
+        std::vector<T>& getStorage()
+        {
+            if (m_view != nullptr)
+            {
+                m_storage.assign(m_view, m_view + m_viewSize);
+                m_view = nullptr;
+                m_viewSize = 0;
+            }
+            return m_storage;
+        }
+
+    public:
+        SceneBuffer() : m_view(nullptr), m_viewSize(0) { }
+
+        void setView(const T* data, size_t count)
+        {
+            std::vector<T>().swap(m_storage);
+            m_view = data;
+            m_viewSize = count;
+        }
+
+        bool isView() const { return m_view != nullptr; }
+
+        size_t size() const { return (m_view != nullptr) ? m_viewSize : m_storage.size(); }
+        bool empty() const { return size() == 0; }
+        const T* data() const { return (m_view != nullptr) ? m_view : m_storage.data(); }
+
+        const T& operator[](size_t i) const { return data()[i]; }
+        T& operator[](size_t i) { return getStorage()[i]; }
+
+        const T* begin() const { return data(); }
+        const T* end() const { return data() + size(); }
+
+        void push_back(const T& value) { getStorage().push_back(value); }
+        void reserve(size_t count) { getStorage().reserve(count); }
+        void resize(size_t count, const T& value) { getStorage().resize(count, value); }
+        void assign(const T* first, const T* last) { m_view = nullptr; m_viewSize = 0; m_storage.assign(first, last); }
+        void clear() { m_view = nullptr; m_viewSize = 0; m_storage.clear(); }
+    };
+
+    // Geometry in its own object space, shared by every instance of it.
+    struct SceneMesh
+    {
+        SceneBuffer<bx::Vec3> vertexBuffer;
+        SceneBuffer<uint32_t> indexBuffer;
+        SceneBuffer<bx::Vec3> normalBuffer;
+        SceneBuffer<bx::Vec3> colorBuffer;
+        SceneBuffer<uint32_t> materialIDBuffer;
+
+        // Optional BVH over the triangles, e.g. from a scene cache, that the CPU renderer
+        // uses instead of building its own. Opaque to the scene, see CpuBVH::save().
+        SceneBuffer<uint8_t> bvhData;
+    };
+
+    // One placement of a mesh. The transform is a 3x4 row major object to world matrix
+    // like D3D12_RAYTRACING_INSTANCE_DESC, and the mask has to share a bit with a ray's
+    // mask for the ray to see the instance, like InstanceMask.
+    struct SceneInstance
+    {
+        uint32_t meshID;
+        float transform[12];
+        uint32_t mask;
+    };
+
+    enum class SceneLightType
+    {
+        Quad,
+        Triangle,
+    };
+
+    // An emitter the renderers sample direct lighting from. A quad spans position +- edge0
+    // +- edge1 like the shaders' AreaLight, a triangle's corners are position, position +
+    // edge0 and position + edge1. Only the side the normal faces emits.
+    struct SceneLight
+    {
+        SceneLightType type;
+        bx::Vec3 position;
+        bx::Vec3 edge0;
+        bx::Vec3 edge1;
+        bx::Vec3 normal;
+        bx::Vec3 color;
+        float area;
+        float pdf;  // Chance of the alias table picking this light.
+
+        // Where it came from, the primitive is UINT32_MAX for a quad covering its instance.
+        uint32_t instanceIndex;
+        uint32_t primitiveIndex;
+
+        SceneLight();
+    };
+
+    // One bucket of Walker's alias table. A uniformly picked bucket keeps its own light
+    // with this probability and hands over to its alias otherwise.
+    struct SceneLightAlias
+    {
+        float probability;
+        uint32_t alias;
+    };
+
     class Scene
     {
     protected:
-        void addGeometry(bx::Vec3* vertices,
-            uint32_t* indices,
-            int triangleCount,
-            float* transformMtx,
-            bx::Vec3 color,
-            unsigned int materialID);
+        enum Shape
+        {
+            SHAPE_CUBE,
+            SHAPE_PLANE,
+        };
+
+        // Meshes made for addCube() and friends, reused by every shape with the same
+        // color and material.
+        struct ShapeMesh
+        {
+            Shape shape;
+            float color[3];
+            uint32_t materialID;
+            uint32_t meshID;
+        };
+
+        // Position, normal and color of a vertex compared bit for bit.
+        struct VertexKey
+        {
+            uint32_t bits[9];
+
+            bool operator==(const VertexKey& other) const;
+        };
+
+        struct VertexKeyHash
+        {
+            size_t operator()(const VertexKey& key) const;
+        };
+
+        // When welding, identical vertices are shared between triangles instead of every
+        // triangle corner getting its own.
+        bool m_weldVertices;
+        std::unordered_map<VertexKey, uint32_t, VertexKeyHash> m_vertexLookup;
+
+        std::vector<ShapeMesh> m_shapeMeshes;
+
+        // Per mesh, whether buildLights() found lights on it.
+        std::vector<uint8_t> m_meshEmissive;
+
+        // Instances moved by setTransform() since the renderer last picked them up.
+        std::vector<uint32_t> m_dirtyInstances;
+        std::vector<uint8_t> m_instanceDirty;
+
+        // Files that mesh buffers are viewing, kept open as long as the scene.
+        std::vector<std::unique_ptr<MappedFile>> m_mappedFiles;
+
+        uint32_t addVertex(SceneMesh& mesh, const bx::Vec3& position, const bx::Vec3& normal, const bx::Vec3& color);
+        uint32_t getShapeMesh(Shape shape, bx::Vec3 color, unsigned int materialID);
 
     public:
+        std::vector<SceneMesh> m_meshes;
+        std::vector<SceneInstance> m_instances;
+
+        // Every instance baked into one world space mesh by bakeInstances(), for backends
+        // that build a single acceleration structure.
         std::vector<bx::Vec3> m_vertexBuffer;
         std::vector<uint32_t> m_indexBuffer;
         std::vector<bx::Vec3> m_normalBuffer;
         std::vector<bx::Vec3> m_colorBuffer;
         std::vector<uint32_t> m_materialIDBuffer;
 
-        // Geometry
-        void addCube(bx::Vec3 color, float* transformMtx);
-        void addPlane(bx::Vec3 color, float* transformMtx);
-        void addAreaLight(bx::Vec3 color, float* transformMtx);
+        // Every area light and emissive triangle in world space, filled by buildLights()
+        // along with an alias table that picks lights in proportion to their power.
+        std::vector<SceneLight> m_lights;
+        std::vector<SceneLightAlias> m_lightAliases;
+
+        Scene();
+
+        // Only affects meshes added afterwards.
+        void setVertexWelding(bool enabled);
+        bool getVertexWelding() const;
+
+        // Vertex memory, what welding and instancing save, and how well the index buffers
+        // would use a post transform vertex cache.
+        void printVertexStats() const;
+
+        // Meshes and instances. Triangles get flat normals, the color and material apply
+        // to the whole mesh. transformMtx is a bx matrix.
+        uint32_t addMesh(const bx::Vec3* vertices,
+            const uint32_t* indices,
+            int triangleCount,
+            bx::Vec3 color,
+            unsigned int materialID);
+        // A mesh that's already been filled in, e.g. by a file loader.
+        uint32_t addMesh(SceneMesh&& mesh);
+        uint32_t addInstance(uint32_t meshID, const float* transformMtx, uint32_t mask = 0xff);
+
+        // Instance IDs are handles that stay valid for the life of the scene. Moving an
+        // instance marks it dirty, Renderer::updateScene() applies the changes.
+        void setTransform(uint32_t instanceID, const float* transformMtx);
+        void getTransform(uint32_t instanceID, float* transformMtxOut) const;
+        const std::vector<uint32_t>& getDirtyInstances() const;
+        void clearDirtyInstances();
+
+        // Takes ownership of a file so meshes can view its contents instead of copying them.
+        const MappedFile* addMappedFile(std::unique_ptr<MappedFile> file);
+
+        // Fills the world space buffers above from the meshes and instances. Large scenes
+        // are baked on the pool's threads, null bakes on the calling thread.
+        void bakeInstances(CpuThreadPool* threadPool);
+        // Where an instance's triangles are in the baked buffers, instances are baked in order.
+        void getBakedTriangles(uint32_t instanceID, uint32_t& firstOut, uint32_t& countOut) const;
+
+        // Fills the light list above from the instances, call again after moving lights.
+        void buildLights();
+        // True if a dirty instance is a light, or meshes were added since buildLights().
+        bool getDirtyInstancesHaveLights() const;
+        // Most powerful quad light, for backends that only take a single AreaLight. False
+        // if the scene has none.
+        bool getBrightestAreaLight(SceneLight& lightOut) const;
+
+        // Geometry, each call adds an instance of a shared mesh and returns its ID.
+        uint32_t addCube(bx::Vec3 color, float* transformMtx);
+        uint32_t addPlane(bx::Vec3 color, float* transformMtx);
+        uint32_t addAreaLight(bx::Vec3 color, float* transformMtx);
     };
 }
 
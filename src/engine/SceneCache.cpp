@@ -0,0 +1,438 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#include "SceneCache.h"
+#include "engine/Engine.h"
+#include "engine/MappedFile.h"
+#include "engine/CPU/CpuBVH.h"
+#include "engine/CPU/CpuThreadPool.h"
+using namespace toyraygun;
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <utility>
+#include <vector>
+
+static const uint32_t kSceneCacheMagic = 0x43535254; // "TRSC"
+
+// Bump whenever the layout below changes, old caches are rebuilt. The BVHs carry their
+// own version, see CpuBVH::save().
+static const uint32_t kSceneCacheVersion = 2;
+
+// Every section starts on a cache line.
+static const uint64_t kSectionAlignment = 64;
+
+enum Section
+{
+    SECTION_VERTICES,
+    SECTION_NORMALS,
+    SECTION_COLORS,
+    SECTION_INDICES,
+    SECTION_MATERIAL_IDS,
+    SECTION_BVH,
+    SECTION_COUNT,
+};
+
+static const uint64_t kSectionElementSizes[SECTION_COUNT] =
+{
+    sizeof(bx::Vec3),
+    sizeof(bx::Vec3),
+    sizeof(bx::Vec3),
+    sizeof(uint32_t),
+    sizeof(uint32_t),
+    1,
+};
+
+// The header, then the mesh table and the instances, then each mesh's sections.
+struct SceneCache::Header
+{
+    uint32_t magic;
+    uint32_t version;
+
+    // Sizes of everything stored as is, in case a struct changes without the version.
+    uint32_t headerSize;
+    uint32_t meshEntrySize;
+    uint32_t instanceSize;
+
+    uint32_t meshCount;
+    uint32_t instanceCount;
+    uint64_t fileSize;
+
+    // The file the scene was loaded from when the cache was written.
+    uint64_t sourceSize;
+    int64_t sourceModifiedTime;
+
+    uint64_t instanceOffset;
+
+    // FNV-1a of the header with this zeroed, the mesh table and the instances.
+    uint64_t checksum;
+};
+
+struct SceneCache::MeshEntry
+{
+    uint64_t offset[SECTION_COUNT];
+    uint64_t count[SECTION_COUNT];
+};
+
+static uint64_t alignUp(uint64_t offset)
+{
+    return (offset + kSectionAlignment - 1) & ~(kSectionAlignment - 1);
+}
+
+static uint64_t hashBytes(uint64_t hash, const void* data, size_t size)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static bool getSourceStamp(const std::string& path, uint64_t& sizeOut, int64_t& modifiedTimeOut)
+{
+    sizeOut = 0;
+    modifiedTimeOut = 0;
+    if (path.empty())
+    {
+        return true;
+    }
+
+#ifdef PLATFORM_WINDOWS
+    struct _stat64 info;
+    if (_stat64(path.c_str(), &info) != 0)
+#else
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+#endif
+    {
+        return false;
+    }
+
+    sizeOut = (uint64_t)info.st_size;
+    modifiedTimeOut = (int64_t)info.st_mtime;
+    return true;
+}
+
+static const void* getSection(const SceneMesh& mesh, uint32_t section, size_t& countOut)
+{
+    switch (section)
+    {
+        case SECTION_VERTICES: countOut = mesh.vertexBuffer.size(); return mesh.vertexBuffer.data();
+        case SECTION_NORMALS: countOut = mesh.normalBuffer.size(); return mesh.normalBuffer.data();
+        case SECTION_COLORS: countOut = mesh.colorBuffer.size(); return mesh.colorBuffer.data();
+        case SECTION_INDICES: countOut = mesh.indexBuffer.size(); return mesh.indexBuffer.data();
+        case SECTION_MATERIAL_IDS: countOut = mesh.materialIDBuffer.size(); return mesh.materialIDBuffer.data();
+        case SECTION_BVH: countOut = mesh.bvhData.size(); return mesh.bvhData.data();
+    }
+
+    countOut = 0;
+    return nullptr;
+}
+
+static void setSectionView(SceneMesh& mesh, uint32_t section, const uint8_t* data, size_t count)
+{
+    switch (section)
+    {
+        case SECTION_VERTICES: mesh.vertexBuffer.setView((const bx::Vec3*)data, count); break;
+        case SECTION_NORMALS: mesh.normalBuffer.setView((const bx::Vec3*)data, count); break;
+        case SECTION_COLORS: mesh.colorBuffer.setView((const bx::Vec3*)data, count); break;
+        case SECTION_INDICES: mesh.indexBuffer.setView((const uint32_t*)data, count); break;
+        case SECTION_MATERIAL_IDS: mesh.materialIDBuffer.setView((const uint32_t*)data, count); break;
+        case SECTION_BVH: mesh.bvhData.setView(data, count); break;
+    }
+}
+
+// Zero pads the file up to offset before writing, false if anything fails.
+static bool writeAt(FILE* file, uint64_t& position, uint64_t offset, const void* data, size_t size)
+{
+    static const uint8_t padding[kSectionAlignment] = { };
+    while (position < offset)
+    {
+        const size_t padSize = (size_t)bx::min<uint64_t>(offset - position, kSectionAlignment);
+        if (fwrite(padding, 1, padSize, file) != padSize)
+        {
+            return false;
+        }
+        position += padSize;
+    }
+
+    if (size > 0 && fwrite(data, 1, size, file) != size)
+    {
+        return false;
+    }
+
+    position += size;
+    return true;
+}
+
+SceneCache::SceneCache() :
+    m_timeMs(0.0f),
+    m_fileSize(0)
+{
+
+}
+
+bool SceneCache::write(const std::string& path, Scene* scene, const std::string& sourcePath, uint32_t threadCount)
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    if (!getSourceStamp(sourcePath, header.sourceSize, header.sourceModifiedTime))
+    {
+        std::cout << "Scene cache: couldn't find " << sourcePath << std::endl;
+        return false;
+    }
+
+    // Build the BVHs the cache is for, the scene keeps them so the renderer doesn't build them again.
+    CpuThreadPool threadPool;
+    bool threadPoolStarted = false;
+    for (size_t i = 0; i < scene->m_meshes.size(); ++i)
+    {
+        SceneMesh& mesh = scene->m_meshes[i];
+        const uint32_t triangleCount = (uint32_t)(mesh.indexBuffer.size() / 3);
+        if (triangleCount == 0 || !mesh.bvhData.empty())
+        {
+            continue;
+        }
+
+        if (!threadPoolStarted)
+        {
+            threadPool.init(threadCount);
+            threadPoolStarted = true;
+        }
+
+        CpuBVH bvh;
+        bvh.build(mesh.vertexBuffer.data(), mesh.indexBuffer.data(), triangleCount, &threadPool);
+
+        std::vector<uint8_t> bvhData;
+        bvh.save(bvhData);
+        mesh.bvhData.assign(bvhData.data(), bvhData.data() + bvhData.size());
+    }
+
+    header.magic = kSceneCacheMagic;
+    header.version = kSceneCacheVersion;
+    header.headerSize = sizeof(Header);
+    header.meshEntrySize = sizeof(MeshEntry);
+    header.instanceSize = sizeof(SceneInstance);
+    header.meshCount = (uint32_t)scene->m_meshes.size();
+    header.instanceCount = (uint32_t)scene->m_instances.size();
+
+    // Lay out the file.
+    const uint64_t meshTableOffset = alignUp(sizeof(Header));
+    header.instanceOffset = alignUp(meshTableOffset + (uint64_t)header.meshCount * sizeof(MeshEntry));
+    uint64_t offset = header.instanceOffset + (uint64_t)header.instanceCount * sizeof(SceneInstance);
+
+    std::vector<MeshEntry> meshEntries(header.meshCount);
+    for (uint32_t i = 0; i < header.meshCount; ++i)
+    {
+        for (uint32_t section = 0; section < SECTION_COUNT; ++section)
+        {
+            size_t count;
+            getSection(scene->m_meshes[i], section, count);
+
+            offset = alignUp(offset);
+            meshEntries[i].offset[section] = offset;
+            meshEntries[i].count[section] = count;
+            offset += count * kSectionElementSizes[section];
+        }
+    }
+    header.fileSize = offset;
+
+    uint64_t checksum = 0xcbf29ce484222325ull;
+    checksum = hashBytes(checksum, &header, sizeof(header));
+    checksum = hashBytes(checksum, meshEntries.data(), meshEntries.size() * sizeof(MeshEntry));
+    checksum = hashBytes(checksum, scene->m_instances.data(), scene->m_instances.size() * sizeof(SceneInstance));
+    header.checksum = checksum;
+
+    // Written next to the destination and renamed over it so a failed write never
+    // leaves a half written cache behind.
+    const std::string tempPath = path + ".tmp";
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    if (file == nullptr)
+    {
+        std::cout << "Scene cache: couldn't create " << tempPath << std::endl;
+        return false;
+    }
+
+    uint64_t position = 0;
+    bool written = writeAt(file, position, 0, &header, sizeof(header)) &&
+                   writeAt(file, position, meshTableOffset, meshEntries.data(), meshEntries.size() * sizeof(MeshEntry)) &&
+                   writeAt(file, position, header.instanceOffset, scene->m_instances.data(), scene->m_instances.size() * sizeof(SceneInstance));
+
+    for (uint32_t i = 0; written && i < header.meshCount; ++i)
+    {
+        for (uint32_t section = 0; written && section < SECTION_COUNT; ++section)
+        {
+            size_t count;
+            const void* data = getSection(scene->m_meshes[i], section, count);
+            written = writeAt(file, position, meshEntries[i].offset[section], data, count * kSectionElementSizes[section]);
+        }
+    }
+
+    written &= (fclose(file) == 0);
+    if (written)
+    {
+        remove(path.c_str());
+        written = (rename(tempPath.c_str(), path.c_str()) == 0);
+    }
+
+    if (!written)
+    {
+        remove(tempPath.c_str());
+        std::cout << "Scene cache: couldn't write " << path << std::endl;
+        return false;
+    }
+
+    m_fileSize = header.fileSize;
+    m_timeMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+    std::cout << "Scene cache: wrote " << path << ", " << (m_fileSize / (1024.0f * 1024.0f)) << " MB in " << m_timeMs << " ms." << std::endl;
+    return true;
+}
+
+bool SceneCache::load(const std::string& path, Scene* scene, const std::string& sourcePath)
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    std::unique_ptr<MappedFile> file(new MappedFile());
+    if (!file->open(path))
+    {
+        std::cout << "Scene cache: no cache at " << path << std::endl;
+        return false;
+    }
+
+    const uint8_t* data = file->getData();
+    const uint64_t size = file->getSize();
+
+    Header header;
+    if (size < sizeof(Header))
+    {
+        std::cout << "Scene cache: " << path << " isn't a scene cache." << std::endl;
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    if (header.magic != kSceneCacheMagic || header.version != kSceneCacheVersion || header.headerSize != sizeof(Header) ||
+        header.meshEntrySize != sizeof(MeshEntry) || header.instanceSize != sizeof(SceneInstance))
+    {
+        std::cout << "Scene cache: " << path << " was written by a different version." << std::endl;
+        return false;
+    }
+
+    uint64_t sourceSize;
+    int64_t sourceModifiedTime;
+    if (!getSourceStamp(sourcePath, sourceSize, sourceModifiedTime) || sourceSize != header.sourceSize || sourceModifiedTime != header.sourceModifiedTime)
+    {
+        std::cout << "Scene cache: " << path << " is stale, " << sourcePath << " changed since it was written." << std::endl;
+        return false;
+    }
+
+    const uint64_t meshTableOffset = alignUp(sizeof(Header));
+    if (header.fileSize != size ||
+        meshTableOffset + (uint64_t)header.meshCount * sizeof(MeshEntry) > size ||
+        header.instanceOffset % sizeof(uint32_t) != 0 ||
+        header.instanceOffset + (uint64_t)header.instanceCount * sizeof(SceneInstance) > size)
+    {
+        std::cout << "Scene cache: " << path << " is truncated." << std::endl;
+        return false;
+    }
+
+    const MeshEntry* meshEntries = (const MeshEntry*)(data + meshTableOffset);
+    const SceneInstance* instances = (const SceneInstance*)(data + header.instanceOffset);
+
+    Header checksumHeader = header;
+    checksumHeader.checksum = 0;
+    uint64_t checksum = 0xcbf29ce484222325ull;
+    checksum = hashBytes(checksum, &checksumHeader, sizeof(checksumHeader));
+    checksum = hashBytes(checksum, meshEntries, header.meshCount * sizeof(MeshEntry));
+    checksum = hashBytes(checksum, instances, header.instanceCount * sizeof(SceneInstance));
+    if (checksum != header.checksum)
+    {
+        std::cout << "Scene cache: " << path << " is corrupt." << std::endl;
+        return false;
+    }
+
+    // Everything is checked before the scene is touched.
+    uint64_t triangleCount = 0;
+    for (uint32_t i = 0; i < header.meshCount; ++i)
+    {
+        const MeshEntry& entry = meshEntries[i];
+        bool valid = true;
+        for (uint32_t section = 0; section < SECTION_COUNT; ++section)
+        {
+            valid &= (entry.offset[section] % kSectionAlignment) == 0 && entry.offset[section] <= size &&
+                     entry.count[section] <= (size - entry.offset[section]) / kSectionElementSizes[section];
+        }
+
+        const uint64_t vertexCount = entry.count[SECTION_VERTICES];
+        const uint64_t meshTriangles = entry.count[SECTION_INDICES] / 3;
+        valid &= entry.count[SECTION_NORMALS] == vertexCount && entry.count[SECTION_COLORS] == vertexCount &&
+                 entry.count[SECTION_INDICES] % 3 == 0 && entry.count[SECTION_MATERIAL_IDS] == meshTriangles;
+
+        // The checksum doesn't cover the sections, an index past the vertices would have
+        // every backend reading out of bounds. The BVH is checked by CpuBVH::load().
+        const uint32_t* indices = (const uint32_t*)(data + entry.offset[SECTION_INDICES]);
+        for (uint64_t n = 0; valid && n < entry.count[SECTION_INDICES]; ++n)
+        {
+            valid = indices[n] < vertexCount;
+        }
+
+        if (!valid)
+        {
+            std::cout << "Scene cache: " << path << " has a malformed mesh." << std::endl;
+            return false;
+        }
+
+        triangleCount += meshTriangles;
+    }
+
+    for (uint32_t i = 0; i < header.instanceCount; ++i)
+    {
+        if (instances[i].meshID >= header.meshCount)
+        {
+            std::cout << "Scene cache: " << path << " has a malformed instance." << std::endl;
+            return false;
+        }
+    }
+
+    const uint32_t firstMesh = (uint32_t)scene->m_meshes.size();
+    for (uint32_t i = 0; i < header.meshCount; ++i)
+    {
+        SceneMesh mesh;
+        for (uint32_t section = 0; section < SECTION_COUNT; ++section)
+        {
+            setSectionView(mesh, section, data + meshEntries[i].offset[section], (size_t)meshEntries[i].count[section]);
+        }
+        scene->addMesh(std::move(mesh));
+    }
+
+    for (uint32_t i = 0; i < header.instanceCount; ++i)
+    {
+        SceneInstance instance = instances[i];
+        instance.meshID += firstMesh;
+        scene->m_instances.push_back(instance);
+    }
+
+    scene->addMappedFile(std::move(file));
+
+    m_fileSize = size;
+    m_timeMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+    std::cout << "Scene cache: mapped " << path << ", " << (m_fileSize / (1024.0f * 1024.0f)) << " MB in " << m_timeMs << " ms, "
+              << header.meshCount << " meshes, " << header.instanceCount << " instances, " << triangleCount << " triangles." << std::endl;
+    return true;
+}
+
+float SceneCache::getTimeMs() const
+{
+    return m_timeMs;
+}
@@ -0,0 +1,50 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#ifndef SCENECACHE_HEADER_GUARD
+#define SCENECACHE_HEADER_GUARD
+
+#include "engine/Scene.h"
+
+#include <stdint.h>
+#include <string>
+
+namespace toyraygun
+{
+    // Binary snapshot of a Scene's meshes and instances along with the CPU BVH of every
+    // mesh. Each array is stored in its own section, aligned so the mapped file can be
+    // viewed by the scene as is: loading is validating the header and pointing buffers
+    // at the sections, nothing is parsed or rebuilt.
+    //
+    // A cache is rejected if its format version, layout or size don't match this build,
+    // or if the file the scene was loaded from has changed size or modification time
+    // since the cache was written.
+    class SceneCache
+    {
+    protected:
+        struct Header;
+        struct MeshEntry;
+
+        // Stats
+        float m_timeMs;
+        uint64_t m_fileSize;
+
+    public:
+        SceneCache();
+
+        // sourcePath is the file the scene came from, or empty if there isn't one. Builds
+        // the BVHs of meshes that don't have one yet and keeps them in the scene, zero
+        // threads uses one per hardware thread.
+        bool write(const std::string& path, Scene* scene, const std::string& sourcePath, uint32_t threadCount = 0);
+
+        // Adds the cached meshes and instances to the scene, false if the cache is
+        // missing, stale or doesn't match.
+        bool load(const std::string& path, Scene* scene, const std::string& sourcePath);
+
+        float getTimeMs() const;
+    };
+}
+
+#endif // SCENECACHE_HEADER_GUARD
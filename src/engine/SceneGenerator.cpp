@@ -0,0 +1,354 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#include "SceneGenerator.h"
+#include "engine/Renderer.h"
+using namespace toyraygun;
+
+#include <chrono>
+#include <iostream>
+#include <string.h>
+#include <utility>
+#include <bx/math.h>
+
+// Cubes are kept inside the Cornell box's volume so its light sits above them.
+static const float kVolumeHalfWidth = 0.9f;
+static const float kVolumeBottom = 0.05f;
+static const float kVolumeHeight = 1.8f;
+
+// Keeps size^3 and the plane's vertex count within 32 bits.
+static const uint32_t kMaxGridSize = 1024;
+static const uint32_t kMaxPlaneSize = 65534;
+
+static const float kPalette[][3] =
+{
+    { 0.725f, 0.71f,  0.68f  },
+    { 0.63f,  0.065f, 0.05f  },
+    { 0.14f,  0.491f, 0.05f  },
+    { 0.1f,   0.25f,  0.6f   },
+    { 0.8f,   0.6f,   0.1f   },
+    { 0.5f,   0.2f,   0.6f   },
+    { 0.2f,   0.6f,   0.6f   },
+    { 0.9f,   0.9f,   0.9f   },
+};
+static const uint32_t kPaletteSize = sizeof(kPalette) / sizeof(kPalette[0]);
+
+SceneGenerator::SceneGenerator() :
+    m_randomState(0),
+    m_timeMs(0.0f)
+{
+
+}
+
+// PCG32, the same sequence everywhere unlike rand() or the std distributions.
+uint32_t SceneGenerator::nextRandom()
+{
+    const uint64_t state = m_randomState;
+    m_randomState = state * 6364136223846793005ull + 1442695040888963407ull;
+
+    const uint32_t xorShifted = (uint32_t)(((state >> 18) ^ state) >> 27);
+    const uint32_t rotation = (uint32_t)(state >> 59);
+    return (xorShifted >> rotation) | (xorShifted << ((32 - rotation) & 31));
+}
+
+// Uniform in [0, 1).
+float SceneGenerator::nextRandomFloat()
+{
+    return (nextRandom() >> 8) * (1.0f / 16777216.0f);
+}
+
+bx::Vec3 SceneGenerator::nextColor()
+{
+    const float* color = kPalette[nextRandom() % kPaletteSize];
+    return bx::Vec3(color[0], color[1], color[2]);
+}
+
+// A floor under everything and the Cornell box's light above it.
+void SceneGenerator::addStage(Scene* scene)
+{
+    float transform[16];
+
+    bx::mtxSRT(transform, 4.0f, 4.0f, 4.0f, 0.0f, 0.0f, 0.0f, 0.0f, 2.0f, 0.0f);
+    scene->addPlane(bx::Vec3(0.725f, 0.71f, 0.68f), transform);
+
+    bx::mtxSRT(transform, 0.5f, 1.98f, 0.5f, 0.0f, 0.0f, bx::kPi, 0.0f, 1.0f, 0.0f);
+    scene->addAreaLight(bx::Vec3(4.0f, 4.0f, 4.0f), transform);
+}
+
+void SceneGenerator::generateCubeGrid(Scene* scene, uint32_t size)
+{
+    size = bx::min(size, kMaxGridSize);
+    scene->m_instances.reserve(scene->m_instances.size() + (size_t)size * size * size + 2);
+    addStage(scene);
+
+    const float cellSize = (kVolumeHalfWidth * 2.0f) / size;
+    const float cubeSize = cellSize * 0.6f;
+
+    float transform[16];
+    for (uint32_t y = 0; y < size; ++y)
+    {
+        for (uint32_t z = 0; z < size; ++z)
+        {
+            for (uint32_t x = 0; x < size; ++x)
+            {
+                bx::mtxSRT(transform, cubeSize, cubeSize, cubeSize,
+                           0.0f, nextRandomFloat() * bx::kPi2, 0.0f,
+                           -kVolumeHalfWidth + (x + 0.5f) * cellSize,
+                           kVolumeBottom + (y + 0.5f) * cellSize,
+                           -kVolumeHalfWidth + (z + 0.5f) * cellSize);
+                scene->addCube(nextColor(), transform);
+            }
+        }
+    }
+}
+
+void SceneGenerator::generateCubeCloud(Scene* scene, uint32_t size)
+{
+    scene->m_instances.reserve(scene->m_instances.size() + size + 2);
+    addStage(scene);
+
+    // Roughly as big as grid cells holding the same number of cubes.
+    const float baseSize = (kVolumeHalfWidth * 2.0f) / bx::max(bx::pow((float)size, 1.0f / 3.0f), 1.0f) * 0.5f;
+
+    float transform[16];
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        const float scale = baseSize * (0.5f + nextRandomFloat());
+        const float rotationX = nextRandomFloat() * bx::kPi2;
+        const float rotationY = nextRandomFloat() * bx::kPi2;
+        const float rotationZ = nextRandomFloat() * bx::kPi2;
+        const float x = (nextRandomFloat() * 2.0f - 1.0f) * kVolumeHalfWidth;
+        const float y = kVolumeBottom + nextRandomFloat() * kVolumeHeight;
+        const float z = (nextRandomFloat() * 2.0f - 1.0f) * kVolumeHalfWidth;
+
+        bx::mtxSRT(transform, scale, scale, scale, rotationX, rotationY, rotationZ, x, y, z);
+        scene->addCube(nextColor(), transform);
+    }
+}
+
+void SceneGenerator::generateTessellatedPlane(Scene* scene, uint32_t size)
+{
+    size = bx::clamp(size, 1u, kMaxPlaneSize);
+    addStage(scene);
+
+    // A few random waves summed into a height above the floor.
+    static const uint32_t kWaveCount = 4;
+    float waveX[kWaveCount];
+    float waveZ[kWaveCount];
+    float wavePhase[kWaveCount];
+    float waveAmplitude[kWaveCount];
+    for (uint32_t w = 0; w < kWaveCount; ++w)
+    {
+        const float angle = nextRandomFloat() * bx::kPi2;
+        const float frequency = 2.0f + nextRandomFloat() * 10.0f;
+        waveX[w] = bx::cos(angle) * frequency;
+        waveZ[w] = bx::sin(angle) * frequency;
+        wavePhase[w] = nextRandomFloat() * bx::kPi2;
+        waveAmplitude[w] = 0.08f / (w + 1);
+    }
+
+    const uint32_t rowLength = size + 1;
+    const size_t vertexCount = (size_t)rowLength * rowLength;
+    const size_t triangleCount = (size_t)size * size * 2;
+    const bx::Vec3 color = nextColor();
+
+    SceneMesh mesh;
+    mesh.vertexBuffer.resize(vertexCount, bx::Vec3(0.0f, 0.0f, 0.0f));
+    mesh.normalBuffer.resize(vertexCount, bx::Vec3(0.0f, 1.0f, 0.0f));
+    mesh.colorBuffer.resize(vertexCount, color);
+    mesh.indexBuffer.resize(triangleCount * 3, 0);
+    mesh.materialIDBuffer.resize(triangleCount, MATERIAL_DEFAULT);
+
+    bx::Vec3* positions = &mesh.vertexBuffer[0];
+    bx::Vec3* normals = &mesh.normalBuffer[0];
+    for (uint32_t row = 0; row < rowLength; ++row)
+    {
+        const float z = -kVolumeHalfWidth + (kVolumeHalfWidth * 2.0f * row) / size;
+        for (uint32_t column = 0; column < rowLength; ++column)
+        {
+            const float x = -kVolumeHalfWidth + (kVolumeHalfWidth * 2.0f * column) / size;
+
+            float height = 0.3f;
+            float slopeX = 0.0f;
+            float slopeZ = 0.0f;
+            for (uint32_t w = 0; w < kWaveCount; ++w)
+            {
+                const float phase = waveX[w] * x + waveZ[w] * z + wavePhase[w];
+                const float slope = waveAmplitude[w] * bx::cos(phase);
+                height += waveAmplitude[w] * bx::sin(phase);
+                slopeX += slope * waveX[w];
+                slopeZ += slope * waveZ[w];
+            }
+
+            const size_t vertex = (size_t)row * rowLength + column;
+            positions[vertex] = bx::Vec3(x, height, z);
+            normals[vertex] = bx::normalize(bx::Vec3(-slopeX, 1.0f, -slopeZ));
+        }
+    }
+
+    // Two triangles per quad facing up, wound like the plane shape.
+    uint32_t* indices = &mesh.indexBuffer[0];
+    for (uint32_t row = 0; row < size; ++row)
+    {
+        for (uint32_t column = 0; column < size; ++column)
+        {
+            const uint32_t v00 = row * rowLength + column;
+            const uint32_t v10 = v00 + 1;
+            const uint32_t v01 = v00 + rowLength;
+            const uint32_t v11 = v01 + 1;
+
+            uint32_t* quad = indices + ((size_t)row * size + column) * 6;
+            quad[0] = v00;
+            quad[1] = v11;
+            quad[2] = v10;
+            quad[3] = v00;
+            quad[4] = v01;
+            quad[5] = v11;
+        }
+    }
+
+    float identity[16];
+    bx::mtxIdentity(identity);
+    scene->addInstance(scene->addMesh(std::move(mesh)), identity);
+}
+
+void SceneGenerator::generateLightRoom(Scene* scene, uint32_t size)
+{
+    // Lights sit on a grid half a unit apart, the room is a Cornell box scaled to fit.
+    const uint32_t lightsPerRow = bx::max((uint32_t)bx::ceil(bx::sqrt((float)size)), 1u);
+    const float roomScale = bx::max(lightsPerRow * 0.25f, 1.0f);
+    const float roomSize = roomScale * 2.0f;
+
+    const bx::Vec3 white(0.725f, 0.71f, 0.68f);
+    float transform[16];
+
+    bx::mtxSRT(transform, roomSize, roomSize, roomSize, 0.0f, 0.0f, bx::kPi, 0.0f, roomScale, 0.0f);
+    scene->addPlane(white, transform);
+    bx::mtxSRT(transform, roomSize, roomSize, roomSize, 0.0f, 0.0f, 0.0f, 0.0f, roomScale, 0.0f);
+    scene->addPlane(white, transform);
+    bx::mtxSRT(transform, roomSize, roomSize, roomSize, 0.0f, 0.0f, bx::kPi / 2.0f, 0.0f, roomScale, 0.0f);
+    scene->addPlane(bx::Vec3(0.63f, 0.065f, 0.05f), transform);
+    bx::mtxSRT(transform, roomSize, roomSize, roomSize, 0.0f, 0.0f, -bx::kPi / 2.0f, 0.0f, roomScale, 0.0f);
+    scene->addPlane(bx::Vec3(0.14f, 0.491f, 0.05f), transform);
+    bx::mtxSRT(transform, roomSize, roomSize, roomSize, -bx::kPi / 2.0f, 0.0f, 0.0f, 0.0f, roomScale, 0.0f);
+    scene->addPlane(white, transform);
+
+    // The Cornell box's two boxes.
+    bx::mtxSRT(transform, 0.6f * roomScale, 0.6f * roomScale, 0.6f * roomScale, 0.0f, 0.3f, 0.0f,
+               0.3275f * roomScale, 0.3f * roomScale, 0.3725f * roomScale);
+    scene->addCube(white, transform);
+    bx::mtxSRT(transform, 0.6f * roomScale, 1.2f * roomScale, 0.6f * roomScale, 0.0f, -0.3f, 0.0f,
+               -0.335f * roomScale, 0.6f * roomScale, -0.29f * roomScale);
+    scene->addCube(white, transform);
+
+    // Small lights of random warm and cool tints, jittered in their cells just under the ceiling.
+    const float cellSize = roomSize / lightsPerRow;
+    const float lightSize = cellSize * 0.4f;
+
+    // Together the lights give off what the Cornell box's light does over the same floor area.
+    const float radiance = (roomScale * roomScale) / (size * lightSize * lightSize);
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        const uint32_t row = i / lightsPerRow;
+        const uint32_t column = i % lightsPerRow;
+        const float x = -roomScale + (column + 0.5f + (nextRandomFloat() - 0.5f) * 0.4f) * cellSize;
+        const float z = -roomScale + (row + 0.5f + (nextRandomFloat() - 0.5f) * 0.4f) * cellSize;
+
+        const float warmth = nextRandomFloat();
+        const bx::Vec3 color = bx::mul(bx::Vec3(0.8f + 0.2f * warmth, 0.9f, 1.0f - 0.2f * warmth), radiance);
+
+        bx::mtxSRT(transform, lightSize, 0.02f, lightSize, 0.0f, 0.0f, bx::kPi, x, roomSize - 0.02f, z);
+        scene->addAreaLight(color, transform);
+    }
+}
+
+void SceneGenerator::generate(Scene* scene, GeneratedSceneType type, uint32_t size, uint32_t seed)
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    // Standard PCG seeding.
+    m_randomState = 0;
+    nextRandom();
+    m_randomState += seed;
+    nextRandom();
+
+    const size_t firstInstance = scene->m_instances.size();
+    const char* name = "";
+    switch (type)
+    {
+        case GeneratedSceneType::CubeGrid:
+            name = "cube grid";
+            generateCubeGrid(scene, size);
+            break;
+        case GeneratedSceneType::CubeCloud:
+            name = "cube cloud";
+            generateCubeCloud(scene, size);
+            break;
+        case GeneratedSceneType::TessellatedPlane:
+            name = "tessellated plane";
+            generateTessellatedPlane(scene, size);
+            break;
+        case GeneratedSceneType::LightRoom:
+            name = "light room";
+            generateLightRoom(scene, size);
+            break;
+    }
+
+    uint64_t triangleCount = 0;
+    for (size_t i = firstInstance; i < scene->m_instances.size(); ++i)
+    {
+        triangleCount += scene->m_meshes[scene->m_instances[i].meshID].indexBuffer.size() / 3;
+    }
+
+    m_timeMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+    std::cout << "Generated " << name << " of size " << size << " from seed " << seed << ": "
+              << (scene->m_instances.size() - firstInstance) << " instances, " << triangleCount << " triangles in "
+              << m_timeMs << " ms." << std::endl;
+}
+
+bool SceneGenerator::parseType(const char* name, GeneratedSceneType& typeOut)
+{
+    static const struct
+    {
+        const char* name;
+        GeneratedSceneType type;
+    } types[] =
+    {
+        { "grid", GeneratedSceneType::CubeGrid },
+        { "cloud", GeneratedSceneType::CubeCloud },
+        { "plane", GeneratedSceneType::TessellatedPlane },
+        { "lights", GeneratedSceneType::LightRoom },
+    };
+
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); ++i)
+    {
+        if (strcmp(name, types[i].name) == 0)
+        {
+            typeOut = types[i].type;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint32_t SceneGenerator::getDefaultSize(GeneratedSceneType type)
+{
+    switch (type)
+    {
+        case GeneratedSceneType::CubeGrid: return 16;
+        case GeneratedSceneType::CubeCloud: return 10000;
+        case GeneratedSceneType::TessellatedPlane: return 1024;
+        case GeneratedSceneType::LightRoom: return 64;
+    }
+
+    return 1;
+}
+
+float SceneGenerator::getTimeMs() const
+{
+    return m_timeMs;
+}
@@ -0,0 +1,65 @@
+/*
+ * Toy Raygun
+ * MIT License: https://github.com/andr3wmac/ToyRaygun/LICENSE
+ */
+
+#ifndef SCENEGENERATOR_HEADER_GUARD
+#define SCENEGENERATOR_HEADER_GUARD
+
+#include "engine/Scene.h"
+
+#include <stdint.h>
+
+namespace toyraygun
+{
+    enum class GeneratedSceneType
+    {
+        CubeGrid,
+        CubeCloud,
+        TessellatedPlane,
+        LightRoom,
+    };
+
+    // Procedural stress scenes for benchmarking, the same seed and size always give the
+    // same scene on every platform. Each one stands on a floor under the Cornell box's
+    // light:
+    //
+    //  CubeGrid          size^3 cubes in a grid.
+    //  CubeCloud         size randomly placed, rotated and scaled cubes.
+    //  TessellatedPlane  A rolling heightfield of size x size quads in one mesh.
+    //  LightRoom         A Cornell box sized to fit size area lights on its ceiling.
+    //
+    // Cubes are instances of a few shared meshes, so grids and clouds can reach hundreds
+    // of millions of triangles.
+    class SceneGenerator
+    {
+    protected:
+        uint64_t m_randomState;
+
+        // Stats
+        float m_timeMs;
+
+        uint32_t nextRandom();
+        float nextRandomFloat();
+        bx::Vec3 nextColor();
+
+        void addStage(Scene* scene);
+        void generateCubeGrid(Scene* scene, uint32_t size);
+        void generateCubeCloud(Scene* scene, uint32_t size);
+        void generateTessellatedPlane(Scene* scene, uint32_t size);
+        void generateLightRoom(Scene* scene, uint32_t size);
+
+    public:
+        SceneGenerator();
+
+        void generate(Scene* scene, GeneratedSceneType type, uint32_t size, uint32_t seed);
+
+        // Type from its command line name: grid, cloud, plane or lights.
+        static bool parseType(const char* name, GeneratedSceneType& typeOut);
+        static uint32_t getDefaultSize(GeneratedSceneType type);
+
+        float getTimeMs() const;
+    };
+}
+
+#endif // SCENEGENERATOR_HEADER_GUARD
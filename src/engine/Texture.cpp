@@ -20,9 +20,15 @@ Texture Texture::generateRandomTexture(int width, int height, int channels)
     
     uint8_t* randomValues = randomTexture.getBufferPointer();
     
-    for (int i = 0; i < (width * height * channels); i++)
+    // One number per pixel spread over its channels, the renderers read 4 channels as a
+    // uint. RAND_MAX can be as low as 32767 so two calls make up the 20 bits.
+    for (int i = 0; i < (width * height); i++)
     {
-        randomValues[i] = rand() % (1024 * 1024);
+        uint32_t value = (((uint32_t)rand() << 15) ^ (uint32_t)rand()) % (1024 * 1024);
+        for (int c = 0; c < channels; c++)
+        {
+            randomValues[(i * channels) + c] = (c < 4) ? (uint8_t)(value >> (c * 8)) : 0;
+        }
     }
     
     return randomTexture;
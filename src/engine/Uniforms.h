@@ -10,8 +10,10 @@
 
 #ifdef PLATFORM_WINDOWS
 #include "engine/D3D12/D3D12Uniforms.h"
-#else
+#elif PLATFORM_OSX
 #include "engine/Metal/MetalUniforms.h"
+#else
+#include "engine/CPU/CpuUniforms.h"
 #endif
 
 namespace toyraygun
@@ -36,8 +38,13 @@ namespace toyraygun
         unsigned int width;
         unsigned int height;
         unsigned int frameIndex;
+        unsigned int indexSize;  // Bytes per index, 2 or 4.
         Camera camera;
         AreaLight light;
+
+        // The light's triangles in the baked scene, none if there isn't a light.
+        unsigned int lightFirstTriangle;
+        unsigned int lightTriangleCount;
     };
 }
 
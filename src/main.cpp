@@ -4,23 +4,25 @@
  */
 
 #include "engine/Engine.h"
+#include "engine/GltfLoader.h"
+#include "engine/ObjLoader.h"
 #include "engine/Renderer.h"
+#include "engine/SceneCache.h"
+#include "engine/SceneGenerator.h"
 #include "engine/Shader.h"
 using namespace toyraygun;
 
 #include <bx/math.h>
+#include <float.h>
 #include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
 
 #include "cornellBox.h"
 
-int main (int argc, char *args[])
+static bool loadShaders(std::vector<Shader*>& shaders)
 {
-    // Uncomment to load PIX debugging DLL.
-    // Engine::initPIXDebugger();
-
-    Engine* engine = Engine::instance();
-    engine->init(1024, 768);
-    
     Shader* rtShader = Engine::createShader();
     if (rtShader->load("Raytracing"))
     {
@@ -33,7 +35,7 @@ int main (int argc, char *args[])
         if (!rtShader->compile(ShaderType::Raytrace))
         {
             std::cout << "Failed to compile Raytracing shader." << std::endl;
-            return -1;
+            return false;
         }
     }
     else {
@@ -48,7 +50,7 @@ int main (int argc, char *args[])
         if (!accumulateShader->compile(ShaderType::Compute))
         {
             std::cout << "Failed to compile Accumulate shader." << std::endl;
-            return -1;
+            return false;
         }
     }
     else {
@@ -64,33 +66,199 @@ int main (int argc, char *args[])
         if (!postProcessingShader->compile(ShaderType::Graphics))
         {
             std::cout << "Failed to compile PostProcessing shader." << std::endl;
-            return -1;
+            return false;
         }
     }
     else {
         // Print error.
     }
 
-    Renderer* renderer = Engine::createRenderer();
+    shaders.push_back(rtShader);
+    shaders.push_back(accumulateShader);
+    shaders.push_back(postProcessingShader);
+
+    return true;
+}
+
+// Looks at the whole scene from in front of it, down the -z axis like the Cornell box camera.
+static void frameScene(Renderer* renderer, Scene* scene)
+{
+    bx::Vec3 boundsMin(FLT_MAX, FLT_MAX, FLT_MAX);
+    bx::Vec3 boundsMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (size_t i = 0; i < scene->m_instances.size(); ++i)
+    {
+        const SceneInstance& instance = scene->m_instances[i];
+        const SceneBuffer<bx::Vec3>& vertices = scene->m_meshes[instance.meshID].vertexBuffer;
+        const float* t = instance.transform;
+
+        for (size_t v = 0; v < vertices.size(); ++v)
+        {
+            const bx::Vec3& p = vertices[v];
+            const bx::Vec3 world(p.x * t[0] + p.y * t[1] + p.z * t[2] + t[3],
+                                 p.x * t[4] + p.y * t[5] + p.z * t[6] + t[7],
+                                 p.x * t[8] + p.y * t[9] + p.z * t[10] + t[11]);
+            boundsMin = bx::min(boundsMin, world);
+            boundsMax = bx::max(boundsMax, world);
+        }
+    }
+
+    if (boundsMin.x > boundsMax.x)
+    {
+        return;
+    }
+
+    const bx::Vec3 center = bx::mul(bx::add(boundsMin, boundsMax), 0.5f);
+    const float radius = bx::length(bx::sub(boundsMax, boundsMin)) * 0.5f;
+
+    renderer->setCameraPosition(bx::add(center, bx::Vec3(0.0f, 0.0f, radius * 2.0f)));
+    renderer->setCameraLookAt(center);
+}
+
+int main (int argc, char *args[])
+{
+    // Uncomment to load PIX debugging DLL.
+    // Engine::initPIXDebugger();
+
+    Engine* engine = Engine::instance();
+    engine->setCommandLine(argc, args);
+    engine->init(1024, 768);
+
+    // Pass --cpu to use the CPU renderer on machines that have a GPU backend.
+    RendererType rendererType = Engine::getDefaultRendererType();
+    if (engine->hasArg("--cpu"))
+    {
+        rendererType = RendererType::CPU;
+    }
+    
+    // GPU backends need their shaders compiled, the CPU renderer has its own versions.
+    std::vector<Shader*> shaders;
+    if (rendererType != RendererType::CPU && !loadShaders(shaders))
+    {
+        return -1;
+    }
+
+    Renderer* renderer = Engine::createRenderer(rendererType);
+    if (renderer == nullptr)
+    {
+        std::cout << "Requested renderer is not supported on this platform." << std::endl;
+        return -1;
+    }
+
     if (!renderer->init())
     {
         std::cout << "Renderer failed to initialize." << std::endl;
         return -1;
     }
 
-    renderer->addShader(rtShader);
-    renderer->addShader(accumulateShader);
-    renderer->addShader(postProcessingShader);
+    for (int i = 0; i < shaders.size(); ++i)
+    {
+        renderer->addShader(shaders[i]);
+    }
 
     renderer->setCameraPosition(bx::Vec3(0.0f, 1.0f, 3.38f));
     renderer->setCameraLookAt(bx::Vec3(0.0f, 1.0f, -1.0f));
 
-    Scene* scene = createCornellBoxScene();
+    Scene* scene = nullptr;
+
+    // Pass --obj <path> to load a Wavefront OBJ or --gltf <path> a binary glTF instead of the Cornell box.
+    // With --cache <path> as well the loaded scene is saved to a binary cache, later runs map
+    // that instead as long as the file hasn't changed.
+    const char* objPath = engine->getArgValue("--obj");
+    const char* gltfPath = engine->getArgValue("--gltf");
+    const char* sourcePath = (gltfPath != nullptr) ? gltfPath : objPath;
+    if (sourcePath != nullptr)
+    {
+        const char* threads = engine->getArgValue("--threads");
+        const uint32_t threadCount = (threads != nullptr) ? atoi(threads) : 0;
+        const char* cachePath = engine->getArgValue("--cache");
+
+        scene = new Scene();
+        SceneCache cache;
+        if (cachePath == nullptr || !cache.load(cachePath, scene, sourcePath))
+        {
+            bool loaded = false;
+            if (gltfPath != nullptr)
+            {
+                GltfLoader loader;
+                loaded = loader.load(gltfPath, scene);
+            }
+            else
+            {
+                ObjLoader loader;
+                loaded = loader.load(objPath, scene, threadCount);
+            }
+
+            if (!loaded)
+            {
+                return -1;
+            }
+
+            if (cachePath != nullptr)
+            {
+                cache.write(cachePath, scene, sourcePath, threadCount);
+            }
+        }
+
+        frameScene(renderer, scene);
+    }
+    else if (engine->getArgValue("--generate") != nullptr)
+    {
+        // Pass --generate grid|cloud|plane|lights for a procedural stress scene, --size and
+        // --seed pick how big and which one.
+        GeneratedSceneType type;
+        if (!SceneGenerator::parseType(engine->getArgValue("--generate"), type))
+        {
+            std::cout << "Unknown scene type, expected grid, cloud, plane or lights." << std::endl;
+            return -1;
+        }
+
+        const char* size = engine->getArgValue("--size");
+        const char* seed = engine->getArgValue("--seed");
+
+        scene = new Scene();
+        SceneGenerator generator;
+        generator.generate(scene, type, (size != nullptr) ? atoi(size) : SceneGenerator::getDefaultSize(type), (seed != nullptr) ? atoi(seed) : 0);
+
+        frameScene(renderer, scene);
+    }
+    else
+    {
+        // Pass --weld to share identical vertices between triangles.
+        scene = createCornellBoxScene(engine->hasArg("--weld"));
+    }
+
+    scene->printVertexStats();
     renderer->loadScene(scene);
+
+    // Pass --animate to bob every instance up and down by a quarter of its height, moving
+    // them through Scene::setTransform() each frame.
+    const bool animate = engine->hasArg("--animate");
+    std::vector<float> baseTransforms(animate ? scene->m_instances.size() * 16 : 0);
+    for (size_t i = 0; i < scene->m_instances.size() && animate; ++i)
+    {
+        scene->getTransform((uint32_t)i, &baseTransforms[i * 16]);
+    }
     
     while (!engine->hasQuit())
     {
         engine->pollEvents();
+
+        if (animate)
+        {
+            const float time = SDL_GetTicks() / 1000.0f;
+            for (size_t i = 0; i < scene->m_instances.size(); ++i)
+            {
+                float transform[16];
+                memcpy(transform, &baseTransforms[i * 16], sizeof(transform));
+
+                const float height = bx::length(bx::Vec3(transform[4], transform[5], transform[6]));
+                transform[13] += height * 0.25f * bx::sin(time * 2.0f + i * 0.37f);
+                scene->setTransform((uint32_t)i, transform);
+            }
+
+            renderer->updateScene(scene);
+        }
+
         renderer->renderFrame();
     }
     